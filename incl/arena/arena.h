@@ -17,6 +17,14 @@ Arena *arena_make(size_t bucket_init_size);
 void arena_destroy(Arena *arena);
 
 void *arena_alloc(Arena *arena, size_t size);
+// total number of bytes handed out by `arena_alloc` so far
+size_t arena_bytes_used(const Arena *arena);
+// makes everything allocated from ARENA invalid and hands its memory out
+// again, keeping one bucket
+void arena_reset(Arena *arena);
+// moves the buckets of SRC (and so everything allocated from it) into DST,
+// then frees SRC; DST keeps allocating from its own current bucket
+void arena_merge(Arena *dst, Arena *src);
 
 #define arena_alloc_T(_a, _n, _T) ((_T *)arena_alloc((_a), (_n)*sizeof(_T)))
 
@@ -6,11 +6,16 @@
 #define MML__CPP_COMPAT_END_DECLS }
 
 #define crestrict
+
+#include <atomic>
+#define MML__ATOMIC(T) std::atomic<T>
 #else
 #define MML__CPP_COMPAT_BEGIN_DECLS
 #define MML__CPP_COMPAT_END_DECLS
 
 #define crestrict restrict
+
+#define MML__ATOMIC(T) _Atomic(T)
 #endif
 
 #endif /* MML__CPP_COMPAT_H */
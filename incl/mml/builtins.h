@@ -0,0 +1,75 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include <stddef.h>
+
+#include "mml/eval.h"
+#include "mml/expr.h"
+#include "cpp_compat.h"
+
+MML__CPP_COMPAT_BEGIN_DECLS
+
+/* The functions of one name, which `name{...}` calls. Set the ones it has;
+ * a call uses the first that fits its arguments, in this order:
+ *   vec	any arguments, passed as unevaluated expressions
+ *   d_dd	2 real numbers (or Booleans)
+ *   cd_cdcd	2 numbers, at least one of them complex
+ *   d_v	the real numbers of a single vector argument, or of the arguments
+ *   cd_d, d_d	a first argument that is a real number
+ *   d_cd, cd_cd	a first argument that is a complex number
+ * Every kind but `vec` gets its arguments evaluated and unboxed. A function
+ * that isn't IMPURE depends only on its arguments, so a call with constant
+ * arguments may be made once, ahead of time (see `MML_compile`). */
+typedef struct MML_native {
+	MML_val_func vec;
+	double (*d_dd)(double, double);
+	_Complex double (*cd_cdcd)(_Complex double, _Complex double);
+	double (*d_v)(const double *, size_t);
+	_Complex double (*cd_d)(double);
+	double (*d_d)(double);
+	double (*d_cd)(_Complex double);
+	_Complex double (*cd_cd)(_Complex double);
+	// prints, changes the configuration or otherwise has side effects
+	bool impure;
+} MML_native;
+
+/* A constant or the functions of one name, from the table generated from
+ * `src/builtins.def` (shared read-only by every state and thread), or
+ * registered with `MML_register_native`. */
+typedef struct MML_builtin {
+	const char *name;
+	size_t len;
+	bool is_constant;
+	MML_value constant;
+	MML_native fn;
+} MML_builtin;
+
+/* Adds the functions of NATIVE that are set to the name NAME (copied), on
+ * top of any it already has, including builtin ones; NATIVE being impure
+ * makes every function of NAME impure. Registered functions are seen by
+ * every state. Not safe while any state is evaluating, so register them
+ * first. Returns 0 on success, -1 if out of memory. */
+int32_t MML_register_native(const char *name, const MML_native *native);
+
+/* Returns the builtin called NAME, or NULL if there is none. */
+const MML_builtin *MML_builtin_get(strbuf name);
+
+// the functions of lib/math.c and lib/stdmml.c the table refers to
+MML_value math__max(MML_state *crestrict state, MML_expr_vec *args);
+MML_value math__min(MML_state *crestrict state, MML_expr_vec *args);
+MML_value math__root(MML_state *crestrict state, MML_expr_vec *args);
+MML_value math__sort(MML_state *crestrict state, MML_expr_vec *args);
+MML_value math__sum(MML_state *crestrict state, MML_expr_vec *args);
+double math__logb(double a, double b);
+_Complex double math__clogb(_Complex double a, _Complex double b);
+_Complex double math__clog2(_Complex double a);
+_Complex double math__clog10(_Complex double a);
+_Complex double math__csqrt(double a);
+
+MML_value stdmml__dbg_type(MML_state *crestrict state, MML_expr_vec *args);
+MML_value stdmml__dbg_ident(MML_state *crestrict state, MML_expr_vec *args);
+MML_value stdmml__config_set(MML_state *crestrict state, MML_expr_vec *args);
+
+MML__CPP_COMPAT_END_DECLS
+
+#endif /* BUILTINS_H */
@@ -0,0 +1,50 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "mml/expr.h"
+#include "cpp_compat.h"
+
+MML__CPP_COMPAT_BEGIN_DECLS
+
+/* A directory of evaluation results shared by any number of processes. It
+ * holds two files: `index`, a fixed-size hash table that is mapped into
+ * memory, and `data`, which only ever grows. Readers take a shared `flock`
+ * on the index and writers an exclusive one. When a key's slots are all
+ * taken, a new result replaces an old one. Removing the directory empties
+ * the cache. */
+typedef struct MML_cache MML_cache;
+
+typedef struct MML_cache_key {
+	uint64_t lo, hi;
+} MML_cache_key;
+
+/* Writes the key of evaluating the N statements STMTS on STATE to *OUT: a
+ * hash of their syntax trees, of the variables already set on STATE (with
+ * the data of packed vectors), of the configuration that affects what is
+ * printed, and of the build of `mml` itself (its GNU build ID, or the
+ * executable's contents if it has none). Returns false if it ran out of
+ * memory or couldn't identify the build. */
+bool MML_cache_key_make(const MML_state *crestrict state,
+		const MML_expr *const *stmts, size_t n, MML_cache_key *out);
+
+/* Opens (creating it if needed) the cache in the directory DIR. Returns NULL
+ * after logging an error if it can't be used. */
+MML_cache *MML_cache_open(const char *dir);
+void MML_cache_close(MML_cache *c);
+
+/* If C has a result for KEY, writes it to OUT and returns true. */
+bool MML_cache_replay(MML_cache *c, MML_cache_key key, FILE *out);
+/* Keeps a copy in memory of everything STATE prints until
+ * `MML_cache_commit`; the output still reaches its sink as it is printed. */
+bool MML_cache_capture(MML_cache *c, MML_state *crestrict state);
+/* Stops copying what STATE prints, and if STORE is set, saves what it
+ * printed since `MML_cache_capture` in C as the result for KEY. */
+void MML_cache_commit(MML_cache *c, MML_state *crestrict state,
+		MML_cache_key key, bool store);
+
+MML__CPP_COMPAT_END_DECLS
+
+#endif /* CACHE_H */
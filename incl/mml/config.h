@@ -7,6 +7,7 @@
 
 #include "cpp_compat.h"
 #include "mml/token.h"
+#include "mml/reduce.h"
 
 MML__CPP_COMPAT_BEGIN_DECLS
 
@@ -29,6 +30,33 @@ enum {
 #define CCLEAR_FLAG(c_p, f) ((c_p)->runtime_flags &= ~(f))
 #define CFLAG_IS_SET(c_p, f) (((c_p)->runtime_flags & (f)) != 0)
 
+/* What printed values look like. In the machine-readable formats every
+ * printed value is one record and `print`/`println` add no separators:
+ *   binary: an 8-byte header { u8 `enum MML_binary_kind`,
+ *           u8 `enum MML_binary_elem`, 6 zero bytes } and a u64 element
+ *           count, then the elements as little-endian doubles (complex
+ *           numbers as interleaved real/imaginary pairs, integers as
+ *           int64s if every element is one)
+ *   csv:    one line per value; a vector of vectors is one line per vector,
+ *           and complex numbers take two fields
+ *   json:   one JSON value per line; complex numbers are {"re":..,"im":..} */
+enum MML_output_format {
+	MML_OUTPUT_TEXT,
+	MML_OUTPUT_BINARY,
+	MML_OUTPUT_CSV,
+	MML_OUTPUT_JSON,
+};
+enum MML_binary_kind {
+	MML_BIN_SCALAR,
+	MML_BIN_VECTOR,
+	MML_BIN_INVALID,	// a value the format can't hold, with no elements
+};
+enum MML_binary_elem {
+	MML_BIN_F64,
+	MML_BIN_C128,
+	MML_BIN_I64,
+};
+
 typedef struct MML_state MML_state;
 
 struct MML_config {
@@ -38,6 +66,17 @@ struct MML_config {
 	MML_state *eval_state;
 	bool last_print_was_newline;
 	bool full_prec_floats;
+	bool shortest_floats;
+	enum MML_output_format output_format;
+	MML_reduce_opts reduce;
+	char *serve_path;
+	char *script_path;
+	char *read_vec_name;
+	char *record_inputs;
+	char *cache_dir;
+	char *snapshot_out;
+	// errors and warnings logged so far
+	uint64_t n_problems_logged;
 };
 extern struct MML_config MML_global_config;
 
@@ -47,6 +86,13 @@ void MML_print_usage(void);
 void MML_arg_parse(int32_t argc, char **argv);
 
 strbuf MML_read_string_from_stream(FILE *stream);
+/* Maps the file at PATH read-only. The text is followed by a NUL byte, so
+ * it can be parsed in place. Returns `{ NULL, 0 }` on failure; otherwise
+ * the result must be passed to `MML_unmap_file` when it is no longer used. */
+strbuf MML_map_file(const char *path);
+/* Like `MML_map_file`, but maps the file at ADDR if that range is free. */
+strbuf MML_map_file_at(const char *path, void *addr);
+void MML_unmap_file(strbuf file);
 strbuf strbuf_dup(strbuf buf);
 
 enum LOG_TYPE {
@@ -69,9 +115,11 @@ static inline void MML_dbg_print_func(
 	switch (log_type) {
 	case MML_LOG_ERROR:
 		log_type_str = "\x1b[38;5;160mERROR\x1b[0m";
+		++MML_global_config.n_problems_logged;
 		break;
 	case MML_LOG_WARN:
 		log_type_str = "\x1b[38;5;214mWARN\x1b[0m";
+		++MML_global_config.n_problems_logged;
 		break;
 	case MML_LOG_DEBUG:
 		if (!FLAG_IS_SET(DEBUG))
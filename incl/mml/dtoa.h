@@ -0,0 +1,30 @@
+#ifndef DTOA_H
+#define DTOA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpp_compat.h"
+
+MML__CPP_COMPAT_BEGIN_DECLS
+
+/* Enough room for any result of `MML_dtoa_shortest`, and for any result of
+ * `MML_dtoa_g` with a precision up to 17, including the terminator. */
+#define MML_DTOA_BUF_SIZE 32
+
+/* The formatters below work like `snprintf`: they write at most SIZE bytes
+ * (including a terminating NUL) to BUF and return the length the full result
+ * has, so a return value >= SIZE means BUF was too small. */
+
+/* Writes the shortest decimal representation of X that reads back as X
+ * (Ryu), in the style of "%g": plain notation for exponents in [-4, 17),
+ * scientific otherwise. */
+size_t MML_dtoa_shortest(char *buf, size_t size, double x);
+/* Writes X exactly as `snprintf(buf, size, "%.*g", prec, x)` would. */
+size_t MML_dtoa_g(char *buf, size_t size, double x, uint32_t prec);
+/* Writes X exactly as `snprintf(buf, size, "%.*f", prec, x)` would. */
+size_t MML_dtoa_f(char *buf, size_t size, double x, uint32_t prec);
+
+MML__CPP_COMPAT_END_DECLS
+
+#endif /* DTOA_H */
@@ -0,0 +1,88 @@
+#ifndef ERRORS_H
+#define ERRORS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mml/config.h"
+#include "mml/expr.h"
+#include "mml/token.h"
+#include "cpp_compat.h"
+
+MML__CPP_COMPAT_BEGIN_DECLS
+
+/* What went wrong in an evaluation, recorded as a code and its operands
+ * rather than as text. The text is only made by `MML_error_format`, which
+ * happens when the error is logged; with quiet errors (see
+ * `MML_eval_set_quiet_errors`) an error costs a store into the state's ring. */
+typedef enum MML_error_code {
+	MML_ERR_NONE,
+	MML_ERR_NO_ARGS,		// SPAN called with no arguments
+	MML_ERR_UNDEFINED_FUNC,	// no function SPAN takes an argument of `types[0]`
+	MML_ERR_UNARY_OP,		// OP applied to an operand of `types[0]`
+	MML_ERR_BINARY_OP,		// OP applied to operands of `types[0]` and `types[1]`,
+					// with `args` the lengths of those that are vectors
+	MML_ERR_INDEX_NOT_INT,	// a vector indexed by a negative or fractional number
+	MML_ERR_INDEX_RANGE,		// index `args[0]` past a vector of length `args[1]`
+	MML_ERR_UNDEFINED_IDENT,	// SPAN names no constant or variable
+} MML_error_code;
+
+/* Room for the identifier of an error, including its terminator; a longer one
+ * is cut short and ends in "...". */
+#define MML_ERROR_SPAN_SIZE 48
+
+typedef struct MML_error {
+	MML_error_code code;
+	enum LOG_TYPE severity;
+	MML_token_type op;
+	MML_expr_type types[2];
+	// the identifier or function name involved, NUL-terminated; a copy,
+	// since the source it came from may be gone before the error is read
+	char span[MML_ERROR_SPAN_SIZE];
+	// the innermost node whose evaluation failed, if known; it belongs to
+	// the tree that was evaluated, so it is only valid as long as that is
+	const MML_expr *expr;
+	size_t args[2];
+	// where the error was reported from
+	const char *file;
+	uint32_t line;
+} MML_error;
+
+#define MML_ERROR_RING_SIZE 64
+
+/* The last `MML_ERROR_RING_SIZE` errors of a state, kept in the state itself
+ * so recording one never allocates. */
+typedef struct MML_error_ring {
+	MML_error ring[MML_ERROR_RING_SIZE];
+	uint64_t n_errors;	// recorded since the last `MML_errors_clear`
+	bool quiet;
+} MML_error_ring;
+
+/* Records ERR, with SPAN copied to its `span`, in the ring of STATE and,
+ * unless its errors are quiet, logs it like `MML_log` would from FILE at
+ * LINE. */
+void MML_error_report(MML_state *crestrict state, const char *file, uint32_t line,
+		strbuf span, MML_error err);
+#define MML_report(state, err_code, err_severity, ...) \
+	MML_report_span((state), (err_code), (err_severity), (strbuf) { 0 }, ##__VA_ARGS__)
+#define MML_report_span(state, err_code, err_severity, err_span, ...) \
+	(MML_error_report((state), __FILE_NAME__, __LINE__, (err_span), \
+		(MML_error) { .code = (err_code), .severity = (err_severity), ##__VA_ARGS__ }))
+
+/* Makes STATE only record its errors, without logging them. */
+void MML_eval_set_quiet_errors(MML_state *crestrict state, bool quiet);
+/* Returns the number of errors STATE recorded since its errors were last
+ * cleared, which may be more than its ring keeps. */
+uint64_t MML_errors_count(const MML_state *crestrict state);
+/* Writes the I-th most recent error of STATE (0 being the last one) to *OUT.
+ * Returns false if the ring doesn't hold that many. */
+bool MML_error_get(const MML_state *crestrict state, size_t i, MML_error *out);
+/* Writes the message of ERR (without a newline) to BUF like `snprintf`,
+ * returning the length of the whole message. */
+size_t MML_error_format(const MML_error *crestrict err, char *crestrict buf, size_t n);
+/* Forgets the errors of STATE. */
+void MML_errors_clear(MML_state *crestrict state);
+
+MML__CPP_COMPAT_END_DECLS
+
+#endif /* ERRORS_H */
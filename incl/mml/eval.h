@@ -2,7 +2,9 @@
 #define EVAL_H
 
 #include "mml/config.h"
+#include "mml/errors.h"
 #include "mml/expr.h"
+#include "mml/outbuf.h"
 #include "cpp_compat.h"
 #include "arena/arena.h"
 
@@ -12,13 +14,54 @@ extern Arena *MML_global_arena;
 
 typedef struct hashmap hashmap;
 
+#define MML_DEFAULT_MAX_DEPTH 10000
+
+/* Limits applied to every top-level evaluation (a call to `MML_eval_expr` that
+ * isn't nested inside another one). A limit of 0 means unlimited. When a limit
+ * is hit, evaluation unwinds and returns an `Invalid_type` value whose `i` is
+ * the matching `MML_*_LIMIT_INVAL` code. */
+typedef struct MML_eval_budget {
+	uint64_t max_nodes;		// expression nodes visited
+	uint64_t max_nsecs;		// wall-clock time
+	size_t max_arena_bytes;	// bytes allocated from `MML_eval_arena`
+	uint32_t max_depth;		// nesting of expression nodes (guards the C stack),
+					// `MML_DEFAULT_MAX_DEPTH` unless changed
+} MML_eval_budget;
+
 typedef struct MML_state {
 	struct MML_config *config;
 
 	hashmap *variables;
+	// what `print`, `println` and friends write, on its way to stdout
+	// (or the sink set with `MML_outbuf_set_sink`)
+	MML_outbuf out;
 
 	MML_value last_val;
 	bool is_init;
+
+	// what values made while evaluating (e.g. the result of `[1, 2] + 1`)
+	// are allocated from; NULL means `MML_global_arena`
+	Arena *arena;
+
+	// the mappings behind packed vector variables (`MML_bind_vector_mmap`,
+	// `MML_read_vector`), unmapped by `MML_cleanup_state`
+	dvec_t(strbuf) mapped_files;
+
+	// what `MML_eval_parse` parsed before, if enabled (see `MML_eval_set_parse_cache`)
+	struct MML_parse_cache *parse_cache;
+	// values of variables kept between uses, if enabled (see `MML_eval_set_memoize`)
+	struct MML_memo *memo;
+	// the last errors of its evaluations (see `MML_error_get`)
+	MML_error_ring errors;
+
+	MML_eval_budget budget;
+	MML__ATOMIC(bool) cancel_requested;
+	// bookkeeping for the evaluation currently running
+	uint64_t nodes_visited;
+	uint64_t deadline_nsecs;
+	size_t arena_start;
+	uint32_t depth;
+	int64_t abort_code;
 } MML_state;
 
 typedef MML_value (*MML_val_func)(MML_state *crestrict state, MML_expr_vec *args);
@@ -41,15 +84,100 @@ MML_state *MML_init_state(void);
  * more details. */
 void MML_cleanup_state(MML_state *crestrict state);
 
+/* Replaces the evaluation limits of STATE with BUDGET. */
+void MML_eval_set_budget(MML_state *crestrict state, const MML_eval_budget *budget);
+/* Makes STATE keep the value of a variable once it is evaluated, instead of
+ * evaluating its expression on every use, until a variable it reads is
+ * redefined (see `MML_memo`). Only variables defined while this is on are
+ * kept. Turning it off forgets every value. Returns 0 on success, -1 if out
+ * of memory. */
+int32_t MML_eval_set_memoize(MML_state *crestrict state, bool on);
+/* Asks the evaluation currently running on STATE to stop at the next node it
+ * visits; it then returns `MML_CANCELLED_INVAL`. May be called from any thread
+ * (or a signal handler). If nothing is running, the next evaluation is cancelled. */
+void MML_eval_cancel(MML_state *state);
+
 int32_t MML_eval_set_variable(MML_state *crestrict state, strbuf name, MML_expr *expr);
 MML_expr *MML_eval_get_variable(MML_state *crestrict state, strbuf name);
+/* Maps the file at PATH, which holds raw native-endian `double`s, and sets
+ * the variable NAME to a read-only vector of them. The data isn't copied; the
+ * file stays mapped until STATE is cleaned up. Returns 0 on success, -1 if
+ * the file can't be mapped or its size isn't a multiple of `sizeof(double)`. */
+int32_t MML_bind_vector_mmap(MML_state *crestrict state, strbuf name, const char *path);
 
 /* evaluates EXPR using the evaluator state data in STATE */
 MML_value MML_eval_expr(MML_state *crestrict state, const MML_expr *expr);
 MML_value MML_eval_expr_recurse(MML_state *crestrict state, const MML_expr *expr);
 
+/* Returns the arena the values STATE makes while evaluating live in. */
+static inline Arena *MML_eval_arena(const MML_state *crestrict state)
+{
+	return (state->arena != NULL) ? state->arena : MML_global_arena;
+}
+
+/* evaluates element I of the vector V, which may be packed */
+static inline MML_value MML_vec_elem(MML_state *crestrict state, const MML_expr_vec *v, size_t i)
+{
+	return (v->packed != NULL)
+		? VAL_NUM(v->packed[i])
+		: MML_eval_expr(state, v->ptr[i]);
+}
+
+/* Parses S and evaluates its statements on STATE, returning the value of the
+ * last one. With a parse cache (see `MML_eval_set_parse_cache`), a source
+ * seen before isn't parsed again, and a returned vector is only valid until
+ * the next call. */
 MML_value MML_eval_parse(MML_state *state, const char *s);
 
+/* Evaluates N sources in order on STATE, writing the value of the last
+ * statement of `srcs[i]` to `out[i]` (what `MML_eval_parse` would return for
+ * it). Later sources see variables set by earlier ones. If the batch is
+ * cancelled with `MML_eval_cancel`, it stops and every remaining element of
+ * OUT is set to `MML_CANCELLED_INVAL`. The trees of a source are freed once
+ * it is evaluated, unless it assigns a variable or its value is a vector,
+ * which point into them. Returns the number of sources evaluated. */
+size_t MML_eval_parse_many(MML_state *crestrict state,
+		const char *const *srcs, size_t n, MML_value *out);
+/* Like `MML_eval_parse_many`, but for N expressions that are already parsed
+ * (e.g. by `MML_parse`), which can be evaluated any number of times. */
+size_t MML_eval_expr_many(MML_state *crestrict state,
+		const MML_expr *const *exprs, size_t n, MML_value *out);
+
+/* A parsed expression whose parameters are read straight from `double`s,
+ * so evaluating it many times doesn't parse, allocate or look up variables. */
+typedef struct MML_prepared MML_prepared;
+
+/* Parses SRC (one or more statements) for evaluation on STATE. PARAM_NAMES is
+ * a NULL-terminated list of identifiers that become parameters; it may be
+ * NULL. Builtin constants, and calls of pure builtins on number literals,
+ * are resolved now (so variables of the same names, even ones defined
+ * later, don't change them), other identifiers when called.
+ * Returns NULL if SRC doesn't parse. Variables assigned by SRC refer to the
+ * parameters, so they can't be read once the handle is freed.
+ * Free the handle with `MML_prepared_free`. */
+MML_prepared *MML_compile(MML_state *crestrict state, const char *src, const char *const *param_names);
+/* Makes parameter PARAM of P read the `double` at LOC on every call until it
+ * is bound again, instead of taking it from the ARGS passed to `MML_call`.
+ * A LOC of NULL undoes the binding. */
+void MML_prepared_bind(MML_prepared *p, size_t param, const double *loc);
+/* Evaluates P and returns the value of its last statement. `args[i]` is the
+ * value of the i-th parameter unless that parameter is bound to a host
+ * location; ARGS may be NULL if every parameter is bound. ARGS is copied, so
+ * variables of P read later see the values of the last call. */
+MML_value MML_call(MML_prepared *p, const double *args);
+/* Returns the number of statements in P. */
+size_t MML_prepared_n_stmts(const MML_prepared *p);
+/* Returns statement STMT of P, or NULL if there is no such statement. */
+const MML_expr *MML_prepared_stmt(const MML_prepared *p, size_t stmt);
+/* Returns a mask of the parameters statement STMT of P reads, directly or
+ * through variables assigned by any statement of P: bit i is set if it
+ * reads parameter i (parameters past the 63rd all share bit 63). Changing
+ * the other parameters doesn't change the value of the statement. */
+uint64_t MML_prepared_deps(const MML_prepared *p, size_t stmt);
+/* Like `MML_call`, but evaluates only statement STMT of P. */
+MML_value MML_call_stmt(MML_prepared *p, size_t stmt, const double *args);
+void MML_prepared_free(MML_prepared *p);
+
 MML__CPP_COMPAT_END_DECLS
 
 #endif /* EVAL_H */
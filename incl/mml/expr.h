@@ -27,11 +27,16 @@ typedef enum MML_ExprType {
 	Boolean_type,
 	Identifier_type,
 	Vector_type,
+	// a parameter of a prepared expression; only appears in `MML_expr`s
+	Slot_type,
 } MML_expr_type;
 
 typedef struct {
 	MML_expr **ptr;
 	size_t n;
+	// if not NULL, the elements are these N doubles (e.g. a mapped file,
+	// see `MML_bind_vector_mmap`) and PTR is unused
+	const double *packed;
 } MML_expr_vec;
 
 typedef dvec_t(MML_expr *) MML_expr_dvec;
@@ -68,6 +73,7 @@ typedef struct MML_expr {
 		strbuf s;
 		MML_expr_vec v;
 		int64_t i;
+		const double *const *slot; // the value is `**slot`
 		struct value_union_size w; // used for copying the union between MML_expr's
 	};
 } MML_expr;
@@ -81,8 +87,18 @@ enum INVAL_TYPES {
 	MML_ERROR_INVAL,
 	MML_QUIT_INVAL,
 	MML_CLEAR_INVAL,
+
+	// an evaluation was stopped before it finished (see `MML_eval_budget`)
+	MML_NODE_LIMIT_INVAL,
+	MML_TIME_LIMIT_INVAL,
+	MML_MEMORY_LIMIT_INVAL,
+	MML_DEPTH_LIMIT_INVAL,
+	MML_CANCELLED_INVAL,
 };
 
+#define VAL_IS_ABORT(v) ((v).type == Invalid_type \
+		&& (v).i >= MML_NODE_LIMIT_INVAL && (v).i <= MML_CANCELLED_INVAL)
+
 constexpr MML_value VAL_INVAL = { Invalid_type, .i = MML_ERROR_INVAL };
 
 #define VAL_IS_NUM(v) (\
@@ -0,0 +1,24 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+
+#include "cpp_compat.h"
+
+MML__CPP_COMPAT_BEGIN_DECLS
+
+/* The 64-bit finalizer of MurmurHash3: mixes the bits of X so that each
+ * affects every bit of the result. */
+static inline uint64_t MML_hash_fmix(uint64_t x)
+{
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdull;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ull;
+	x ^= x >> 33;
+	return x;
+}
+
+MML__CPP_COMPAT_END_DECLS
+
+#endif /* HASH_H */
@@ -0,0 +1,33 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <stddef.h>
+
+#include "mml/token.h"
+#include "cpp_compat.h"
+
+MML__CPP_COMPAT_BEGIN_DECLS
+
+/* Splits the text at *S into at most N tokens written to OUT, and advances
+ * *S past them. The text ends at a NUL, or at END if it isn't NULL and no
+ * token spans it. PREV is the type of the token before *S (`MML_EOF_TOK` at
+ * the start of the text). Returns how many tokens were written; the last
+ * token of the text is an `MML_EOF_TOK` whose text is empty and starts where
+ * the text ends, and nothing is lexed after it. A number may have a
+ * fractional part and an exponent (`1.5e-9`), except right after a `.`,
+ * where it is an index (`v.1.2` is `(v.1).2`). A byte that can't start a token becomes an
+ * `MML_INVALID_TOK`, which the parser logs. */
+size_t MML_lex(const char **s, const char *end, MML_token_type prev,
+		MML_token *out, size_t n);
+/* Reads the elements of a vector literal at *S (just past its `[` or a `,`)
+ * for as long as each is a number, or a `-` and a number, followed by `,` or
+ * `]`, writing at most N of their values to OUT and advancing *S past each
+ * one's separator. *CLOSED is set once the `]` is read. Returns how many
+ * values were written; an element that isn't a plain number is left at *S
+ * to be lexed as usual. END bounds the text as for `MML_lex`. */
+size_t MML_lex_numbers(const char **s, const char *end, double *out, size_t n,
+		bool *closed);
+
+MML__CPP_COMPAT_END_DECLS
+
+#endif /* LEXER_H */
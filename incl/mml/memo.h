@@ -0,0 +1,33 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include "mml/expr.h"
+#include "cpp_compat.h"
+
+MML__CPP_COMPAT_BEGIN_DECLS
+
+/* Values of variables kept between uses, which MML otherwise re-evaluates
+ * every time (see `MML_eval_set_memoize`). Each variable records the
+ * variables its expression reads; redefining one forgets its value and the
+ * values of everything that reads it, directly or not. A variable whose
+ * expression assigns, reads `ans`, holds a parameter of a prepared
+ * expression or calls a builtin with side effects is never kept, nor is one
+ * that reads such a variable (directly or not), nor is a value that is
+ * invalid. `config_set` forgets every kept value. */
+typedef struct MML_memo MML_memo;
+
+MML_memo *MML_memo_make(void);
+void MML_memo_free(MML_memo *m);
+
+/* Records that NAME is now EXPR, forgetting the values that depended on it. */
+void MML_memo_define(MML_memo *m, strbuf name, const MML_expr *expr);
+/* If a value of NAME is kept, writes it to *OUT and returns true. */
+bool MML_memo_get(MML_memo *m, strbuf name, MML_value *out);
+/* Keeps VAL as the value of NAME, if NAME can be kept. */
+void MML_memo_put(MML_memo *m, strbuf name, MML_value val);
+/* Forgets every kept value. */
+void MML_memo_clear(MML_memo *m);
+
+MML__CPP_COMPAT_END_DECLS
+
+#endif /* MEMO_H */
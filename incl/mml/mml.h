@@ -5,6 +5,10 @@
 
 #define MML_BARE_USE
 #include "mml/eval.h"
+#include "mml/builtins.h"
 #include "mml/parser.h"
+#include "mml/errors.h"
+#include "mml/parse_cache.h"
+#include "mml/trace.h"
 
 #endif /* MML_H */
@@ -0,0 +1,33 @@
+#ifndef NUMBER_H
+#define NUMBER_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "mml/expr.h"
+#include "cpp_compat.h"
+
+MML__CPP_COMPAT_BEGIN_DECLS
+
+/* Parses all of [S, END) as a decimal number (as `strtod` would in the C
+ * locale, and rounded the same way) into *OUT. Returns false if it isn't
+ * one. `strtod` itself is only called for the rare numbers the fast paths
+ * can't round. */
+bool MML_parse_double(const char *s, const char *end, double *out);
+/* Returns the first byte in [S, END) that separates two numbers in a column
+ * of text (whitespace, ',' or ';'), or END if there is none. */
+const char *MML_find_delim(const char *s, const char *end);
+/* Parses the numbers in [S, END), separated as for `MML_find_delim`, into
+ * OUT, which has room for N of them. Returns how many numbers there are
+ * (only the first N are stored), or -1 if one of them is malformed. */
+int64_t MML_parse_doubles(const char *s, const char *end, double *out, size_t n);
+
+/* Reads decimal numbers separated by whitespace, commas or semicolons from
+ * STREAM until EOF, and sets the variable NAME to a read-only vector of them,
+ * stored like the ones `MML_bind_vector_mmap` makes. Returns 0 on success,
+ * -1 on a malformed number or a read error. */
+int32_t MML_read_vector(MML_state *crestrict state, strbuf name, FILE *stream);
+
+MML__CPP_COMPAT_END_DECLS
+
+#endif /* NUMBER_H */
@@ -0,0 +1,57 @@
+#ifndef OUTBUF_H
+#define OUTBUF_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "cpp_compat.h"
+
+MML__CPP_COMPAT_BEGIN_DECLS
+
+#define MML_OUTBUF_SIZE (1u << 16)
+
+/* Output collected in memory and written to SINK in large blocks: when the
+ * buffer fills up, on `MML_outbuf_flush`, and at every newline if SINK is a
+ * terminal (so interactive output shows up as it is printed). Whatever
+ * reaches SINK is also written to COPY, if it isn't NULL. */
+typedef struct MML_outbuf {
+	FILE *sink;
+	FILE *copy;
+	char *buf;
+	size_t len;
+	size_t cap;
+	bool line_buffered;
+} MML_outbuf;
+
+void MML_outbuf_init(MML_outbuf *o, FILE *sink);
+/* Flushes O and frees its buffer. SINK isn't closed. */
+void MML_outbuf_destroy(MML_outbuf *o);
+/* Flushes O, then sends later output to SINK. */
+void MML_outbuf_set_sink(MML_outbuf *o, FILE *sink);
+/* Flushes O, then also writes later output to COPY (or stops if NULL). */
+void MML_outbuf_set_copy(MML_outbuf *o, FILE *copy);
+/* Writes everything buffered in O to its sink, and flushes the sink. */
+void MML_outbuf_flush(MML_outbuf *o);
+
+/* Returns room for at least N bytes at `o->buf + o->len`. The caller writes
+ * there and then adds what it wrote to `o->len`. */
+char *MML_outbuf_reserve(MML_outbuf *o, size_t n);
+
+void MML_outbuf_write(MML_outbuf *o, const char *s, size_t n);
+void MML_outbuf_printf(MML_outbuf *o, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+static inline void MML_outbuf_putc(MML_outbuf *o, char c)
+{
+	if (o->len == o->cap || (c == '\n' && o->line_buffered))
+	{
+		MML_outbuf_write(o, &c, 1);
+		return;
+	}
+	o->buf[o->len++] = c;
+}
+
+MML__CPP_COMPAT_END_DECLS
+
+#endif /* OUTBUF_H */
@@ -0,0 +1,50 @@
+#ifndef PARSE_CACHE_H
+#define PARSE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mml/expr.h"
+#include "cpp_compat.h"
+
+MML__CPP_COMPAT_BEGIN_DECLS
+
+/* A per-state cache of the statements `MML_eval_parse` has parsed, keyed by
+ * a hash of their source text (which is compared in full, so a collision is
+ * only a miss). Each entry owns an arena holding its trees and a copy of its
+ * source. Once the entries take more than the cache's limit, the least
+ * recently used ones are dropped after an evaluation, never the one it used.
+ * The trees of a dropped entry are freed unless something may still point
+ * into them (a variable it assigned, or the last value being a vector); then
+ * they are moved to `MML_global_arena`, where uncached trees live anyway. */
+typedef struct MML_parse_cache MML_parse_cache;
+
+typedef struct MML_parse_cache_stats {
+	uint64_t hits, misses;
+	uint64_t evictions;
+	size_t n_entries;
+	size_t bytes;	// taken by the entries, compared against the limit
+	size_t max_bytes;
+} MML_parse_cache_stats;
+
+/* Makes `MML_eval_parse` on STATE reuse what it parsed for sources it has
+ * seen before, keeping at most about MAX_BYTES of them. A MAX_BYTES of 0
+ * turns the cache off and empties it; changing the limit keeps the entries
+ * and the counters. Returns 0 on success, -1 if out of memory. */
+int32_t MML_eval_set_parse_cache(MML_state *crestrict state, size_t max_bytes);
+/* Returns the counters of the parse cache of STATE (all 0 if it has none). */
+MML_parse_cache_stats MML_eval_parse_cache_stats(const MML_state *crestrict state);
+
+/* Returns the statements of S, parsing them into a new entry of C if it
+ * has none. Returns NULL if out of memory. The statements stay valid until
+ * the next `MML_parse_cache_trim` or `MML_parse_cache_free`. */
+const MML_expr_dvec *MML_parse_cache_get(MML_parse_cache *c, const char *s);
+/* Drops least recently used entries of C until it is within its limit.
+ * KEEP_TREES is set if values outside the cache may point into any entry's
+ * trees. */
+void MML_parse_cache_trim(MML_parse_cache *c, bool keep_trees);
+void MML_parse_cache_free(MML_parse_cache *c);
+
+MML__CPP_COMPAT_END_DECLS
+
+#endif /* PARSE_CACHE_H */
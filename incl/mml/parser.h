@@ -2,6 +2,7 @@
 #define PARSER_H
 
 #include "mml/token.h"
+#include "mml/lexer.h"
 #include "mml/expr.h"
 #include "mml/eval.h"
 #include "cpp_compat.h"
@@ -11,6 +12,42 @@ MML__CPP_COMPAT_BEGIN_DECLS
 MML_expr *MML_parse(const char *s);
 
 MML_expr_dvec MML_parse_stmts(const char *s);
+/* Like `MML_parse_stmts`, but identifiers point into S instead of being
+ * copied, so S must stay valid (and unchanged) for as long as the result
+ * and any variables it defines are used. */
+MML_expr_dvec MML_parse_stmts_borrowed(const char *s);
+
+/* Like `MML_parse` and `MML_parse_stmts(_borrowed)`, but the trees (and the
+ * copied identifiers) are allocated from ARENA. The parser has no other
+ * shared state, so calls with different arenas may run at the same time. */
+MML_expr *MML_parse_in(Arena *arena, const char *s);
+MML_expr_dvec MML_parse_stmts_in(Arena *arena, const char *s, bool borrow_idents);
+/* Same result as `MML_parse_stmts_in`, but a large S is split after `;`s
+ * into up to N_THREADS parts that are parsed at once, each into an arena of
+ * its own that is merged into ARENA afterwards. The parts are parsed
+ * without logging; if one has a problem (e.g. a statement turns out to span
+ * two parts, only possible when S has a syntax error), S is parsed again in
+ * one piece, which logs what it finds. */
+MML_expr_dvec MML_parse_stmts_parallel(Arena *arena, const char *s,
+		bool borrow_idents, uint32_t n_threads);
+
+/* Called by `MML_expr_walk` for each node EXPR (which may be NULL) with the
+ * node PARENT that holds it, or NULL for the root. Returns false to stop the
+ * walk. */
+typedef bool (*MML_expr_visit)(const MML_expr *expr, const MML_expr *parent, void *usr);
+/* Calls VISIT on EXPR and then on every node below it, each before its
+ * children and the children in order (left before right, vector elements
+ * from the first). Missing children are visited as NULL, and the elements
+ * of packed vectors aren't visited. Trees of any depth can be walked.
+ * Returns false if the walk ran out of memory and couldn't finish. */
+bool MML_expr_walk(const MML_expr *expr, MML_expr_visit visit, void *usr);
+
+/* Returns whether a statement of STMTS assigns a variable (or may, if there
+ * isn't the memory to find out). Variables point into the trees that define
+ * them, so such trees have to outlive them. */
+bool MML_stmts_assign(const MML_expr_dvec *stmts);
+/* Like `MML_stmts_assign`, for the single statement EXPR. */
+bool MML_expr_assigns(const MML_expr *expr);
 
 #ifndef MML_BARE_USE
 constexpr const uint8_t PRECEDENCE[] = {
@@ -297,13 +334,35 @@ extern const char *const TOK_STRINGS[];
 extern const char *const EXPR_TYPE_STRINGS[];
 
 
+#define PARSER_TOK_WINDOW 256
+
 struct parser_state {
+	// the input is lexed PARSER_TOK_WINDOW tokens at a time from LEX_S; the
+	// parser reads them from TOKS starting at TOK_POS
+	MML_token toks[PARSER_TOK_WINDOW];
+	const char *lex_s;
+	const char *lex_end;	// where the input ends if not at its NUL, or NULL
+	size_t n_toks, tok_pos;
+	size_t peeked_pos;
 	const char *saved_s;
 	MML_token peeked_tok;
 	MML_token current_tok;
 	bool has_peeked;
-	bool looking_for_int;
+	bool in_pipe_block;
+	bool borrow_idents;
+	// don't log problems with the input, only set HAD_PROBLEM
+	bool quiet;
+	bool had_problem;
+	// what the trees are allocated from; NULL means `MML_global_arena`
+	Arena *arena;
 };
+
+/* Parses the statement at *S and advances *S past it and the `;` that
+ * follows, if any. *HAS_MORE is set if another statement follows. Same
+ * result as one element of `MML_parse_stmts`, without collecting them.
+ * STATE holds tokens lexed ahead of *S, so it must only be used with the *S
+ * the previous call left. */
+MML_expr *MML_parse_next_stmt(const char **s, struct parser_state *state, bool *has_more);
 #endif
 
 MML__CPP_COMPAT_END_DECLS
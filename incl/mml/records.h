@@ -0,0 +1,31 @@
+#ifndef RECORDS_H
+#define RECORDS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "mml/expr.h"
+#include "cpp_compat.h"
+
+MML__CPP_COMPAT_BEGIN_DECLS
+
+/* Evaluates SRC once per record read from STREAM. Each line of STREAM is a
+ * record: one number per input, in the order of INPUT_NAMES (a
+ * NULL-terminated list of at most 64 identifiers), separated as for
+ * `MML_find_delim`. The inputs are parameters of SRC (see `MML_compile`), so
+ * a record rebinds them without touching any variable, and only the
+ * statements that read an input which changed since the last record (or
+ * whose value is a vector) are evaluated again. The values a record makes
+ * are freed before the next one.
+ *
+ * For every record, the values of the statements of SRC that aren't
+ * assignments are printed as one line, separated by ", " (in the
+ * machine-readable output formats, as one vector). Malformed records are
+ * reported and skipped. Returns 0 at the end of STREAM, -1 if SRC doesn't
+ * parse or STREAM can't be read. */
+int32_t MML_stream_records(MML_state *crestrict state, const char *src,
+		const char *const *input_names, FILE *stream);
+
+MML__CPP_COMPAT_END_DECLS
+
+#endif /* RECORDS_H */
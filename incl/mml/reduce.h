@@ -0,0 +1,36 @@
+#ifndef REDUCE_H
+#define REDUCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpp_compat.h"
+
+MML__CPP_COMPAT_BEGIN_DECLS
+
+/* Number of elements summed left-to-right in each leaf of the reduction tree.
+ * Inputs shorter than this are summed exactly like a plain loop would. */
+#define MML_REDUCE_BLOCK 256
+
+/* Inputs shorter than this are always reduced on the calling thread. */
+#define MML_REDUCE_PARALLEL_MIN 65536
+
+/* Most threads a reduction (or a parallel parse) will use; `--threads` is
+ * clamped to it, since each thread's bookkeeping lives on the stack. */
+#define MML_REDUCE_MAX_THREADS 256
+
+typedef struct MML_reduce_opts {
+	uint32_t threads;
+	bool compensated;
+} MML_reduce_opts;
+
+/* Sums the N doubles at XS. The input is split into fixed blocks of
+ * `MML_REDUCE_BLOCK` elements whose partial sums are combined in a fixed
+ * pairwise tree, so the result only depends on XS, N and `opts->compensated`,
+ * never on `opts->threads`. If `opts->compensated` is set, each step uses
+ * Neumaier's compensated summation. OPTS may be NULL for a serial, uncompensated sum. */
+double MML_reduce_sum(const double *crestrict xs, size_t n, const MML_reduce_opts *opts);
+
+MML__CPP_COMPAT_END_DECLS
+
+#endif /* REDUCE_H */
@@ -0,0 +1,40 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+
+#include "cpp_compat.h"
+
+MML__CPP_COMPAT_BEGIN_DECLS
+
+/* Protocol spoken over the socket (all integers little-endian):
+ *
+ * request:  u32 LEN, then LEN bytes of MML source (one or more statements)
+ * response: u32 LEN, then u8 STATUS, then LEN-1 bytes of text
+ *
+ * The text is everything the statements printed, followed by the value of
+ * the last statement and a newline if that value is valid. STATUS is one of
+ * `enum MML_serve_status`. Requests on a connection are answered in order.
+ * Each connection has its own evaluator state and configuration, so
+ * variables defined (and settings changed with `config_set`) by one request
+ * are visible to later requests on the same connection only. */
+enum MML_serve_status {
+	MML_SERVE_OK,
+	MML_SERVE_INVALID,	// the last statement evaluated to an invalid value
+	MML_SERVE_STOPPED,	// evaluation hit a limit or was cancelled
+	MML_SERVE_TOO_LONG,	// the text was over `MML_SERVE_MAX_REPLY` bytes and is left out
+};
+
+// requests longer than this close the connection
+#define MML_SERVE_MAX_REQUEST (16u << 20)
+#define MML_SERVE_MAX_REPLY (256u << 20)
+
+/* Listens on a Unix domain socket at SOCKET_PATH and answers evaluation
+ * requests until the process gets SIGINT or SIGTERM. An existing socket file
+ * at SOCKET_PATH is replaced. Returns 0 on a clean shutdown, -1 if the socket
+ * could not be set up. */
+int32_t MML_serve(const char *socket_path);
+
+MML__CPP_COMPAT_END_DECLS
+
+#endif /* SERVER_H */
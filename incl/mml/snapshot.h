@@ -0,0 +1,64 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+
+#include "mml/expr.h"
+#include "cpp_compat.h"
+
+MML__CPP_COMPAT_BEGIN_DECLS
+
+/* A snapshot holds the variables of an evaluator state: a symbol table, and
+ * their syntax trees laid out as `MML_expr`s that point to each other as if
+ * the file were mapped at `MML_SNAPSHOT_BASE`, followed by a list of every
+ * pointer field in the file. Loading maps the file at that address if it is
+ * free and binds the symbols, so nothing is parsed, copied or written to
+ * and the pages stay shared with the page cache. If the address is taken,
+ * the pointer fields are moved to where the file is mapped instead, which
+ * makes private copies of the pages holding them. Snapshots are only read by builds
+ * with the same `MML_expr` layout and byte order as the one that wrote them.
+ * The header, symbols and relocations are checked on loading, but the trees
+ * aren't walked, so a snapshot is trusted like any other script. Builtins
+ * are still registered by `MML_init_state`.
+ *
+ * file layout (all offsets from the start of the file, 8-byte aligned):
+ *   header:   `struct MML_snapshot_header`
+ *   symbols:  N_SYMBOLS `struct MML_snapshot_symbol`s
+ *   trees:    `MML_expr`s, arrays of element pointers, identifier text and
+ *             packed vector data
+ *   relocs:   N_RELOCS u64 offsets of pointer fields (a field holding 0 is
+ *             a NULL pointer and isn't listed) */
+#define MML_SNAPSHOT_MAGIC "MMLSNAP"
+#define MML_SNAPSHOT_VERSION 2
+// far from where the heap, the stack and other mappings are usually put
+#define MML_SNAPSHOT_BASE 0x600000000000ull
+
+struct MML_snapshot_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;	// 0x01020304 as written
+	uint64_t expr_size;	// `sizeof(MML_expr)`
+	uint64_t base;		// where the pointers expect the file to be
+	uint64_t symbols_off;
+	uint64_t n_symbols;
+	uint64_t relocs_off;
+	uint64_t n_relocs;
+};
+
+struct MML_snapshot_symbol {
+	uint64_t name_off;
+	uint64_t name_len;
+	uint64_t expr_off;
+};
+
+/* Writes every variable set on STATE to a snapshot at PATH (replacing the
+ * file atomically). Returns 0 on success, -1 on failure. */
+int32_t MML_save_snapshot(MML_state *crestrict state, const char *path);
+/* Maps the snapshot at PATH and sets its variables on STATE, replacing ones
+ * with the same names. The file stays mapped until STATE is cleaned up.
+ * Returns 0 on success, -1 if it can't be read or isn't a valid snapshot. */
+int32_t MML_load_snapshot(MML_state *crestrict state, const char *path);
+
+MML__CPP_COMPAT_END_DECLS
+
+#endif /* SNAPSHOT_H */
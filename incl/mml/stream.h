@@ -0,0 +1,27 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdio.h>
+
+#include "mml/expr.h"
+#include "cpp_compat.h"
+
+MML__CPP_COMPAT_BEGIN_DECLS
+
+/* Reads statements from a stream a chunk at a time, so a script can be
+ * evaluated while it is still being read. Only the statement being read is
+ * kept in memory, never the whole script. */
+typedef struct MML_stmt_reader MML_stmt_reader;
+
+/* Returns a reader for STREAM, or NULL if it couldn't be allocated. The
+ * reader doesn't close STREAM. Free it with `MML_stmt_reader_close`. */
+MML_stmt_reader *MML_stmt_reader_open(FILE *stream);
+/* Parses the next statement into *OUT, the same as the matching element of
+ * `MML_parse_stmts` on the whole input would be. Returns false once every
+ * statement has been read. */
+bool MML_stmt_reader_next(MML_stmt_reader *r, MML_expr **out);
+void MML_stmt_reader_close(MML_stmt_reader *r);
+
+MML__CPP_COMPAT_END_DECLS
+
+#endif /* STREAM_H */
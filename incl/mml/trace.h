@@ -0,0 +1,83 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#include "cpp_compat.h"
+
+MML__CPP_COMPAT_BEGIN_DECLS
+
+/* Events that are recorded as they happen, unlike `MML_log_dbg`, which
+ * prints them (and only with --debug). An event is a pointer to its call
+ * site, a timestamp and up to 2 numbers, stored into a ring of the calling
+ * thread; about the last `MML_TRACE_RING_SIZE` events of each thread are
+ * kept, and only made into text by `MML_trace_dump`. Events below
+ * `MML_TRACE_MIN_LEVEL` are compiled out; by default that is
+ * `MML_TRACE_WARN`, so the debug events of hot paths (like the parser's)
+ * cost nothing unless built with e.g.
+ * `make NO_DEBUG=-DMML_TRACE_MIN_LEVEL=MML_TRACE_DEBUG`. */
+enum MML_trace_level {
+	MML_TRACE_DEBUG,
+	MML_TRACE_INFO,
+	MML_TRACE_WARN,
+	MML_TRACE_ERROR,
+	MML_TRACE_OFF,	// as `MML_TRACE_MIN_LEVEL`, compiles every event out
+};
+
+#ifndef MML_TRACE_MIN_LEVEL
+#define MML_TRACE_MIN_LEVEL MML_TRACE_WARN
+#endif
+
+#define MML_TRACE_RING_SIZE 4096
+
+typedef struct MML_trace_site {
+	const char *file;
+	const char *name;
+	uint32_t line;
+	uint8_t level;
+	uint8_t n_args;
+	uint8_t float_args;	// bit i is set if argument i is a `double`
+} MML_trace_site;
+
+void MML_trace_emit(const MML_trace_site *site, uint64_t a, uint64_t b);
+
+static inline uint64_t MML_trace_u64(uint64_t x) { return x; }
+static inline uint64_t MML_trace_f64(double x)
+{
+	union { double d; uint64_t u; } bits = { x };
+	return bits.u;
+}
+#define MML__TRACE_IS_FLOAT(x) _Generic((x), double: 1, float: 1, default: 0)
+#define MML__TRACE_ARG(x) _Generic((x), double: MML_trace_f64, float: MML_trace_f64, default: MML_trace_u64)(x)
+
+#define MML__TRACE(lvl, event_name, n, float_bits, a, b) do { \
+	if ((lvl) >= MML_TRACE_MIN_LEVEL) \
+	{ \
+		static const MML_trace_site site_ = { \
+			__FILE_NAME__, (event_name), __LINE__, (lvl), (n), (float_bits) \
+		}; \
+		MML_trace_emit(&site_, (a), (b)); \
+	} \
+} while (0)
+
+/* Records the event NAME (a string literal) at LEVEL, with no arguments or
+ * with the integers or doubles A and B. */
+#define MML_trace(level, name) MML__TRACE(level, name, 0, 0, 0, 0)
+#define MML_trace1(level, name, a) \
+	MML__TRACE(level, name, 1, MML__TRACE_IS_FLOAT(a), MML__TRACE_ARG(a), 0)
+#define MML_trace2(level, name, a, b) \
+	MML__TRACE(level, name, 2, MML__TRACE_IS_FLOAT(a) | MML__TRACE_IS_FLOAT(b) << 1, \
+			MML__TRACE_ARG(a), MML__TRACE_ARG(b))
+
+/* Writes the events every thread has kept to the file descriptor FD, one
+ * line each, oldest first within each thread. Only uses async-signal-safe
+ * functions, so it may be called from a signal handler; events recorded
+ * while it runs may be skipped. */
+void MML_trace_dump(int32_t fd);
+/* Makes the signal SIGNUM dump the events to stderr (e.g. `kill -USR1`).
+ * Returns 0 on success, -1 on failure. */
+int32_t MML_trace_dump_on_signal(int32_t signum);
+
+MML__CPP_COMPAT_END_DECLS
+
+#endif /* TRACE_H */
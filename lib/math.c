@@ -1,28 +1,30 @@
 #include <math.h>
 #include <complex.h>
+#include <stdlib.h>
 
 #include "arena/arena.h"
 #include "mml/expr.h"
 #include "mml/eval.h"
 #include "mml/config.h"
-#include "c-hashmap/map.h"
+#include "mml/reduce.h"
+#include "mml/builtins.h"
 
-static _Complex double custom_clog2(_Complex double a)
+_Complex double math__clog2(_Complex double a)
 {
 	return clog(a)/clog(2.0);
 }
 
-static _Complex double custom_clog10(_Complex double a)
+_Complex double math__clog10(_Complex double a)
 {
 	return clog(a)/clog(10.0);
 }
 
-static _Complex double custom_sqrt(double a)
+_Complex double math__csqrt(double a)
 {
 	return csqrt(a + 0.0*I);
 }
 
-static MML_value custom_root(MML_state *state, MML_expr_vec *args)
+MML_value math__root(MML_state *state, MML_expr_vec *args)
 {
 	if (args->n == 1)
 	{
@@ -43,72 +45,37 @@ static MML_value custom_root(MML_state *state, MML_expr_vec *args)
 			MML_eval_expr(state, args->ptr[1]), MML_OP_ROOT);
 }
 
-static MML_value custom_logb(MML_state *state, MML_expr_vec *args)
+// the log of A in base B
+double math__logb(double a, double b)
 {
-	if (args->n == 1)
-	{
-		MML_value a = MML_eval_expr(state, args->ptr[0]);
-		if (!VAL_IS_NUM(a))
-		{
-			MML_log_err("`logb`: takes either 2 number (real number, complex number, or Boolean) arguments or 1 number argument\n");
-			return VAL_INVAL;
-		}
-		if (a.type != ComplexNumber_type)
-			return VAL_NUM(log(MML_get_number(&a)));
-		else
-			return VAL_CNUM(clog(MML_get_complex(&a)));
-	}
-
-	if (args->n != 2)
-	{
-		MML_log_err("`logb`: takes either 2 number (real number, complex number, or Boolean) arguments or 1 number argument\n");
-		return VAL_INVAL;
-	}
-
-	MML_value a = MML_eval_expr(state, args->ptr[0]);
-	MML_value b = MML_eval_expr(state, args->ptr[1]);
-
-	if (!VAL_IS_NUM(a) || !VAL_IS_NUM(b))
-	{
-		MML_log_err("`logb`: takes either 2 number (real number, complex number, or Boolean) arguments or 1 number argument\n");
-		return VAL_INVAL;
-	}
+	return log(a) / log(b);
+}
 
-	if (a.type != ComplexNumber_type && b.type != ComplexNumber_type)
-		return VAL_NUM(log(MML_get_number(&a)) / log(MML_get_number(&b)));
-	else
-		return VAL_CNUM(clog(MML_get_complex(&a)) / clog(MML_get_complex(&b)));
+_Complex double math__clogb(_Complex double a, _Complex double b)
+{
+	return clog(a) / clog(b);
 }
 
-static MML_value custom_atan2(MML_state *state, MML_expr_vec *args)
+MML_value math__max(MML_state *state, MML_expr_vec *args)
 {
-	if (args->n != 2)
+	// a single vector argument takes the max of its elements
+	MML_expr_vec terms = *args;
+	if (args->n == 1)
 	{
-		MML_log_err("`atan2`: takes exactly 2 real number arguments\n");
-		return VAL_INVAL;
+		const MML_value first = MML_eval_expr(state, args->ptr[0]);
+		if (first.type == Vector_type)
+			terms = first.v;
 	}
 
-	const MML_value y = MML_eval_expr(state, args->ptr[0]);
-	const MML_value x = MML_eval_expr(state, args->ptr[1]);
-	if (y.type != RealNumber_type || x.type != RealNumber_type)
-	{
-		MML_log_err("`atan2` takes exactly 2 real number arguments\n");
-		return VAL_INVAL;
-	}
-	return VAL_NUM(atan2(y.n, x.n));
-}
-
-static MML_value custom_max(MML_state *state, MML_expr_vec *args)
-{
 	MML_value max = VAL_INVAL;
 
-	for (size_t i = 0; i < args->n; ++i)
+	for (size_t i = 0; i < terms.n; ++i)
 	{
 		if (max.type == Invalid_type)
-			max = MML_eval_expr(state, args->ptr[i]);
+			max = MML_vec_elem(state, &terms, i);
 		if (!VALTYPE_IS_ORDERED(max))
 			return VAL_INVAL;
-		MML_value cur = MML_eval_expr(state, args->ptr[i]);
+		MML_value cur = MML_vec_elem(state, &terms, i);
 		MML_value tmp = MML_apply_binary_op(state, cur, max, MML_OP_GREATER_TOK);
 		if (tmp.type == Boolean_type && tmp.b)
 			max = cur;
@@ -117,17 +84,26 @@ static MML_value custom_max(MML_state *state, MML_expr_vec *args)
 	return max;
 }
 
-static MML_value custom_min(MML_state *state, MML_expr_vec *args)
+MML_value math__min(MML_state *state, MML_expr_vec *args)
 {
+	// a single vector argument takes the min of its elements
+	MML_expr_vec terms = *args;
+	if (args->n == 1)
+	{
+		const MML_value first = MML_eval_expr(state, args->ptr[0]);
+		if (first.type == Vector_type)
+			terms = first.v;
+	}
+
 	MML_value min = VAL_INVAL;
 
-	for (size_t i = 0; i < args->n; ++i)
+	for (size_t i = 0; i < terms.n; ++i)
 	{
 		if (min.type == Invalid_type)
-			min = MML_eval_expr(state, args->ptr[i]);
+			min = MML_vec_elem(state, &terms, i);
 		if (!VALTYPE_IS_ORDERED(min))
 			return VAL_INVAL;
-		MML_value cur = MML_eval_expr(state, args->ptr[i]);
+		MML_value cur = MML_vec_elem(state, &terms, i);
 		MML_value tmp = MML_apply_binary_op(state, cur, min, MML_OP_LESS_TOK);
 		if (tmp.type == Boolean_type && tmp.b)
 			min = cur;
@@ -136,6 +112,56 @@ static MML_value custom_min(MML_state *state, MML_expr_vec *args)
 	return min;
 }
 
+MML_value math__sum(MML_state *state, MML_expr_vec *args)
+{
+	// a single vector argument sums its elements
+	MML_expr_vec terms = *args;
+	MML_value first = VAL_INVAL;
+	if (args->n == 1)
+	{
+		first = MML_eval_expr(state, args->ptr[0]);
+		if (first.type == Vector_type)
+			terms = first.v;
+	}
+	// any other single argument is only evaluated once
+	const bool reuse_first = args->n == 1 && first.type != Vector_type;
+
+	// mapped data can be summed in place
+	if (terms.packed != NULL)
+		return VAL_NUM(MML_reduce_sum(terms.packed, terms.n, &state->config->reduce));
+
+	double *re __attribute__((cleanup(MML_free_pp)))
+		= malloc(terms.n * sizeof(double));
+	double *im __attribute__((cleanup(MML_free_pp)))
+		= calloc(terms.n, sizeof(double));
+	if ((re == NULL || im == NULL) && terms.n != 0)
+		return VAL_INVAL;
+
+	bool is_complex = false;
+	for (size_t i = 0; i < terms.n; ++i)
+	{
+		const MML_value cur = (reuse_first) ? first : MML_vec_elem(state, &terms, i);
+		if (!VAL_IS_NUM(cur))
+		{
+			MML_log_err("`sum`: takes numbers (real number, complex number, or Boolean) "
+					"or a single vector of numbers\n");
+			return VAL_INVAL;
+		}
+		if (cur.type == ComplexNumber_type)
+		{
+			is_complex = true;
+			re[i] = creal(cur.cn);
+			im[i] = cimag(cur.cn);
+		} else
+			re[i] = MML_get_number(&cur);
+	}
+
+	const double re_sum = MML_reduce_sum(re, terms.n, &state->config->reduce);
+	if (!is_complex)
+		return VAL_NUM(re_sum);
+	return VAL_CNUM(re_sum + MML_reduce_sum(im, terms.n, &state->config->reduce)*I);
+}
+
 // set this before using compare_values()
 static MML_state *cur_state;
 
@@ -149,12 +175,34 @@ static int compare_values(const void *a, const void *b)
 	return MML_get_number(&va) - MML_get_number(&vb);
 }
 
-static MML_value custom_sort(MML_state *state, MML_expr_vec *args)
+static int compare_doubles(const void *a, const void *b)
 {
-	const MML_expr_vec *vec = &args->ptr[0]->v;
+	const double da = *(const double *)a;
+	const double db = *(const double *)b;
+	return (da > db) - (da < db);
+}
+
+MML_value math__sort(MML_state *state, MML_expr_vec *args)
+{
+	const MML_value arg = (args->n == 1) ? MML_eval_expr(state, args->ptr[0]) : VAL_INVAL;
+	if (arg.type != Vector_type)
+	{
+		MML_log_err("`sort`: takes a vector\n");
+		return VAL_INVAL;
+	}
+	const MML_expr_vec *vec = &arg.v;
 	MML_expr_vec ret_vec;
-	ret_vec.ptr = arena_alloc_T(MML_global_arena, vec->n, MML_expr *);
+	if (vec->packed != NULL)
+	{
+		double *sorted = arena_alloc_T(MML_eval_arena(state), vec->n, double);
+		memcpy(sorted, vec->packed, vec->n * sizeof(double));
+		qsort(sorted, vec->n, sizeof(double), compare_doubles);
+		ret_vec = (MML_expr_vec) { NULL, vec->n, sorted };
+		return (MML_value) { Vector_type, .v = ret_vec };
+	}
+	ret_vec.ptr = arena_alloc_T(MML_eval_arena(state), vec->n, MML_expr *);
 	ret_vec.n = vec->n;
+	ret_vec.packed = NULL;
 
 	memcpy(
 			ret_vec.ptr,
@@ -169,86 +217,3 @@ static MML_value custom_sort(MML_state *state, MML_expr_vec *args)
 
 	return (MML_value) { Vector_type, .v = ret_vec };
 }
-
-
-static void register_functions(hashmap *maps[6])
-{
-	hashmap_set(maps[1], hashmap_str_lit("max"),			(uintptr_t)custom_max);
-	hashmap_set(maps[1], hashmap_str_lit("min"),			(uintptr_t)custom_min);
-	hashmap_set(maps[1], hashmap_str_lit("root"),			(uintptr_t)custom_root);
-	hashmap_set(maps[1], hashmap_str_lit("logb"),			(uintptr_t)custom_logb);
-	hashmap_set(maps[1], hashmap_str_lit("atan2"),			(uintptr_t)custom_atan2);
-	hashmap_set(maps[1], hashmap_str_lit("sort"),			(uintptr_t)custom_sort);
-
-	hashmap_set(maps[2], hashmap_str_lit("sin"),			(uintptr_t)sin);
-	hashmap_set(maps[2], hashmap_str_lit("cos"),			(uintptr_t)cos);
-	hashmap_set(maps[2], hashmap_str_lit("tan"),			(uintptr_t)tan);
-	hashmap_set(maps[2], hashmap_str_lit("asin"),			(uintptr_t)asin);
-	hashmap_set(maps[2], hashmap_str_lit("acos"),			(uintptr_t)acos);
-	hashmap_set(maps[2], hashmap_str_lit("atan"),			(uintptr_t)atan);
-	hashmap_set(maps[2], hashmap_str_lit("sinh"),			(uintptr_t)sinh);
-	hashmap_set(maps[2], hashmap_str_lit("cosh"),			(uintptr_t)cosh);
-	hashmap_set(maps[2], hashmap_str_lit("tanh"),			(uintptr_t)tanh);
-	hashmap_set(maps[2], hashmap_str_lit("asinh"),			(uintptr_t)asinh);
-	hashmap_set(maps[2], hashmap_str_lit("acosh"),			(uintptr_t)acosh);
-	hashmap_set(maps[2], hashmap_str_lit("atanh"),			(uintptr_t)atanh);
-	hashmap_set(maps[2], hashmap_str_lit("ln"),			(uintptr_t)log);
-	hashmap_set(maps[2], hashmap_str_lit("log"),			(uintptr_t)log);
-	hashmap_set(maps[2], hashmap_str_lit("log2"),			(uintptr_t)log2);
-	hashmap_set(maps[2], hashmap_str_lit("log10"),			(uintptr_t)log10);
-	hashmap_set(maps[2], hashmap_str_lit("sqrt"),			(uintptr_t)sqrt);
-	hashmap_set(maps[2], hashmap_str_lit("floor"),			(uintptr_t)floor);
-	hashmap_set(maps[2], hashmap_str_lit("ceil"),			(uintptr_t)ceil);
-	hashmap_set(maps[2], hashmap_str_lit("round"),			(uintptr_t)round);
-
-	hashmap_set(maps[3], hashmap_str_lit("complex_sin"),		(uintptr_t)csin);
-	hashmap_set(maps[3], hashmap_str_lit("complex_cos"),		(uintptr_t)ccos);
-	hashmap_set(maps[3], hashmap_str_lit("complex_tan"),		(uintptr_t)ctan);
-	hashmap_set(maps[3], hashmap_str_lit("complex_asin"),		(uintptr_t)casin);
-	hashmap_set(maps[3], hashmap_str_lit("complex_acos"),		(uintptr_t)cacos);
-	hashmap_set(maps[3], hashmap_str_lit("complex_atan"),		(uintptr_t)catan);
-	hashmap_set(maps[3], hashmap_str_lit("complex_sinh"),		(uintptr_t)csinh);
-	hashmap_set(maps[3], hashmap_str_lit("complex_cosh"),		(uintptr_t)ccosh);
-	hashmap_set(maps[3], hashmap_str_lit("complex_tanh"),		(uintptr_t)ctanh);
-	hashmap_set(maps[3], hashmap_str_lit("complex_asinh"),	(uintptr_t)casinh);
-	hashmap_set(maps[3], hashmap_str_lit("complex_acosh"),	(uintptr_t)cacosh);
-	hashmap_set(maps[3], hashmap_str_lit("complex_atanh"),	(uintptr_t)catanh);
-	hashmap_set(maps[3], hashmap_str_lit("complex_ln"),		(uintptr_t)clog);
-	hashmap_set(maps[3], hashmap_str_lit("complex_log"),		(uintptr_t)clog);
-	hashmap_set(maps[3], hashmap_str_lit("complex_log2"),		(uintptr_t)custom_clog2);
-	hashmap_set(maps[3], hashmap_str_lit("complex_log10"),	(uintptr_t)custom_clog10);
-	hashmap_set(maps[3], hashmap_str_lit("complex_sqrt"),		(uintptr_t)csqrt);
-	hashmap_set(maps[3], hashmap_str_lit("complex_csqrt"),	(uintptr_t)csqrt);
-
-	hashmap_set(maps[4], hashmap_str_lit("csqrt"),			(uintptr_t)custom_sqrt);
-
-	hashmap_set(maps[5], hashmap_str_lit("complex_conj"),		(uintptr_t)conj);
-	hashmap_set(maps[5], hashmap_str_lit("complex_phase"),	(uintptr_t)carg);
-	hashmap_set(maps[5], hashmap_str_lit("complex_real"),		(uintptr_t)creal);
-	hashmap_set(maps[5], hashmap_str_lit("complex_imag"),		(uintptr_t)cimag);
-
-
-	static constexpr MML_value TRUE_M		= VAL_BOOL(true);
-	static constexpr MML_value FALSE_M		= VAL_BOOL(false);
-	static constexpr MML_value PI_M		= VAL_NUM(3.14159265358979323846);
-	static constexpr MML_value E_M		= VAL_NUM(2.71828182845904523536);
-	static constexpr MML_value PHI_M		= VAL_NUM(1.61803398874989484820);
-	static constexpr MML_value I_M		= VAL_CNUM(I);
-	static constexpr MML_value NAN_M		= VAL_NUM(NAN);
-	static constexpr MML_value INFINITY_M	= VAL_NUM(INFINITY);
-
-	hashmap_set(maps[0], hashmap_str_lit("true"), 	(uintptr_t)&TRUE_M);
-	hashmap_set(maps[0], hashmap_str_lit("false"), 	(uintptr_t)&FALSE_M);
-	hashmap_set(maps[0], hashmap_str_lit("pi"),	(uintptr_t)&PI_M);
-	hashmap_set(maps[0], hashmap_str_lit("e"),	(uintptr_t)&E_M);
-	hashmap_set(maps[0], hashmap_str_lit("phi"),	(uintptr_t)&PHI_M);
-	static_assert(I_M.cn == I, "how on earth does I != I? i think your computer's borked\n");
-	hashmap_set(maps[0], hashmap_str_lit("i"),	(uintptr_t)&I_M);
-	hashmap_set(maps[0], hashmap_str_lit("nan"),	(uintptr_t)&NAN_M);
-	hashmap_set(maps[0], hashmap_str_lit("inf"),	(uintptr_t)&INFINITY_M);
-}
-
-void math__register_functions(hashmap *maps[6])
-{
-	register_functions(maps);
-}
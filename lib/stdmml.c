@@ -1,28 +1,32 @@
 #include <math.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "mml/eval.h"
 #include "mml/expr.h"
 #include "mml/config.h"
 #include "mml/parser.h"
-#include "c-hashmap/map.h"
+#include "mml/builtins.h"
+#include "mml/memo.h"
 
-static MML_value custom_dbg_type(MML_state *state, MML_expr_vec *args)
+MML_value stdmml__dbg_type(MML_state *state, MML_expr_vec *args)
 {
-	printf("%s", EXPR_TYPE_STRINGS[MML_eval_expr(state, args->ptr[0]).type]);
+	const char *type_str = EXPR_TYPE_STRINGS[MML_eval_expr(state, args->ptr[0]).type];
+	MML_outbuf_write(&state->out, type_str, strlen(type_str));
 	state->config->last_print_was_newline = false;
 
 	return VAL_INVAL;
 }
 
-static MML_value custom_dbg_ident(MML_state *state, MML_expr_vec *args)
+MML_value stdmml__dbg_ident(MML_state *state, MML_expr_vec *args)
 {
-	MML_print_exprh(MML_eval_get_variable(state, args->ptr[0]->s));
+	MML_expr *var = MML_eval_get_variable(state, args->ptr[0]->s);
+	MML_expr_vec var_arg = { &var, 1, NULL };
 
-	return VAL_INVAL;
+	return MML_print_exprh_tv_func(state, &var_arg);
 }
 
-static MML_value custom_config_set(MML_state *state, MML_expr_vec *args)
+MML_value stdmml__config_set(MML_state *state, MML_expr_vec *args)
 {
 	if (args->n != 2
 	 || args->ptr[0]->type != Identifier_type)
@@ -67,6 +71,16 @@ static MML_value custom_config_set(MML_state *state, MML_expr_vec *args)
 			CCLEAR_FLAG(state->config, BOOLS_PRINT_NUM);
 		else if (!CFLAG_IS_SET(state->config, BOOLS_PRINT_NUM) && val.b)
 			CSET_FLAG(state->config, BOOLS_PRINT_NUM);
+	} else if (strncmp(config_ident.s, "compensated_sums", sizeof("compensated_sums")-1) == 0)
+	{
+		MML_value val = MML_eval_expr(state, args->ptr[1]);
+		if (val.type != Boolean_type)
+		{
+			MML_log_err("`config_set`: the `compensated_sums` config setting "
+					"must be of type Boolean\n");
+			return VAL_INVAL;
+		}
+		state->config->reduce.compensated = val.b;
 	} else
 	{
 		fprintf(stderr, "`config_set`: unknown config setting `%.*s`\n",
@@ -74,18 +88,9 @@ static MML_value custom_config_set(MML_state *state, MML_expr_vec *args)
 		return VAL_INVAL;
 	}
 
-	return VAL_INVAL;
-}
+	// kept values may have been computed with the old setting
+	if (state->memo != NULL)
+		MML_memo_clear(state->memo);
 
-static void register_functions(hashmap *maps[6])
-{
-	hashmap_set(maps[1], hashmap_str_lit("dbg"),		(uintptr_t)MML_print_exprh_tv_func);
-	hashmap_set(maps[1], hashmap_str_lit("dbg_type"),	(uintptr_t)custom_dbg_type);
-	hashmap_set(maps[1], hashmap_str_lit("dbg_ident"),	(uintptr_t)custom_dbg_ident);
-	hashmap_set(maps[1], hashmap_str_lit("config_set"),	(uintptr_t)custom_config_set);
-}
-
-void stdmml__register_functions(hashmap *maps[6])
-{
-	register_functions(maps);
+	return VAL_INVAL;
 }
@@ -14,6 +14,7 @@ typedef struct Arena {
 	ArenaBucket *current;
 	size_t index;
 	size_t bucket_init_size;
+	size_t bytes_used;
 } Arena;
 
 
@@ -70,10 +71,43 @@ inline void *arena_alloc(Arena *arena, size_t size)
 		arena->current = arena->current->next = new_bucket;
 
 		arena->index = size;
+		arena->bytes_used += size;
 		return arena->current->base;
 	}
 	arena->index += size;
+	arena->bytes_used += size;
 
 	return ret_ptr;
 }
 
+size_t arena_bytes_used(const Arena *arena)
+{
+	return arena->bytes_used;
+}
+
+void arena_reset(Arena *arena)
+{
+	// the current bucket is the last one, and one of ARENA's own (buckets
+	// merged in go in front), so it holds at least `bucket_init_size` bytes
+	ArenaBucket *cur = arena->first;
+	while (cur != arena->current)
+	{
+		ArenaBucket *next = cur->next;
+		free(cur->base);
+		free(cur);
+		cur = next;
+	}
+	arena->first = arena->current;
+	arena->index = 0;
+	arena->bytes_used = 0;
+}
+
+void arena_merge(Arena *dst, Arena *src)
+{
+	// SRC's current bucket is its last one; the list goes in front of DST's
+	// so that DST's current bucket stays last
+	src->current->next = dst->first;
+	dst->first = src->first;
+	dst->bytes_used += src->bytes_used;
+	free(src);
+}
@@ -0,0 +1,90 @@
+#include "mml/builtins.h"
+
+#include <complex.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mml/eval.h"
+#include "mml/expr.h"
+#include "c-hashmap/map.h"
+
+#include "builtins_incl.c"
+
+// must stay the same as `builtin_hash` in tools/gen_builtins.py
+static inline uint32_t builtin_hash(const char *s, size_t len, uint32_t seed)
+{
+	uint32_t h = seed ^ (uint32_t)len;
+	for (size_t i = 0; i < len; ++i)
+		h = (h ^ (unsigned char)s[i]) * 0x01000193u;
+	return h ^ (h >> 15);
+}
+
+// what `MML_register_native` added: name -> `MML_builtin *`, NULL until then
+static hashmap *host_natives = NULL;
+
+static const MML_builtin *table_get(strbuf name)
+{
+	if (name.len > BUILTIN_MAX_LEN)
+		return NULL;
+	const uint8_t i = BUILTIN_SLOTS[builtin_hash(name.s, name.len, BUILTIN_HASH_SEED)
+		& (BUILTIN_N_SLOTS - 1)];
+	if (i == 0)
+		return NULL;
+	const MML_builtin *b = &BUILTINS[i - 1];
+	return (b->len == name.len && memcmp(b->name, name.s, name.len) == 0) ? b : NULL;
+}
+
+const MML_builtin *MML_builtin_get(strbuf name)
+{
+	MML_builtin *b;
+	if (host_natives != NULL && hashmap_get(host_natives, name.s, name.len, (uintptr_t *)&b))
+		return b;
+	return table_get(name);
+}
+
+int32_t MML_register_native(const char *name, const MML_native *native)
+{
+	if (host_natives == NULL && (host_natives = hashmap_create()) == NULL)
+		return -1;
+
+	const size_t len = strlen(name);
+	MML_builtin *b;
+	if (!hashmap_get(host_natives, name, len, (uintptr_t *)&b))
+	{
+		// starts as the builtin of the name, if there is one
+		const MML_builtin *builtin = table_get((strbuf) { (char *)name, len });
+		char *name_copy = malloc(len + 1);
+		b = malloc(sizeof(*b));
+		if (name_copy == NULL || b == NULL)
+		{
+			free(name_copy);
+			free(b);
+			return -1;
+		}
+		memcpy(name_copy, name, len + 1);
+		*b = (builtin != NULL) ? *builtin : (MML_builtin) { 0 };
+		b->name = name_copy;
+		b->len = len;
+		if (hashmap_set(host_natives, name_copy, len, (uintptr_t)b) < 0)
+		{
+			free(name_copy);
+			free(b);
+			return -1;
+		}
+	}
+
+#define SET_IF_GIVEN(f) if (native->f != NULL) b->fn.f = native->f
+	SET_IF_GIVEN(vec);
+	SET_IF_GIVEN(d_dd);
+	SET_IF_GIVEN(cd_cdcd);
+	SET_IF_GIVEN(d_v);
+	SET_IF_GIVEN(cd_d);
+	SET_IF_GIVEN(d_d);
+	SET_IF_GIVEN(d_cd);
+	SET_IF_GIVEN(cd_cd);
+#undef SET_IF_GIVEN
+	b->fn.impure |= native->impure;
+	return 0;
+}
@@ -0,0 +1,109 @@
+// Table for `src/builtins.c`, included from there. Generated from
+// `src/builtins.def` by `tools/gen_builtins.py`; edit those instead.
+
+#define BUILTIN_HASH_SEED 0xe9u
+#define BUILTIN_N_SLOTS 256
+#define BUILTIN_MAX_LEN 10
+
+static const MML_builtin BUILTINS[48] = {
+	{ "print", 5, .fn.vec = MML_print_typedval_multiargs, .fn.impure = true },
+	{ "println", 7, .fn.vec = MML_println_typedval_multiargs, .fn.impure = true },
+	{ "exit", 4, .is_constant = true, .constant = { Invalid_type, .i = MML_QUIT_INVAL } },
+	{ "clear", 5, .is_constant = true, .constant = { Invalid_type, .i = MML_CLEAR_INVAL } },
+	{ "max", 3, .fn.vec = math__max },
+	{ "min", 3, .fn.vec = math__min },
+	{ "root", 4, .fn.vec = math__root },
+	{ "logb", 4, .fn.d_dd = math__logb, .fn.cd_cdcd = math__clogb, .fn.d_d = log, .fn.cd_cd = clog },
+	{ "atan2", 5, .fn.d_dd = atan2 },
+	{ "sort", 4, .fn.vec = math__sort },
+	{ "sum", 3, .fn.vec = math__sum },
+	{ "sin", 3, .fn.d_d = sin, .fn.cd_cd = csin },
+	{ "cos", 3, .fn.d_d = cos, .fn.cd_cd = ccos },
+	{ "tan", 3, .fn.d_d = tan, .fn.cd_cd = ctan },
+	{ "asin", 4, .fn.d_d = asin, .fn.cd_cd = casin },
+	{ "acos", 4, .fn.d_d = acos, .fn.cd_cd = cacos },
+	{ "atan", 4, .fn.d_d = atan, .fn.cd_cd = catan },
+	{ "sinh", 4, .fn.d_d = sinh, .fn.cd_cd = csinh },
+	{ "cosh", 4, .fn.d_d = cosh, .fn.cd_cd = ccosh },
+	{ "tanh", 4, .fn.d_d = tanh, .fn.cd_cd = ctanh },
+	{ "asinh", 5, .fn.d_d = asinh, .fn.cd_cd = casinh },
+	{ "acosh", 5, .fn.d_d = acosh, .fn.cd_cd = cacosh },
+	{ "atanh", 5, .fn.d_d = atanh, .fn.cd_cd = catanh },
+	{ "ln", 2, .fn.d_d = log, .fn.cd_cd = clog },
+	{ "log", 3, .fn.d_d = log, .fn.cd_cd = clog },
+	{ "log2", 4, .fn.d_d = log2, .fn.cd_cd = math__clog2 },
+	{ "log10", 5, .fn.d_d = log10, .fn.cd_cd = math__clog10 },
+	{ "sqrt", 4, .fn.d_d = sqrt, .fn.cd_cd = csqrt },
+	{ "floor", 5, .fn.d_d = floor },
+	{ "ceil", 4, .fn.d_d = ceil },
+	{ "round", 5, .fn.d_d = round },
+	{ "csqrt", 5, .fn.cd_d = math__csqrt, .fn.cd_cd = csqrt },
+	{ "conj", 4, .fn.cd_cd = conj },
+	{ "phase", 5, .fn.d_cd = carg },
+	{ "real", 4, .fn.d_cd = creal },
+	{ "imag", 4, .fn.d_cd = cimag },
+	{ "true", 4, .is_constant = true, .constant = { Boolean_type, .b = true } },
+	{ "false", 5, .is_constant = true, .constant = { Boolean_type, .b = false } },
+	{ "pi", 2, .is_constant = true, .constant = { RealNumber_type, .n = 3.14159265358979323846 } },
+	{ "e", 1, .is_constant = true, .constant = { RealNumber_type, .n = 2.71828182845904523536 } },
+	{ "phi", 3, .is_constant = true, .constant = { RealNumber_type, .n = 1.61803398874989484820 } },
+	{ "i", 1, .is_constant = true, .constant = { ComplexNumber_type, .cn = I } },
+	{ "nan", 3, .is_constant = true, .constant = { RealNumber_type, .n = NAN } },
+	{ "inf", 3, .is_constant = true, .constant = { RealNumber_type, .n = INFINITY } },
+	{ "dbg", 3, .fn.vec = MML_print_exprh_tv_func, .fn.impure = true },
+	{ "dbg_type", 8, .fn.vec = stdmml__dbg_type, .fn.impure = true },
+	{ "dbg_ident", 9, .fn.vec = stdmml__dbg_ident, .fn.impure = true },
+	{ "config_set", 10, .fn.vec = stdmml__config_set, .fn.impure = true },
+};
+
+// 1 + the index into BUILTINS of the name hashing to each slot, or 0
+static const uint8_t BUILTIN_SLOTS[BUILTIN_N_SLOTS] = {
+	[0] = 28,
+	[4] = 13,
+	[10] = 41,
+	[14] = 6,
+	[18] = 42,
+	[21] = 14,
+	[22] = 18,
+	[28] = 36,
+	[30] = 25,
+	[46] = 34,
+	[54] = 46,
+	[55] = 2,
+	[76] = 45,
+	[81] = 1,
+	[95] = 31,
+	[97] = 30,
+	[102] = 27,
+	[103] = 11,
+	[111] = 24,
+	[113] = 26,
+	[122] = 35,
+	[127] = 12,
+	[144] = 15,
+	[148] = 47,
+	[156] = 20,
+	[179] = 17,
+	[182] = 22,
+	[184] = 29,
+	[185] = 39,
+	[186] = 19,
+	[189] = 9,
+	[194] = 48,
+	[199] = 44,
+	[205] = 7,
+	[208] = 23,
+	[211] = 37,
+	[216] = 38,
+	[218] = 5,
+	[223] = 3,
+	[225] = 8,
+	[229] = 21,
+	[230] = 10,
+	[234] = 32,
+	[237] = 16,
+	[244] = 4,
+	[245] = 43,
+	[246] = 40,
+	[252] = 33,
+};
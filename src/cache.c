@@ -0,0 +1,493 @@
+// open_memstream, dl_iterate_phdr
+#define _GNU_SOURCE
+#include "mml/cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <link.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mml/config.h"
+#include "mml/eval.h"
+#include "mml/hash.h"
+#include "mml/parser.h"
+#include "c-hashmap/map.h"
+
+#define CACHE_MAGIC "MMLCACHE"
+#define CACHE_VERSION 1
+#define CACHE_SLOTS (1u << 16)	// a power of two
+#define CACHE_MAX_PROBES 32
+
+struct index_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t n_slots;
+	uint8_t reserved[48];
+};
+
+// a key of zero marks an empty slot
+struct index_slot {
+	MML_cache_key key;
+	uint64_t offset;	// of the record in `data`
+	uint64_t len;
+};
+
+// what precedes each result in `data`
+struct data_header {
+	MML_cache_key key;
+	uint64_t len;
+};
+
+#define INDEX_SIZE (sizeof(struct index_header) + CACHE_SLOTS*sizeof(struct index_slot))
+
+struct MML_cache {
+	int32_t index_fd;
+	int32_t data_fd;
+	struct index_slot *slots;	// mapped right after the header
+
+	// while capturing
+	FILE *capture;
+	char *capture_buf;
+	size_t capture_len;
+};
+
+static inline uint64_t rotl(uint64_t x, uint32_t r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline void mix(MML_cache_key *k, uint64_t w)
+{
+	k->lo = rotl((k->lo ^ w) * 0x9e3779b97f4a7c15ull, 27) * 5 + 0x52dce729;
+	k->hi = rotl((k->hi + w) * 0x87c37b91114253d5ull, 31) ^ k->lo;
+}
+
+static void mix_bytes(MML_cache_key *k, const void *p, size_t len)
+{
+	const uint8_t *b = p;
+	mix(k, len);
+	for (; len >= 8; b += 8, len -= 8)
+	{
+		uint64_t w;
+		memcpy(&w, b, 8);
+		mix(k, w);
+	}
+	uint64_t w = 0;
+	memcpy(&w, b, len);
+	mix(k, w);
+}
+
+static inline void mix_double(MML_cache_key *k, double x)
+{
+	uint64_t w;
+	memcpy(&w, &x, sizeof(w));
+	mix(k, w);
+}
+
+static bool mix_node(const MML_expr *expr, const MML_expr *, void *usr)
+{
+	MML_cache_key *k = usr;
+	if (expr == NULL)
+	{
+		mix(k, UINT64_MAX);
+		return true;
+	}
+
+	mix(k, expr->type);
+	switch (expr->type) {
+	case Operation_type:
+		mix(k, expr->o.op);
+		break;
+	case Integer_type:
+		mix(k, expr->i);
+		break;
+	case RealNumber_type:
+		mix_double(k, expr->n);
+		break;
+	case ComplexNumber_type:
+		mix_double(k, creal(expr->cn));
+		mix_double(k, cimag(expr->cn));
+		break;
+	case Boolean_type:
+		mix(k, expr->b);
+		break;
+	case Identifier_type:
+		mix_bytes(k, expr->s.s, expr->s.len);
+		break;
+	case Vector_type:
+		mix(k, expr->v.n);
+		if (expr->v.packed != NULL)
+			mix_bytes(k, expr->v.packed, expr->v.n * sizeof(double));
+		break;
+	case Slot_type:
+		mix_double(k, **expr->slot);
+		break;
+	default:
+		break;
+	}
+	return true;
+}
+
+// Returns false if the walk ran out of memory.
+static inline bool mix_expr(MML_cache_key *k, const MML_expr *expr)
+{
+	return MML_expr_walk(expr, mix_node, k);
+}
+
+static inline MML_cache_key finish(MML_cache_key k)
+{
+	return (MML_cache_key) { MML_hash_fmix(k.lo ^ k.hi), MML_hash_fmix(k.hi + k.lo) };
+}
+
+struct build_key {
+	MML_cache_key *k;
+	const char *path;	// of the object, if it has no build ID
+	bool found;
+};
+
+// Adds the GNU build ID of the object that holds this code to the key, if
+// it is the object described by INFO and has one.
+static int mix_build_id(struct dl_phdr_info *info, size_t size, void *usr)
+{
+	(void)size;
+	struct build_key *build = usr;
+	const ElfW(Addr) self = (ElfW(Addr))(uintptr_t)&MML_cache_key_make;
+
+	bool holds_self = false;
+	for (ElfW(Half) i = 0; i < info->dlpi_phnum && !holds_self; ++i)
+	{
+		const ElfW(Phdr) *ph = &info->dlpi_phdr[i];
+		const ElfW(Addr) start = info->dlpi_addr + ph->p_vaddr;
+		holds_self = ph->p_type == PT_LOAD && self >= start && self - start < ph->p_memsz;
+	}
+	if (!holds_self)
+		return 0;
+	// the executable itself has no name here
+	if (info->dlpi_name != NULL && info->dlpi_name[0] == '/')
+		build->path = info->dlpi_name;
+
+	for (ElfW(Half) i = 0; i < info->dlpi_phnum; ++i)
+	{
+		const ElfW(Phdr) *ph = &info->dlpi_phdr[i];
+		if (ph->p_type != PT_NOTE)
+			continue;
+
+		const char *p = (const char *)(info->dlpi_addr + ph->p_vaddr);
+		const char *end = p + ph->p_memsz;
+		while ((size_t)(end - p) >= sizeof(ElfW(Nhdr)))
+		{
+			const ElfW(Nhdr) *note = (const ElfW(Nhdr) *)p;
+			const char *name = p + sizeof(*note);
+			const char *desc = name + ((note->n_namesz + 3) & ~3u);
+			if (desc + note->n_descsz > end)
+				break;
+			if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4
+			 && memcmp(name, "GNU", 4) == 0)
+			{
+				mix_bytes(build->k, desc, note->n_descsz);
+				build->found = true;
+				return 1;
+			}
+			p = desc + ((note->n_descsz + 3) & ~3u);
+		}
+	}
+	// found, but without a build ID
+	return 1;
+}
+
+// Adds what identifies this build of `mml` to the key: the linker's build
+// ID, or if it wasn't given one, the contents of the executable.
+static bool mix_build(MML_cache_key *k)
+{
+	struct build_key build = { k, "/proc/self/exe", false };
+	dl_iterate_phdr(mix_build_id, &build);
+	if (build.found)
+		return true;
+
+	const int32_t fd = open(build.path, O_RDONLY | O_CLOEXEC);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) < 0)
+	{
+		if (fd >= 0)
+			close(fd);
+		return false;
+	}
+	void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return false;
+	mix_bytes(k, p, st.st_size);
+	munmap(p, st.st_size);
+	return true;
+}
+
+struct vars_key {
+	MML_cache_key k;
+	bool failed;
+};
+
+// Adds a variable to the key. Variables are combined by addition, so the
+// key doesn't depend on the order the map keeps them in.
+static int32_t mix_variable(const void *name, size_t name_len, uintptr_t value, void *usr)
+{
+	struct vars_key *vars = usr;
+	MML_cache_key var = { 0, 0 };
+	mix_bytes(&var, name, name_len);
+	vars->failed |= !mix_expr(&var, (const MML_expr *)value);
+	var = finish(var);
+
+	vars->k.lo += var.lo;
+	vars->k.hi += var.hi;
+	return 0;
+}
+
+bool MML_cache_key_make(const MML_state *restrict state,
+		const MML_expr *const *stmts, size_t n, MML_cache_key *out)
+{
+	MML_cache_key k = { CACHE_VERSION, 0 };
+
+	if (!mix_build(&k))
+	{
+		MML_log_err("failed to identify this build of mml for the cache\n");
+		return false;
+	}
+
+	const struct MML_config *config = state->config;
+	mix(&k, config->precision);
+	mix(&k, config->runtime_flags & (PRINT | BOOLS_PRINT_NUM));
+	mix(&k, config->full_prec_floats);
+	mix(&k, config->shortest_floats);
+	mix(&k, config->output_format);
+	mix(&k, config->reduce.compensated);
+
+	bool ok = true;
+	mix(&k, n);
+	for (size_t i = 0; i < n; ++i)
+		ok &= mix_expr(&k, stmts[i]);
+
+	struct vars_key vars = { { 0, 0 }, false };
+	if (state->variables != nullptr)
+		hashmap_iterate(state->variables, mix_variable, &vars);
+	mix(&k, vars.k.lo);
+	mix(&k, vars.k.hi);
+
+	if (!ok || vars.failed)
+	{
+		MML_log_err("failed to allocate memory to hash the expression for the cache\n");
+		return false;
+	}
+
+	k = finish(k);
+	if (k.lo == 0 && k.hi == 0)
+		k.lo = 1;
+	*out = k;
+	return true;
+}
+
+static bool key_eq(MML_cache_key a, MML_cache_key b)
+{
+	return a.lo == b.lo && a.hi == b.hi;
+}
+
+// Makes sure the index at FD has its header and full size. Called with an
+// exclusive lock held.
+static bool init_index(int32_t fd, const char *dir)
+{
+	struct stat st;
+	if (fstat(fd, &st) < 0)
+		return false;
+
+	if (st.st_size == 0)
+	{
+		const struct index_header header = {
+			.magic = CACHE_MAGIC,
+			.version = CACHE_VERSION,
+			.n_slots = CACHE_SLOTS,
+		};
+		// the slots are the zero-filled rest of the file
+		if (ftruncate(fd, INDEX_SIZE) < 0
+		 || pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header))
+		{
+			MML_log_err("failed to create cache index in '%s': %s\n", dir, strerror(errno));
+			return false;
+		}
+		return true;
+	}
+
+	struct index_header header;
+	if ((size_t)st.st_size != INDEX_SIZE
+	 || pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)
+	 || memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) != 0
+	 || header.version != CACHE_VERSION
+	 || header.n_slots != CACHE_SLOTS)
+	{
+		MML_log_err("'%s' holds an incompatible cache; remove it to start a new one\n", dir);
+		return false;
+	}
+	return true;
+}
+
+MML_cache *MML_cache_open(const char *dir)
+{
+	if (mkdir(dir, 0777) < 0 && errno != EEXIST)
+	{
+		MML_log_err("failed to create cache directory '%s': %s\n", dir, strerror(errno));
+		return NULL;
+	}
+
+	MML_cache *c = calloc(1, sizeof(MML_cache));
+	if (c == NULL)
+		return NULL;
+	c->index_fd = c->data_fd = -1;
+
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/index", dir);
+	c->index_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+	snprintf(path, sizeof(path), "%s/data", dir);
+	c->data_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+	if (c->index_fd < 0 || c->data_fd < 0)
+	{
+		MML_log_err("failed to open cache in '%s': %s\n", dir, strerror(errno));
+		MML_cache_close(c);
+		return NULL;
+	}
+
+	flock(c->index_fd, LOCK_EX);
+	const bool ok = init_index(c->index_fd, dir);
+	flock(c->index_fd, LOCK_UN);
+	if (!ok)
+	{
+		MML_cache_close(c);
+		return NULL;
+	}
+
+	char *p = mmap(NULL, INDEX_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, c->index_fd, 0);
+	if (p == MAP_FAILED)
+	{
+		MML_log_err("failed to map cache index in '%s': %s\n", dir, strerror(errno));
+		MML_cache_close(c);
+		return NULL;
+	}
+	c->slots = (struct index_slot *)(p + sizeof(struct index_header));
+
+	return c;
+}
+
+void MML_cache_close(MML_cache *c)
+{
+	if (c == NULL)
+		return;
+
+	if (c->slots != NULL)
+		munmap((char *)c->slots - sizeof(struct index_header), INDEX_SIZE);
+	if (c->index_fd >= 0)
+		close(c->index_fd);
+	if (c->data_fd >= 0)
+		close(c->data_fd);
+	free(c);
+}
+
+// Returns the slot holding KEY, or NULL. Called with a lock held.
+static struct index_slot *find_slot(MML_cache *c, MML_cache_key key)
+{
+	for (uint32_t i = 0; i < CACHE_MAX_PROBES; ++i)
+	{
+		struct index_slot *slot = &c->slots[(key.lo + i) & (CACHE_SLOTS - 1)];
+		if (key_eq(slot->key, key))
+			return slot;
+		if (slot->key.lo == 0 && slot->key.hi == 0)
+			return NULL;
+	}
+	return NULL;
+}
+
+bool MML_cache_replay(MML_cache *c, MML_cache_key key, FILE *out)
+{
+	flock(c->index_fd, LOCK_SH);
+	const struct index_slot *slot = find_slot(c, key);
+	const struct index_slot found = (slot != NULL) ? *slot : (struct index_slot) { 0 };
+	flock(c->index_fd, LOCK_UN);
+	if (slot == NULL)
+		return false;
+
+	// records are never changed once written, so they can be read unlocked
+	struct data_header header;
+	if (pread(c->data_fd, &header, sizeof(header), found.offset) != (ssize_t)sizeof(header)
+	 || !key_eq(header.key, key) || header.len != found.len)
+		return false;
+
+	char *buf __attribute__((cleanup(MML_free_pp))) = malloc(found.len);
+	if ((buf == NULL && found.len != 0)
+	 || pread(c->data_fd, buf, found.len, found.offset + sizeof(header)) != (ssize_t)found.len)
+		return false;
+
+	fwrite(buf, 1, found.len, out);
+	return true;
+}
+
+static void store(MML_cache *c, MML_cache_key key, const char *data, size_t len)
+{
+	flock(c->index_fd, LOCK_EX);
+
+	struct index_slot *slot = find_slot(c, key);
+	if (slot != NULL)
+		goto done;
+	for (uint32_t i = 0; i < CACHE_MAX_PROBES && slot == NULL; ++i)
+	{
+		struct index_slot *cur = &c->slots[(key.lo + i) & (CACHE_SLOTS - 1)];
+		if (cur->key.lo == 0 && cur->key.hi == 0)
+			slot = cur;
+	}
+	// every slot is taken; replace the first one
+	if (slot == NULL)
+		slot = &c->slots[key.lo & (CACHE_SLOTS - 1)];
+
+	struct stat st;
+	const struct data_header header = { key, len };
+	if (fstat(c->data_fd, &st) < 0
+	 || pwrite(c->data_fd, &header, sizeof(header), st.st_size) != (ssize_t)sizeof(header)
+	 || pwrite(c->data_fd, data, len, st.st_size + sizeof(header)) != (ssize_t)len)
+	{
+		MML_log_warn("failed to write to cache: %s\n", strerror(errno));
+		goto done;
+	}
+
+	// readers hold the lock, so the slot can't be seen half written
+	*slot = (struct index_slot) { key, st.st_size, len };
+
+done:
+	flock(c->index_fd, LOCK_UN);
+}
+
+bool MML_cache_capture(MML_cache *c, MML_state *restrict state)
+{
+	c->capture = open_memstream(&c->capture_buf, &c->capture_len);
+	if (c->capture == NULL)
+		return false;
+
+	MML_outbuf_set_copy(&state->out, c->capture);
+	return true;
+}
+
+void MML_cache_commit(MML_cache *c, MML_state *restrict state,
+		MML_cache_key key, bool store_result)
+{
+	if (c->capture == NULL)
+		return;
+
+	MML_outbuf_set_copy(&state->out, NULL);
+	fclose(c->capture);
+	c->capture = NULL;
+
+	if (store_result)
+		store(c, key, c->capture_buf, c->capture_len);
+
+	free(c->capture_buf);
+	c->capture_buf = NULL;
+	c->capture_len = 0;
+}
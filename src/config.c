@@ -1,8 +1,14 @@
+// O_CLOEXEC, MAP_ANONYMOUS, madvise
+#define _GNU_SOURCE
 #include "mml/config.h"
 
 #include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <termios.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -12,6 +18,7 @@
 #include "mml/parser.h"
 #include "mml/token.h"
 #include "mml/eval.h"
+#include "mml/snapshot.h"
 
 struct MML_config MML_global_config = {
 	.PROG_NAME = NULL,
@@ -20,6 +27,11 @@ struct MML_config MML_global_config = {
 	.eval_state = nullptr,
 	.last_print_was_newline = true,
 	.full_prec_floats = false,
+	.shortest_floats = false,
+	.output_format = MML_OUTPUT_TEXT,
+	.reduce = { .threads = 1, .compensated = false },
+	.serve_path = nullptr,
+	.script_path = nullptr,
 };
 
 strbuf expression = { NULL, 0 };
@@ -32,7 +44,8 @@ void MML_term_set_raw_mode(void)
 	tcgetattr(STDIN_FILENO, &old_term);
 	new_term = old_term;
 	new_term.c_lflag &= ~(ICANON | ECHO);
-	new_term.c_cc[VMIN] = 0;
+	// reads block until a byte arrives; the prompt waits in `poll` anyway
+	new_term.c_cc[VMIN] = 1;
 	new_term.c_cc[VTIME] = 0;
 	tcsetattr(STDIN_FILENO, TCSANOW, &new_term);
 
@@ -61,9 +74,25 @@ void MML_print_usage(void)
 			  "  -E EXPR, --expr=EXPR               Alternate way to specify the expression to be evaluated\n"
                     "  -p PREC, --precision=PREC          Set the number of decimal digits to be printed when printing numbers (default 6)\n"
 			  "  --full-prec-floats                 Decimal numbers are represented with the full precision specified by --precision ('%%f' format) (default OFF, uses '%%g').\n"
+			  "  --file=PATH                        Evaluate the script at PATH, which is mapped into memory and parsed in place\n"
+			  "  --shortest-floats                  Print decimal numbers with the fewest digits that read back as the same number, ignoring --precision (default OFF)\n"
+			  "  --output=FORMAT                    Print values as text, binary (raw little-endian doubles), csv or json (default text)\n"
+			  "  --load_vec:NAME=PATH               Map the file at PATH, raw native-endian doubles, as the vector variable NAME without copying it\n"
+			  "  --read_vec:NAME                    Read numbers separated by whitespace, commas or semicolons from stdin into the vector variable NAME\n"
+			  "  --records=NAME,...                 Evaluate the expression once per line of stdin, whose numbers are bound to the NAMEs, printing one line per record\n"
+			  "  --cache-dir=DIR                    Reuse what an earlier run with the same expression, variables and options printed, keeping results in DIR\n"
+			  "  --save-snapshot=PATH               After evaluating, write every variable that is set to a snapshot at PATH\n"
+			  "  --load-snapshot=PATH               Map the snapshot at PATH and set its variables without parsing them\n"
 			  "  --no-eval                          Only parse the expression; don't evaluate it (default OFF)\n"
                     "  --bools-are-nums                   Write the number 1 or 0 to represent boolean values (default OFF)\n"
+			  "  --threads=N                        Number of threads used for large vector reductions and for parsing large scripts, at most 256; results do not depend on it (default 1)\n"
+			  "  --compensated-sums                 Use compensated (Neumaier) summation for vector reductions (default OFF)\n"
+			  "  --max-eval-nodes=N                 Stop an evaluation after it visits N expression nodes (default 0, unlimited)\n"
+			  "  --eval-timeout=MS                  Stop an evaluation after MS milliseconds (default 0, unlimited)\n"
+			  "  --max-eval-mem=BYTES               Stop an evaluation after it allocates BYTES bytes (default 0, unlimited)\n"
+			  "  --max-eval-depth=N                 Stop an evaluation that nests deeper than N expression nodes (default 10000)\n"
 			  "  --dbg-time                         Debug option: the parser will print the time it took to parse and evaluate each line\n"
+			  "  --serve=PATH                       Answer evaluation requests on a Unix domain socket at PATH until SIGINT or SIGTERM\n"
 			  "  -I, --interactive                  Start an interactive prompt (similar to the Python IDLE)\n"
 			  "  -h, --help                         Display this help message\n"
 			  "  -V, --version                      Display program information\n"
@@ -114,10 +143,74 @@ void MML_arg_parse(int32_t argc, char **argv)
 				SET_FLAG(DBG_TIME);
 			else if (strcmp(argv[arg_n]+2, "full-prec-floats") == 0)
 				MML_global_config.full_prec_floats = true;
+			else if (strcmp(argv[arg_n]+2, "shortest-floats") == 0)
+				MML_global_config.shortest_floats = true;
+			else if (strncmp(argv[arg_n]+2, "output=", 7) == 0)
+			{
+				const char *format = argv[arg_n]+2+7;
+				if (strcmp(format, "text") == 0)
+					MML_global_config.output_format = MML_OUTPUT_TEXT;
+				else if (strcmp(format, "binary") == 0)
+					MML_global_config.output_format = MML_OUTPUT_BINARY;
+				else if (strcmp(format, "csv") == 0)
+					MML_global_config.output_format = MML_OUTPUT_CSV;
+				else if (strcmp(format, "json") == 0)
+					MML_global_config.output_format = MML_OUTPUT_JSON;
+				else
+				{
+					fprintf(stderr, "argument error: unknown output format '%s'\n", format);
+					MML_print_usage();
+				}
+			}
+			else if (strncmp(argv[arg_n]+2, "threads=", 8) == 0)
+			{
+				const char *count = argv[arg_n]+2+8;
+				char *end;
+				const long long threads = strtoll(count, &end, 10);
+				if (*count == '\0' || *end != '\0' || threads < 1)
+				{
+					fprintf(stderr, "argument error: thread count must be a positive integer, not '%s'\n", count);
+					MML_print_usage();
+				}
+				if (threads > MML_REDUCE_MAX_THREADS)
+					MML_log_warn("--threads=%s is too many; using %d\n",
+							count, MML_REDUCE_MAX_THREADS);
+				MML_global_config.reduce.threads = (threads > MML_REDUCE_MAX_THREADS)
+					? MML_REDUCE_MAX_THREADS : (uint32_t)threads;
+			}
+			else if (strcmp(argv[arg_n]+2, "compensated-sums") == 0)
+				MML_global_config.reduce.compensated = true;
+			else if (strncmp(argv[arg_n]+2, "max-eval-nodes=", 15) == 0)
+				MML_global_config.eval_state->budget.max_nodes = strtoull(argv[arg_n]+2+15, NULL, 10);
+			else if (strncmp(argv[arg_n]+2, "eval-timeout=", 13) == 0)
+				MML_global_config.eval_state->budget.max_nsecs = strtoull(argv[arg_n]+2+13, NULL, 10) * 1000000;
+			else if (strncmp(argv[arg_n]+2, "max-eval-mem=", 13) == 0)
+				MML_global_config.eval_state->budget.max_arena_bytes = strtoull(argv[arg_n]+2+13, NULL, 10);
+			else if (strncmp(argv[arg_n]+2, "max-eval-depth=", 15) == 0)
+				MML_global_config.eval_state->budget.max_depth = strtoul(argv[arg_n]+2+15, NULL, 10);
 			else if (strcmp(argv[arg_n]+2, "no-eval") == 0)
 				SET_FLAG(NO_EVAL);
 			else if (strcmp(argv[arg_n]+2, "interactive") == 0)
 				SET_FLAG(RUN_PROMPT);
+			else if (strncmp(argv[arg_n]+2, "serve=", 6) == 0)
+				MML_global_config.serve_path = argv[arg_n]+2+6;
+			else if (strncmp(argv[arg_n]+2, "file=", 5) == 0)
+				MML_global_config.script_path = argv[arg_n]+2+5;
+			else if (strncmp(argv[arg_n]+2, "cache-dir=", 10) == 0)
+				MML_global_config.cache_dir = argv[arg_n]+2+10;
+			else if (strncmp(argv[arg_n]+2, "save-snapshot=", 14) == 0)
+				MML_global_config.snapshot_out = argv[arg_n]+2+14;
+			else if (strncmp(argv[arg_n]+2, "load-snapshot=", 14) == 0)
+			{
+				if (MML_load_snapshot(MML_global_config.eval_state, argv[arg_n]+2+14) != 0)
+				{
+					MML_cleanup_state(MML_global_config.eval_state);
+					exit(1);
+				}
+			} else if (strncmp(argv[arg_n]+2, "records=", 8) == 0)
+				MML_global_config.record_inputs = argv[arg_n]+2+8;
+			else if (strncmp(argv[arg_n]+2, "read_vec:", 9) == 0 && argv[arg_n][2+9] != '\0')
+				MML_global_config.read_vec_name = argv[arg_n]+2+9;
 			else if (strncmp(argv[arg_n]+2, "set_var:", 8) == 0)
 			{
 				const char *cur = argv[arg_n]+2+8;
@@ -130,6 +223,21 @@ void MML_arg_parse(int32_t argc, char **argv)
 				}
 				strbuf name = { argv[arg_n]+2+8, cur - (argv[arg_n]+2+8) - 1 };
 				MML_eval_set_variable(MML_global_config.eval_state, name, MML_parse(cur));
+			} else if (strncmp(argv[arg_n]+2, "load_vec:", 9) == 0)
+			{
+				const char *path = strchr(argv[arg_n]+2+9, '=');
+				if (path == NULL || *++path == '\0')
+				{
+					fprintf(stderr, "argument error: expected a file path following command-line vector definition\n");
+					MML_cleanup_state(MML_global_config.eval_state);
+					exit(1);
+				}
+				strbuf name = { argv[arg_n]+2+9, path - (argv[arg_n]+2+9) - 1 };
+				if (MML_bind_vector_mmap(MML_global_config.eval_state, name, path) != 0)
+				{
+					MML_cleanup_state(MML_global_config.eval_state);
+					exit(1);
+				}
 			} else
 			{
 				fprintf(stderr, "argument error: unknown option '%s'\n", argv[arg_n]);
@@ -201,7 +309,9 @@ void MML_arg_parse(int32_t argc, char **argv)
 		}
 	}
 
-	if (expression.s == NULL && !FLAG_IS_SET(READ_STDIN))
+	if (expression.s == NULL && !FLAG_IS_SET(READ_STDIN)
+	 && MML_global_config.serve_path == nullptr
+	 && MML_global_config.script_path == nullptr)
 		SET_FLAG(RUN_PROMPT);
 }
 
@@ -246,6 +356,64 @@ strbuf MML_read_string_from_stream(FILE *stream)
 	return ret_buf;
 }
 
+strbuf MML_map_file(const char *path)
+{
+	return MML_map_file_at(path, NULL);
+}
+
+strbuf MML_map_file_at(const char *path, void *addr)
+{
+	const int32_t fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		MML_log_err("failed to open '%s': %s\n", path, strerror(errno));
+		return (strbuf) { NULL, 0 };
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0)
+	{
+		MML_log_err("failed to stat '%s': %s\n", path, strerror(errno));
+		close(fd);
+		return (strbuf) { NULL, 0 };
+	}
+
+	// reserve a zeroed page more than the file needs, then map the file over
+	// the front of it; the page after the file (or the zeroed end of its last
+	// page) terminates the text
+	const size_t page_size = sysconf(_SC_PAGESIZE);
+	const size_t len = st.st_size;
+	const size_t map_len = (len / page_size + 1) * page_size;
+	char *p = mmap(addr, map_len, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+	{
+		MML_log_err("failed to map %zu bytes for '%s': %s\n", map_len, path, strerror(errno));
+		close(fd);
+		return (strbuf) { NULL, 0 };
+	}
+	if (len != 0 && mmap(p, len, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+	{
+		MML_log_err("failed to map '%s': %s\n", path, strerror(errno));
+		munmap(p, map_len);
+		close(fd);
+		return (strbuf) { NULL, 0 };
+	}
+	close(fd);
+
+	madvise(p, len, MADV_SEQUENTIAL);
+
+	return (strbuf) { p, len };
+}
+
+void MML_unmap_file(strbuf file)
+{
+	if (file.s == NULL)
+		return;
+
+	const size_t page_size = sysconf(_SC_PAGESIZE);
+	munmap(file.s, (file.len / page_size + 1) * page_size);
+}
+
 strbuf strbuf_dup(strbuf buf)
 {
 	strbuf ret = buf;
@@ -0,0 +1,459 @@
+#include "mml/dtoa.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Shortest round-trip digits are found with Ryu (Ulf Adams, "Ryū: fast
+ * float-to-string conversion", PLDI 2018). "%g" output is built from those
+ * digits: rounding the shortest digits gives the same result as rounding the
+ * exact binary value, except when the shortest digits end exactly halfway
+ * between two outputs, when more digits are asked for than a double
+ * reliably has, or for subnormals, whose few bits leave the shortest digits
+ * far from the exact value. Those cases go to `snprintf`. "%f" output is computed
+ * exactly with 128-bit integers when it fits in them. */
+
+#include "dtoa_tables_incl.c"
+
+#define DOUBLE_MANTISSA_BITS 52
+#define DOUBLE_EXPONENT_BITS 11
+#define DOUBLE_BIAS 1023
+#define DOUBLE_POW5_INV_BITCOUNT 125
+#define DOUBLE_POW5_BITCOUNT 125
+
+// %g output of precision up to this is always exact when the shortest
+// representation has no more digits than the precision
+#define MAX_EXACT_G_PREC 15
+// 5^27 < 2^63, so a 53-bit mantissa times 10^prec fits in 128 bits
+#define MAX_EXACT_F_PREC 27
+
+// the value is `digits * 10^exp`
+typedef struct decimal {
+	uint64_t digits;
+	int32_t exp;
+} decimal;
+
+// ceil(log2(5^e)), or 1 for e = 0
+static inline int32_t pow5bits(int32_t e)
+{
+	return (int32_t)(((uint32_t)e * 1217359) >> 19) + 1;
+}
+// floor(log10(2^e))
+static inline uint32_t log10_pow2(int32_t e)
+{
+	return ((uint32_t)e * 78913) >> 18;
+}
+// floor(log10(5^e))
+static inline uint32_t log10_pow5(int32_t e)
+{
+	return ((uint32_t)e * 732923) >> 20;
+}
+
+static inline uint32_t pow5_factor(uint64_t v)
+{
+	uint32_t count = 0;
+	while (v % 5 == 0)
+	{
+		v /= 5;
+		++count;
+	}
+	return count;
+}
+static inline bool multiple_of_pow5(uint64_t v, uint32_t p)
+{
+	return pow5_factor(v) >= p;
+}
+static inline bool multiple_of_pow2(uint64_t v, uint32_t p)
+{
+	return (v & ((1ull << p) - 1)) == 0;
+}
+
+static inline uint64_t mul_shift64(uint64_t m, const uint64_t *mul, int32_t j)
+{
+	const unsigned __int128 b0 = (unsigned __int128)m * mul[0];
+	const unsigned __int128 b2 = (unsigned __int128)m * mul[1];
+	return (uint64_t)(((b0 >> 64) + b2) >> (j - 64));
+}
+
+// X must be finite and positive.
+static decimal shortest_decimal(double x)
+{
+	uint64_t bits;
+	memcpy(&bits, &x, sizeof(bits));
+	const uint64_t ieee_mantissa = bits & ((1ull << DOUBLE_MANTISSA_BITS) - 1);
+	const uint32_t ieee_exponent = (uint32_t)(bits >> DOUBLE_MANTISSA_BITS)
+		& ((1u << DOUBLE_EXPONENT_BITS) - 1);
+
+	int32_t e2;
+	uint64_t m2;
+	if (ieee_exponent == 0)
+	{
+		e2 = 1 - DOUBLE_BIAS - DOUBLE_MANTISSA_BITS - 2;
+		m2 = ieee_mantissa;
+	} else
+	{
+		e2 = (int32_t)ieee_exponent - DOUBLE_BIAS - DOUBLE_MANTISSA_BITS - 2;
+		m2 = (1ull << DOUBLE_MANTISSA_BITS) | ieee_mantissa;
+	}
+	const bool accept_bounds = (m2 & 1) == 0;
+
+	// the interval of decimals that read back as X is (4*m2 - 1 - mm_shift, 4*m2 + 2) * 2^e2
+	const uint64_t mv = 4 * m2;
+	const uint32_t mm_shift = ieee_mantissa != 0 || ieee_exponent <= 1;
+
+	uint64_t vr, vp, vm;
+	int32_t e10;
+	bool vm_is_trailing_zeros = false;
+	bool vr_is_trailing_zeros = false;
+	if (e2 >= 0)
+	{
+		const uint32_t q = log10_pow2(e2) - (e2 > 3);
+		e10 = (int32_t)q;
+		const int32_t k = DOUBLE_POW5_INV_BITCOUNT + pow5bits((int32_t)q) - 1;
+		const int32_t i = -e2 + (int32_t)q + k;
+		vr = mul_shift64(4 * m2, DOUBLE_POW5_INV_SPLIT[q], i);
+		vp = mul_shift64(4 * m2 + 2, DOUBLE_POW5_INV_SPLIT[q], i);
+		vm = mul_shift64(4 * m2 - 1 - mm_shift, DOUBLE_POW5_INV_SPLIT[q], i);
+		if (q <= 21)
+		{
+			if (mv % 5 == 0)
+				vr_is_trailing_zeros = multiple_of_pow5(mv, q);
+			else if (accept_bounds)
+				vm_is_trailing_zeros = multiple_of_pow5(mv - 1 - mm_shift, q);
+			else
+				vp -= multiple_of_pow5(mv + 2, q);
+		}
+	} else
+	{
+		const uint32_t q = log10_pow5(-e2) - (-e2 > 1);
+		e10 = (int32_t)q + e2;
+		const int32_t i = -e2 - (int32_t)q;
+		const int32_t k = pow5bits(i) - DOUBLE_POW5_BITCOUNT;
+		const int32_t j = (int32_t)q - k;
+		vr = mul_shift64(4 * m2, DOUBLE_POW5_SPLIT[i], j);
+		vp = mul_shift64(4 * m2 + 2, DOUBLE_POW5_SPLIT[i], j);
+		vm = mul_shift64(4 * m2 - 1 - mm_shift, DOUBLE_POW5_SPLIT[i], j);
+		if (q <= 1)
+		{
+			vr_is_trailing_zeros = true;
+			if (accept_bounds)
+				vm_is_trailing_zeros = mm_shift == 1;
+			else
+				--vp;
+		} else if (q < 63)
+		{
+			vr_is_trailing_zeros = multiple_of_pow2(mv, q);
+		}
+	}
+
+	// drop digits while the interval still has a shorter decimal in it
+	int32_t removed = 0;
+	uint8_t last_removed_digit = 0;
+	uint64_t output;
+	if (vm_is_trailing_zeros || vr_is_trailing_zeros)
+	{
+		while (vp / 10 > vm / 10)
+		{
+			vm_is_trailing_zeros &= vm % 10 == 0;
+			vr_is_trailing_zeros &= last_removed_digit == 0;
+			last_removed_digit = (uint8_t)(vr % 10);
+			vr /= 10;
+			vp /= 10;
+			vm /= 10;
+			++removed;
+		}
+		if (vm_is_trailing_zeros)
+		{
+			while (vm % 10 == 0)
+			{
+				vr_is_trailing_zeros &= last_removed_digit == 0;
+				last_removed_digit = (uint8_t)(vr % 10);
+				vr /= 10;
+				vp /= 10;
+				vm /= 10;
+				++removed;
+			}
+		}
+		// round half to even
+		if (vr_is_trailing_zeros && last_removed_digit == 5 && vr % 2 == 0)
+			last_removed_digit = 4;
+		output = vr + ((vr == vm && (!accept_bounds || !vm_is_trailing_zeros))
+				|| last_removed_digit >= 5);
+	} else
+	{
+		bool round_up = false;
+		if (vp / 100 > vm / 100)
+		{
+			round_up = vr % 100 >= 50;
+			vr /= 100;
+			vp /= 100;
+			vm /= 100;
+			removed += 2;
+		}
+		while (vp / 10 > vm / 10)
+		{
+			round_up = vr % 10 >= 5;
+			vr /= 10;
+			vp /= 10;
+			vm /= 10;
+			++removed;
+		}
+		output = vr + (vr == vm || round_up);
+	}
+
+	return (decimal) { output, e10 + removed };
+}
+
+// Writes the decimal digits of V to OUT (at least 20 bytes) and returns how many.
+static uint32_t write_digits(char *out, uint64_t v)
+{
+	char tmp[20];
+	uint32_t n = 0;
+	do
+	{
+		tmp[n++] = (char)('0' + v % 10);
+		v /= 10;
+	} while (v != 0);
+
+	for (uint32_t i = 0; i < n; ++i)
+		out[i] = tmp[n - 1 - i];
+	return n;
+}
+
+// Rounds the ND digits in DIGS to KEEP digits (KEEP < ND), half up. Returns
+// true if that carried out of the first digit, leaving DIGS as "1".
+static bool round_digits(char *digs, uint32_t keep)
+{
+	if (digs[keep] < '5')
+		return false;
+
+	for (uint32_t i = keep; i-- > 0; )
+	{
+		if (digs[i] != '9')
+		{
+			++digs[i];
+			return false;
+		}
+		digs[i] = '0';
+	}
+
+	digs[0] = '1';
+	return true;
+}
+
+// bounded writer with `snprintf` semantics
+typedef struct writer {
+	char *p;
+	size_t size;
+	size_t len;
+} writer;
+
+static inline void put_c(writer *w, char c)
+{
+	if (w->len + 1 < w->size)
+		w->p[w->len] = c;
+	++w->len;
+}
+static inline void put_n(writer *w, char c, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		put_c(w, c);
+}
+static inline void put_s(writer *w, const char *s, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		put_c(w, s[i]);
+}
+static inline size_t finish(writer *w)
+{
+	if (w->size != 0)
+		w->p[(w->len < w->size) ? w->len : w->size - 1] = '\0';
+	return w->len;
+}
+
+static void put_exponent(writer *w, int32_t exp)
+{
+	put_c(w, 'e');
+	put_c(w, (exp < 0) ? '-' : '+');
+	if (exp < 0)
+		exp = -exp;
+	if (exp < 10)
+		put_c(w, '0');
+
+	char digs[20];
+	put_s(w, digs, write_digits(digs, (uint64_t)exp));
+}
+
+// Writes the ND digits DIGS, whose first digit is at 10^EXP, in the style of
+// "%g" with trailing zeros removed: plain if MIN_EXP <= EXP < MAX_EXP.
+static void put_general(writer *w, const char *digs, uint32_t nd, int32_t exp,
+		int32_t min_exp, int32_t max_exp)
+{
+	while (nd > 1 && digs[nd - 1] == '0')
+		--nd;
+
+	if (exp < min_exp || exp >= max_exp)
+	{
+		put_c(w, digs[0]);
+		if (nd > 1)
+		{
+			put_c(w, '.');
+			put_s(w, digs + 1, nd - 1);
+		}
+		put_exponent(w, exp);
+	} else if (exp < 0)
+	{
+		put_s(w, "0.", 2);
+		put_n(w, '0', (size_t)(-exp - 1));
+		put_s(w, digs, nd);
+	} else if ((uint32_t)exp + 1 >= nd)
+	{
+		put_s(w, digs, nd);
+		put_n(w, '0', (size_t)exp + 1 - nd);
+	} else
+	{
+		put_s(w, digs, (size_t)exp + 1);
+		put_c(w, '.');
+		put_s(w, digs + exp + 1, nd - exp - 1);
+	}
+}
+
+size_t MML_dtoa_shortest(char *buf, size_t size, double x)
+{
+	if (!isfinite(x))
+		return snprintf(buf, size, "%g", x);
+
+	writer w = { buf, size, 0 };
+	if (signbit(x))
+		put_c(&w, '-');
+	if (x == 0.0)
+	{
+		put_c(&w, '0');
+		return finish(&w);
+	}
+
+	const decimal d = shortest_decimal(fabs(x));
+	char digs[20];
+	const uint32_t nd = write_digits(digs, d.digits);
+	put_general(&w, digs, nd, d.exp + (int32_t)nd - 1, -4, 17);
+
+	return finish(&w);
+}
+
+size_t MML_dtoa_g(char *buf, size_t size, double x, uint32_t prec)
+{
+	if (prec == 0)
+		prec = 1;
+	if (!isfinite(x) || (x != 0.0 && fabs(x) < DBL_MIN))
+		return snprintf(buf, size, "%.*g", (int)prec, x);
+
+	writer w = { buf, size, 0 };
+	if (signbit(x))
+		put_c(&w, '-');
+	if (x == 0.0)
+	{
+		put_c(&w, '0');
+		return finish(&w);
+	}
+
+	const decimal d = shortest_decimal(fabs(x));
+	char digs[20];
+	uint32_t nd = write_digits(digs, d.digits);
+	int32_t exp = d.exp + (int32_t)nd - 1;
+
+	if (nd > prec)
+	{
+		// the shortest digits end exactly halfway; which way the exact
+		// value rounds isn't known from them
+		if (nd == prec + 1 && digs[prec] == '5')
+			return snprintf(buf, size, "%.*g", (int)prec, x);
+		if (round_digits(digs, prec))
+			++exp;
+		nd = prec;
+	} else if (prec > MAX_EXACT_G_PREC)
+	{
+		return snprintf(buf, size, "%.*g", (int)prec, x);
+	}
+
+	put_general(&w, digs, nd, exp, -4, (int32_t)prec);
+
+	return finish(&w);
+}
+
+// Writes the decimal digits of V to OUT (at least 40 bytes) and returns how many.
+static uint32_t write_digits128(char *out, unsigned __int128 v)
+{
+	if (v >> 64 == 0)
+		return write_digits(out, (uint64_t)v);
+
+	// split off the low 19 digits, which always fill a whole chunk
+	const uint64_t low = (uint64_t)(v % 10000000000000000000ull);
+	const uint32_t n = write_digits128(out, v / 10000000000000000000ull);
+	char tmp[20];
+	const uint32_t nl = write_digits(tmp, low);
+	memset(out + n, '0', 19 - nl);
+	memcpy(out + n + 19 - nl, tmp, nl);
+	return n + 19;
+}
+
+size_t MML_dtoa_f(char *buf, size_t size, double x, uint32_t prec)
+{
+	if (!isfinite(x) || prec > MAX_EXACT_F_PREC)
+		return snprintf(buf, size, "%.*f", (int)prec, x);
+
+	// X = M * 2^E exactly; the output is X * 10^prec = M * 5^prec * 2^(E + prec)
+	// rounded to an integer R, half to even like printf
+	int32_t e;
+	const double frac = frexp(fabs(x), &e);
+	const uint64_t m = (uint64_t)ldexp(frac, DOUBLE_MANTISSA_BITS + 1);
+	e -= DOUBLE_MANTISSA_BITS + 1;
+
+	unsigned __int128 v = m;
+	for (uint32_t i = 0; i < prec; ++i)
+		v *= 5;
+
+	unsigned __int128 r;
+	const int32_t shift = e + (int32_t)prec;
+	if (shift >= 0)
+	{
+		// only while R fits, which covers every double below about 2^70
+		if (shift >= 128 || v > ((unsigned __int128)-1 >> shift))
+			return snprintf(buf, size, "%.*f", (int)prec, x);
+		r = v << shift;
+	} else if (shift <= -128)
+	{
+		r = 0;	// V < 2^116, far less than half
+	} else
+	{
+		const int32_t s = -shift;
+		r = v >> s;
+		const unsigned __int128 rem = v & (((unsigned __int128)1 << s) - 1);
+		const unsigned __int128 half = (unsigned __int128)1 << (s - 1);
+		if (rem > half || (rem == half && (r & 1) != 0))
+			++r;
+	}
+
+	char digs[40];
+	const uint32_t nd = write_digits128(digs, r);
+
+	writer w = { buf, size, 0 };
+	if (signbit(x))
+		put_c(&w, '-');
+	if (nd <= prec)
+	{
+		put_c(&w, '0');
+		if (prec != 0)
+			put_c(&w, '.');
+		put_n(&w, '0', prec - nd);
+		put_s(&w, digs, nd);
+	} else
+	{
+		put_s(&w, digs, nd - prec);
+		if (prec != 0)
+			put_c(&w, '.');
+		put_s(&w, digs + nd - prec, prec);
+	}
+
+	return finish(&w);
+}
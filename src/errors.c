@@ -0,0 +1,113 @@
+#include "mml/errors.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "mml/config.h"
+#include "mml/eval.h"
+#include "mml/parser.h"
+#include "mml/trace.h"
+
+// long enough for any message, since the identifier in it is cut short
+#define MESSAGE_BUF_SIZE 256
+
+void MML_error_report(MML_state *restrict state, const char *file, uint32_t line,
+		strbuf span, MML_error err)
+{
+	const size_t span_len = (span.len < MML_ERROR_SPAN_SIZE) ? span.len : MML_ERROR_SPAN_SIZE - 4;
+	if (span_len != 0)
+		memcpy(err.span, span.s, span_len);
+	err.span[span_len] = '\0';
+	if (span_len != span.len)
+		memcpy(err.span + span_len, "...", 4);
+	err.file = file;
+	err.line = line;
+	MML_trace2(MML_TRACE_WARN, "eval.error", err.code, err.op);
+	MML_error_ring *errors = &state->errors;
+	errors->ring[errors->n_errors++ % MML_ERROR_RING_SIZE] = err;
+	if (errors->quiet)
+		return;
+
+	char buf[MESSAGE_BUF_SIZE];
+	MML_error_format(&err, buf, sizeof(buf));
+	MML_dbg_print_func(file, line, stderr, err.severity, "%s\n", buf);
+}
+
+void MML_eval_set_quiet_errors(MML_state *restrict state, bool quiet)
+{
+	state->errors.quiet = quiet;
+}
+
+uint64_t MML_errors_count(const MML_state *restrict state)
+{
+	return state->errors.n_errors;
+}
+
+bool MML_error_get(const MML_state *restrict state, size_t i, MML_error *out)
+{
+	const MML_error_ring *errors = &state->errors;
+	if (i >= errors->n_errors || i >= MML_ERROR_RING_SIZE)
+		return false;
+	*out = errors->ring[(errors->n_errors - 1 - i) % MML_ERROR_RING_SIZE];
+	return true;
+}
+
+static bool is_number_type(MML_expr_type type)
+{
+	return type == RealNumber_type || type == ComplexNumber_type || type == Boolean_type;
+}
+
+size_t MML_error_format(const MML_error *restrict err, char *restrict buf, size_t n)
+{
+	int ret = 0;
+	switch (err->code) {
+	case MML_ERR_NONE:
+		ret = snprintf(buf, n, "no error");
+		break;
+	case MML_ERR_NO_ARGS:
+		ret = snprintf(buf, n, "undefined function for empty argument list in call to function: '%s'",
+				err->span);
+		break;
+	case MML_ERR_UNDEFINED_FUNC:
+		ret = snprintf(buf, n, "undefined function '%s' for %s argument in function call",
+				err->span, EXPR_TYPE_STRINGS[err->types[0]]);
+		break;
+	case MML_ERR_UNARY_OP:
+		ret = (err->op == MML_OP_NOT_TOK)
+			? snprintf(buf, n, "invalid unary operator on complex operand: %s", TOK_STRINGS[err->op])
+			: snprintf(buf, n, "failed to apply %s operator on %s operand",
+					TOK_STRINGS[err->op], EXPR_TYPE_STRINGS[err->types[0]]);
+		break;
+	case MML_ERR_BINARY_OP:
+		if (is_number_type(err->types[0]) && is_number_type(err->types[1]))
+			ret = snprintf(buf, n, "invalid binary operator on %s operands: %s",
+					(err->types[0] == ComplexNumber_type || err->types[1] == ComplexNumber_type)
+						? "complex" : "real",
+					TOK_STRINGS[err->op]);
+		else if (err->types[0] == Vector_type && err->types[1] == Vector_type
+		      && err->args[0] == err->args[1])
+			ret = snprintf(buf, n, "invalid binary operator on two equal-length vector operands: %s",
+					TOK_STRINGS[err->op]);
+		else
+			ret = snprintf(buf, n, "invalid binary operator on %s and %s operands: %s",
+					EXPR_TYPE_STRINGS[err->types[0]], EXPR_TYPE_STRINGS[err->types[1]],
+					TOK_STRINGS[err->op]);
+		break;
+	case MML_ERR_INDEX_NOT_INT:
+		ret = snprintf(buf, n, "vectors may only be indexed by a positive integer");
+		break;
+	case MML_ERR_INDEX_RANGE:
+		ret = snprintf(buf, n, "index %zu out of range for vector of length %zu",
+				err->args[0], err->args[1]);
+		break;
+	case MML_ERR_UNDEFINED_IDENT:
+		ret = snprintf(buf, n, "undefined identifier: '%s'", err->span);
+		break;
+	}
+	return (ret > 0) ? (size_t)ret : 0;
+}
+
+void MML_errors_clear(MML_state *restrict state)
+{
+	state->errors.n_errors = 0;
+}
@@ -7,73 +7,44 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdatomic.h>
+#include <time.h>
 
+#include "mml/builtins.h"
 #include "mml/expr.h"
 #include "mml/config.h"
 #include "mml/token.h"
 #include "mml/parser.h"
+#include "mml/parse_cache.h"
+#include "mml/memo.h"
+#include "mml/reduce.h"
+#include "mml/trace.h"
 #include "arena/arena.h"
 #include "cvi/dvec/dvec.h"
 #include "c-hashmap/map.h"
 
-/* 0 constants
- * 1 tv_tv_funcs
- * 2 d_d_funcs
- * 3 cd_cd_funcs
- * 4 cd_d_funcs
- * 5 d_cd_funcs
- */
-static hashmap *eval_builtin_maps[] = {
-	nullptr,
-	nullptr,
-	nullptr,
-	nullptr,
-	nullptr,
-	nullptr,
-};
-static bool eval_builtins_are_initialized = false;
 static size_t initialized_evaluators_count = 0;
 Arena *MML_global_arena = NULL;
 
-void math__register_functions(hashmap *maps[6]);
-void stdmml__register_functions(hashmap *maps[6]);
-
 MML_state *MML_init_state(void)
 {
 	MML_state *state = calloc(1, sizeof(MML_state));
 	state->config = &MML_global_config;
 
-	if (eval_builtins_are_initialized)
-		goto skip_builtins_init;
-
-	MML_global_arena = arena_make(8192);
-
-	eval_builtin_maps[1] = hashmap_create();
-	eval_builtin_maps[2] = hashmap_create();
-	eval_builtin_maps[3] = hashmap_create();
-	eval_builtin_maps[4] = hashmap_create();
-	eval_builtin_maps[5] = hashmap_create();
-
-	hashmap_set(eval_builtin_maps[1], hashmap_str_lit("print"),			(uintptr_t)MML_print_typedval_multiargs);
-	hashmap_set(eval_builtin_maps[1], hashmap_str_lit("println"),		(uintptr_t)MML_println_typedval_multiargs);
-
-
-	eval_builtin_maps[0] = hashmap_create();
-	static constexpr MML_value EXIT_CMD_M	= { Invalid_type, .i = MML_QUIT_INVAL };
-	static constexpr MML_value CLEAR_CMD_M	= { Invalid_type, .i = MML_CLEAR_INVAL };
-
-	hashmap_set(eval_builtin_maps[0], hashmap_str_lit("exit"),	(uintptr_t)&EXIT_CMD_M);
-	hashmap_set(eval_builtin_maps[0], hashmap_str_lit("clear"),	(uintptr_t)&CLEAR_CMD_M);
-
-	math__register_functions(eval_builtin_maps);
-	stdmml__register_functions(eval_builtin_maps);
-
-	eval_builtins_are_initialized = true;
-
-skip_builtins_init:
+	// the builtins are a table made at build time (see `MML_builtin_get`)
+	if (initialized_evaluators_count == 0)
+		MML_global_arena = arena_make(8192);
 
 	state->variables = nullptr;
+	MML_outbuf_init(&state->out, stdout);
 
+	state->budget = (MML_eval_budget) {
+		.max_nodes = 0,
+		.max_nsecs = 0,
+		.max_arena_bytes = 0,
+		.max_depth = MML_DEFAULT_MAX_DEPTH,
+	};
+	atomic_init(&state->cancel_requested, false);
 
 	state->is_init = true;
 	++initialized_evaluators_count;
@@ -83,33 +54,82 @@ skip_builtins_init:
 
 void MML_cleanup_state(MML_state *restrict state)
 {
+	MML_outbuf_destroy(&state->out);
+
 	if (state->variables != nullptr)
 	{
 		hashmap_free(state->variables);
 		state->variables = nullptr;
 	}
 
+	MML_parse_cache_free(state->parse_cache);
+	MML_memo_free(state->memo);
+
+	strbuf *file;
+	dv_foreach(state->mapped_files, file)
+		MML_unmap_file(*file);
+	dv_destroy(state->mapped_files);
+
 	state->is_init = false;
 	if (--initialized_evaluators_count == 0)
-	{
-		for (uint8_t i = 0; i < 6; ++i)
-		{
-			hashmap_free(eval_builtin_maps[i]);
-			eval_builtin_maps[i] = nullptr;
-		}
-
 		arena_destroy(MML_global_arena);
-	}
 
 	free(state);
 }
 
+void MML_eval_set_budget(MML_state *restrict state, const MML_eval_budget *budget)
+{
+	state->budget = *budget;
+}
+
+static int32_t memo_define_var(const void *name, size_t name_len, uintptr_t expr, void *memo)
+{
+	MML_memo_define(memo, (strbuf) { (char *)name, name_len }, (const MML_expr *)expr);
+	return 0;
+}
+
+int32_t MML_eval_set_memoize(MML_state *restrict state, bool on)
+{
+	if (!on)
+	{
+		MML_memo_free(state->memo);
+		state->memo = NULL;
+		return 0;
+	}
+	if (state->memo != NULL)
+		return 0;
+	if ((state->memo = MML_memo_make()) == NULL)
+	{
+		MML_log_err("failed to allocate the variable value cache\n");
+		return -1;
+	}
+	// variables set before (e.g. by --set_var) need records too, or what
+	// reads them would be kept after they change
+	if (state->variables != nullptr)
+		hashmap_iterate(state->variables, memo_define_var, state->memo);
+	return 0;
+}
+
+void MML_eval_cancel(MML_state *state)
+{
+	atomic_store_explicit(&state->cancel_requested, true, memory_order_relaxed);
+}
+
 int32_t MML_eval_set_variable(MML_state *restrict state,
 		strbuf name, MML_expr *expr)
 {
 	if (state->variables == nullptr)
 		state->variables = hashmap_create();
 	
+	if (state->memo != NULL)
+		MML_memo_define(state->memo, name, expr);
+
+	// the map keeps the key's address, but only a new entry takes it, so a
+	// variable that is set again doesn't need another copy
+	uintptr_t old;
+	if (hashmap_get(state->variables, name.s, name.len, &old))
+		return hashmap_set(state->variables, name.s, name.len, (uintptr_t)expr);
+
 	char *key_copy = arena_alloc_T(MML_global_arena, name.len, char);
 	memcpy(key_copy, name.s, name.len);
 
@@ -127,56 +147,163 @@ MML_expr *MML_eval_get_variable(MML_state *restrict state,
 	return NULL;
 }
 
+int32_t MML_bind_vector_mmap(MML_state *restrict state,
+		strbuf name, const char *path)
+{
+	const strbuf file = MML_map_file(path);
+	if (file.s == NULL)
+		return -1;
+	if (file.len % sizeof(double) != 0)
+	{
+		MML_log_err("'%s' is %zu bytes long, which isn't a whole number of doubles\n",
+				path, file.len);
+		MML_unmap_file(file);
+		return -1;
+	}
+	dv_push(state->mapped_files, file);
+
+	MML_expr *vec = arena_alloc_T(MML_global_arena, 1, MML_expr);
+	vec->type = Vector_type;
+	vec->v = (MML_expr_vec) {
+		.ptr = NULL,
+		.n = file.len / sizeof(double),
+		.packed = (const double *)file.s,
+	};
+
+	return MML_eval_set_variable(state, name, vec);
+}
+
 #define EPSILON 1e-14
 
-static MML_value apply_func(MML_state *restrict state,
-		strbuf ident, MML_value right_vec)
+static inline bool is_real(const MML_value *v)
 {
-	MML_val_func vec_args_func;
-	if (hashmap_get(eval_builtin_maps[1], ident.s, ident.len, (uintptr_t *)&vec_args_func))
-		return ((*vec_args_func)(state, &right_vec.v));
+	return v->type == RealNumber_type || v->type == Boolean_type;
+}
 
-	double (*d_d_func) (double);
-	_Complex double (*cd_cd_func) (_Complex double);
-	_Complex double (*cd_d_func) (double);
-	double (*d_cd_func) (_Complex double);
+// Writes the real numbers of ARGS to TERMS, the first N_VALS of which are
+// already evaluated into VALS. Returns false (with an error reported) if
+// one isn't a real number.
+static bool gather_reals(MML_state *restrict state, strbuf ident,
+		const MML_expr_vec *args, const MML_value *vals, size_t n_vals, double *terms)
+{
+	for (size_t i = 0; i < args->n; ++i)
+	{
+		const MML_value val = (i < n_vals) ? vals[i] : MML_vec_elem(state, args, i);
+		if (!is_real(&val))
+		{
+			MML_report_span(state, MML_ERR_UNDEFINED_FUNC, MML_LOG_ERROR, ident,
+					.types = { val.type });
+			return false;
+		}
+		terms[i] = MML_get_number(&val);
+	}
+	return true;
+}
 
-	if (right_vec.v.n == 0)
+// Calls the `d_v` function of BUILTIN on the arguments ARGS, or on the
+// elements of the first if that is their only one and a vector.
+static MML_value apply_d_v(MML_state *restrict state, strbuf ident, const MML_builtin *builtin,
+		const MML_expr_vec *args, const MML_value *vals, size_t n_vals)
+{
+	if (args->n == 1 && vals[0].type == Vector_type)
 	{
-		MML_log_err("undefined function for empty argument list in call to function: '%.*s'\n",
-				(int)ident.len, ident.s);
+		args = &vals[0].v;
+		n_vals = 0;
+	}
+	if (args->packed != NULL)
+		return VAL_NUM((*builtin->fn.d_v)(args->packed, args->n));
+
+	double *terms __attribute__((cleanup(MML_free_pp)))
+		= malloc(args->n * sizeof(double));
+	if (terms == NULL && args->n != 0)
+		return VAL_INVAL;
+	if (!gather_reals(state, ident, args, vals, n_vals, terms))
 		return VAL_INVAL;
+	return VAL_NUM((*builtin->fn.d_v)(terms, args->n));
+}
+
+// Calls the first typed function of BUILTIN that fits the (at least one)
+// arguments ARGS, in the order of `MML_native`. The first N_VALS arguments
+// are already evaluated into VALS: at least 1, and both if there are 2 and
+// BUILTIN has a function that takes 2.
+static MML_value call_native(MML_state *restrict state, strbuf ident, const MML_builtin *builtin,
+		const MML_expr_vec *args, const MML_value *vals, size_t n_vals)
+{
+	const MML_value *first = &vals[0];
+	if (args->n == 2 && n_vals == 2)
+	{
+		const MML_value *second = &vals[1];
+		if (is_real(first) && is_real(second) && builtin->fn.d_dd != NULL)
+			return VAL_NUM((*builtin->fn.d_dd)(
+					MML_get_number(first), MML_get_number(second)));
+		if (VAL_IS_NUM(*first) && VAL_IS_NUM(*second) && builtin->fn.cd_cdcd != NULL)
+			return VAL_CNUM((*builtin->fn.cd_cdcd)(
+					MML_get_complex(first), MML_get_complex(second)));
 	}
-	const MML_value first_arg_val = MML_eval_expr(state, right_vec.v.ptr[0]);
-	if (first_arg_val.type == RealNumber_type)
+
+	if (builtin->fn.d_v != NULL)
+		return apply_d_v(state, ident, builtin, args, vals, n_vals);
+
+	if (is_real(first))
 	{
-		if (hashmap_get(eval_builtin_maps[4], ident.s, ident.len, (uintptr_t *)&cd_d_func))
-			if (first_arg_val.type == RealNumber_type)
-				return VAL_CNUM((*cd_d_func)(first_arg_val.n));
-		if (hashmap_get(eval_builtin_maps[2], ident.s, ident.len, (uintptr_t *)&d_d_func))
-			if (first_arg_val.type == RealNumber_type)
-				return VAL_NUM((*d_d_func)(first_arg_val.n));
-	} else if (first_arg_val.type == ComplexNumber_type)
+		if (builtin->fn.cd_d != NULL)
+			return VAL_CNUM((*builtin->fn.cd_d)(MML_get_number(first)));
+		if (builtin->fn.d_d != NULL)
+			return VAL_NUM((*builtin->fn.d_d)(MML_get_number(first)));
+	} else if (first->type == ComplexNumber_type)
 	{
-		char *temp __attribute__((cleanup(MML_free_pp)))
-			= calloc(ident.len + sizeof("complex_")-1, sizeof(char));
-		memcpy(temp, "complex_", sizeof("complex_")-1);
-		memcpy(temp+8, ident.s, ident.len);
+		if (builtin->fn.d_cd != NULL)
+			return VAL_NUM((*builtin->fn.d_cd)(first->cn));
+		if (builtin->fn.cd_cd != NULL)
+			return VAL_CNUM((*builtin->fn.cd_cd)(first->cn));
+	}
 
-		if (hashmap_get(eval_builtin_maps[5], temp, ident.len + sizeof("complex_")-1, (uintptr_t *)&d_cd_func))
-			if (first_arg_val.type == ComplexNumber_type)
-				return VAL_NUM((*d_cd_func)(first_arg_val.cn));
+	MML_report_span(state, MML_ERR_UNDEFINED_FUNC, MML_LOG_ERROR, ident,
+			.types = { first->type });
+	return VAL_INVAL;
+}
+
+static MML_value apply_func(MML_state *restrict state,
+		strbuf ident, MML_value right_vec)
+{
+	const MML_builtin *builtin = MML_builtin_get(ident);
+	if (builtin != NULL && builtin->fn.vec != NULL)
+	{
+		if (right_vec.v.packed == NULL)
+			return ((*builtin->fn.vec)(state, &right_vec.v));
 
-		if (hashmap_get(eval_builtin_maps[3], temp, ident.len + sizeof("complex_")-1, (uintptr_t *)&cd_cd_func))
-			if (first_arg_val.type == ComplexNumber_type)
-				return VAL_CNUM((*cd_cd_func)(first_arg_val.cn));
+		// builtins get their arguments as expressions, so a packed vector
+		// is passed as the single argument, like `f{v}`
+		MML_expr arg = { Vector_type, .v = right_vec.v };
+		MML_expr *arg_p = &arg;
+		MML_expr_vec args = { &arg_p, 1, NULL };
+		return ((*builtin->fn.vec)(state, &args));
 	}
 
+	if (right_vec.v.n == 0)
+	{
+		MML_report_span(state, MML_ERR_NO_ARGS, MML_LOG_ERROR, ident);
+		return VAL_INVAL;
+	}
+	// each argument is evaluated once, whichever function gets it
+	MML_value vals[2] = { MML_vec_elem(state, &right_vec.v, 0) };
+	size_t n_vals = 1;
+	if (builtin == NULL)
+	{
+		MML_report_span(state, MML_ERR_UNDEFINED_FUNC, MML_LOG_ERROR, ident,
+				.types = { vals[0].type });
+		return VAL_INVAL;
+	}
+	if (right_vec.v.n == 2 && (builtin->fn.d_dd != NULL
+			|| builtin->fn.cd_cdcd != NULL || builtin->fn.d_v != NULL))
+		vals[n_vals++] = MML_vec_elem(state, &right_vec.v, 1);
 
-	MML_log_err("undefined function '%.*s' for %s argument in function call\n",
-			(int)ident.len, ident.s,
-			EXPR_TYPE_STRINGS[first_arg_val.type]);
-	return VAL_INVAL;
+	return call_native(state, ident, builtin, &right_vec.v, vals, n_vals);
+}
+
+static inline size_t vec_len(MML_value v)
+{
+	return (v.type == Vector_type) ? v.v.n : 0;
 }
 
 MML_value MML_apply_binary_op(MML_state *restrict state, MML_value a, MML_value b, MML_token_type op)
@@ -192,7 +319,8 @@ MML_value MML_apply_binary_op(MML_state *restrict state, MML_value a, MML_value
 			if (a.type != ComplexNumber_type)
 				return VAL_BOOL(MML_get_number(&a) == 0);
 
-			MML_log_warn("invalid unary operator on complex operand: %s\n", TOK_STRINGS[MML_OP_NOT_TOK]);
+			MML_report(state, MML_ERR_UNARY_OP, MML_LOG_WARN,
+					.op = op, .types = { a.type });
 			return VAL_INVAL;
 		case MML_OP_NEGATE:
 			switch (a.type) {
@@ -204,7 +332,8 @@ MML_value MML_apply_binary_op(MML_state *restrict state, MML_value a, MML_value
 			case Vector_type:
 				return MML_apply_binary_op(state, a, VAL_NUM(-1), MML_OP_MUL_TOK);
 			default:
-				MML_log_warn("failed to apply %s operator on %s operand\n", TOK_STRINGS[op], EXPR_TYPE_STRINGS[a.type]);
+				MML_report(state, MML_ERR_UNARY_OP, MML_LOG_WARN,
+						.op = op, .types = { a.type });
 				return VAL_INVAL;
 			}
 		case MML_PIPE_TOK:
@@ -216,25 +345,33 @@ MML_value MML_apply_binary_op(MML_state *restrict state, MML_value a, MML_value
 				return VAL_NUM(fabs(MML_get_number(&a)));
 			case Vector_type:
 				// compute vector magnitude
-				_Complex double sum = 0.0;
+				double *squares __attribute__((cleanup(MML_free_pp)))
+					= malloc(a.v.n * sizeof(double));
+				if (squares == NULL && a.v.n != 0)
+					return VAL_INVAL;
 				MML_value cur_elem;
-				for (size_t i = 0; i < a.v.n; ++i)
+				if (a.v.packed != NULL)
+					for (size_t i = 0; i < a.v.n; ++i)
+						squares[i] = a.v.packed[i]*a.v.packed[i];
+				else for (size_t i = 0; i < a.v.n; ++i)
 				{
 					cur_elem = MML_eval_expr(state, a.v.ptr[i]);
-					sum += MML_apply_binary_op(state, cur_elem, cur_elem, MML_OP_MUL_TOK).n;
+					squares[i] = MML_apply_binary_op(state, cur_elem, cur_elem, MML_OP_MUL_TOK).n;
 				}
-				_Complex double ret = csqrt(sum);
+				_Complex double ret = csqrt(MML_reduce_sum(squares, a.v.n, &state->config->reduce));
 				return (cimag(ret) == 0.0) ? VAL_NUM(creal(ret)) : VAL_CNUM(ret);
 			default:
-				MML_log_warn("failed to apply %s operator on %s operand\n", TOK_STRINGS[op], EXPR_TYPE_STRINGS[a.type]);
+				MML_report(state, MML_ERR_UNARY_OP, MML_LOG_WARN,
+						.op = op, .types = { a.type });
 				return VAL_INVAL;
 			}
 		case MML_TILDE_TOK:
 			MML_expr_vec ret;
-			ret.ptr = arena_alloc_T(MML_global_arena, 2, MML_expr *);
+			ret.ptr = arena_alloc_T(MML_eval_arena(state), 2, MML_expr *);
 			ret.n = 2;
+			ret.packed = NULL;
 
-			MML_expr *data = arena_alloc_T(MML_global_arena, 2, MML_expr);
+			MML_expr *data = arena_alloc_T(MML_eval_arena(state), 2, MML_expr);
 			const MML_value negated_a = MML_apply_binary_op(state,
 					a,
 					VAL_INVAL,
@@ -258,7 +395,8 @@ MML_value MML_apply_binary_op(MML_state *restrict state, MML_value a, MML_value
 			case RealNumber_type:
 				return VAL_NUM(sqrt(MML_get_number(&a)));
 			default:
-				MML_log_warn("failed to apply %s operator on %s operand\n", TOK_STRINGS[op], EXPR_TYPE_STRINGS[a.type]);
+				MML_report(state, MML_ERR_UNARY_OP, MML_LOG_WARN,
+						.op = op, .types = { a.type });
 				return VAL_INVAL;
 			}
 		default:
@@ -287,7 +425,8 @@ MML_value MML_apply_binary_op(MML_state *restrict state, MML_value a, MML_value
 			case MML_OP_EXACT_NOTEQ: return VAL_BOOL(MML_get_number(&a) != MML_get_number(&b));
 			case MML_OP_ROOT: return VAL_NUM(pow(MML_get_number(&a), 1.0/MML_get_number(&b)));
 			default:
-				MML_log_warn("invalid binary operator on real operands: %s\n", TOK_STRINGS[op]);
+				MML_report(state, MML_ERR_BINARY_OP, MML_LOG_WARN,
+						.op = op, .types = { a.type, b.type });
 				return VAL_INVAL;
 		}
 	} else if (VAL_IS_NUM(a) && VAL_IS_NUM(b))
@@ -306,7 +445,8 @@ MML_value MML_apply_binary_op(MML_state *restrict state, MML_value a, MML_value
 				return VAL_BOOL(MML_get_complex(&a) != MML_get_complex(&b));
 			case MML_OP_ROOT: return VAL_NUM(cpow(MML_get_complex(&a), 1.0/MML_get_complex(&b)));
 			default:
-				MML_log_warn("invalid binary operator on complex operands: %s\n", TOK_STRINGS[op]);
+				MML_report(state, MML_ERR_BINARY_OP, MML_LOG_WARN,
+						.op = op, .types = { a.type, b.type });
 				return VAL_INVAL;
 		}
 	} else if (a.type == Vector_type && b.type == RealNumber_type
@@ -316,15 +456,15 @@ MML_value MML_apply_binary_op(MML_state *restrict state, MML_value a, MML_value
 		size_t i = (size_t)MML_get_number(&b);
 		if (fabs(i - MML_get_number(&b)) > EPSILON || MML_get_number(&b) < 0)
 		{
-			MML_log_err("vectors may only be indexed by a positive integer\n");
+			MML_report(state, MML_ERR_INDEX_NOT_INT, MML_LOG_ERROR);
 			return VAL_INVAL;
 		}
 		if (i >= a.v.n)
 		{
-			MML_log_err("index %zu out of range for vector of length %zu\n", i, a.v.n);
+			MML_report(state, MML_ERR_INDEX_RANGE, MML_LOG_ERROR, .args = { i, a.v.n });
 			return VAL_INVAL;
 		}
-		return MML_eval_expr(state, a.v.ptr[i]);
+		return MML_vec_elem(state, &a.v, i);
 	} else if (a.type == Vector_type && b.type == Vector_type
 		  && a.v.n == b.v.n)
 	{
@@ -337,31 +477,41 @@ MML_value MML_apply_binary_op(MML_state *restrict state, MML_value a, MML_value
 				// where the dot product of two vectors is calculated using the dot products
 				// of the corresponding nested vectors in each, along with the regular
 				// multiplication. (not intentionally, that's just what happens)
-				double sum = 0.0;
-				for (size_t i = 0; i < a.v.n; ++i)
+				//
+				// the products are evaluated in order, then summed with the
+				// deterministic tree reduction so the result doesn't depend
+				// on how many threads sum them
+				double *products __attribute__((cleanup(MML_free_pp)))
+					= malloc(a.v.n * sizeof(double));
+				if (products == NULL && a.v.n != 0)
+					return VAL_INVAL;
+				if (a.v.packed != NULL && b.v.packed != NULL)
+					for (size_t i = 0; i < a.v.n; ++i)
+						products[i] = a.v.packed[i]*b.v.packed[i];
+				else for (size_t i = 0; i < a.v.n; ++i)
 				{
-					sum += MML_apply_binary_op(state,
-							MML_eval_expr(state, a.v.ptr[i]), 
-							MML_eval_expr(state, b.v.ptr[i]), 
+					products[i] = MML_apply_binary_op(state,
+							MML_vec_elem(state, &a.v, i), 
+							MML_vec_elem(state, &b.v, i), 
 							MML_OP_MUL_TOK).n;
 				}
-				return VAL_NUM(sum);
+				return VAL_NUM(MML_reduce_sum(products, a.v.n, &state->config->reduce));
 			}
 			case MML_OP_EQ_TOK:
 			{
 				for (size_t i = 0; i < a.v.n; ++i)
 				{
 					if (!MML_apply_binary_op(state,
-							MML_eval_expr(state, a.v.ptr[i]), 
-							MML_eval_expr(state, b.v.ptr[i]), 
+							MML_vec_elem(state, &a.v, i), 
+							MML_vec_elem(state, &b.v, i), 
 							MML_OP_EQ_TOK).b)
 						return VAL_BOOL(false);
 				}
 				return VAL_BOOL(true);
 			}
 			default:
-				MML_log_err("invalid binary operator on two equal-length vector operands: %s\n",
-						TOK_STRINGS[op]);
+				MML_report(state, MML_ERR_BINARY_OP, MML_LOG_ERROR,
+						.op = op, .types = { a.type, b.type }, .args = { a.v.n, b.v.n });
 				return VAL_INVAL;
 		}
 	} else if ((a.type == Vector_type && VAL_IS_NUM(b)) ||
@@ -376,22 +526,42 @@ MML_value MML_apply_binary_op(MML_state *restrict state, MML_value a, MML_value
 				? &a.v
 				: &b.v;
 			MML_expr_vec ret;
-			ret.ptr = arena_alloc_T(MML_global_arena, src_vec->n, MML_expr *);
+			if (src_vec->packed != NULL
+			 && (a.type == RealNumber_type || b.type == RealNumber_type))
+			{
+				// keep the result packed too
+				double *packed = arena_alloc_T(MML_eval_arena(state), src_vec->n, double);
+				const double *restrict src = src_vec->packed;
+				const double x = (a.type == Vector_type) ? b.n : a.n;
+				const bool vec_first = (a.type == Vector_type);
+				for (size_t i = 0; i < src_vec->n; ++i)
+				{
+					switch (op) {
+					case MML_OP_ADD_TOK: packed[i] = src[i] + x; break;
+					case MML_OP_SUB_TOK: packed[i] = vec_first ? src[i] - x : x - src[i]; break;
+					case MML_OP_MUL_TOK: packed[i] = src[i] * x; break;
+					default:             packed[i] = vec_first ? src[i] / x : x / src[i]; break;
+					}
+				}
+				return (MML_value) { Vector_type, .v = { NULL, src_vec->n, packed } };
+			}
+			ret.ptr = arena_alloc_T(MML_eval_arena(state), src_vec->n, MML_expr *);
 			ret.n = src_vec->n;
+			ret.packed = NULL;
 
-			MML_expr *data = arena_alloc_T(MML_global_arena, src_vec->n, MML_expr);
+			MML_expr *data = arena_alloc_T(MML_eval_arena(state), src_vec->n, MML_expr);
 			for (size_t i = 0; i < src_vec->n; ++i)
 			{
 				MML_value cur;
 				if (a.type == Vector_type)
 					cur = MML_apply_binary_op(state,
-							MML_eval_expr(state, a.v.ptr[i]),
+							MML_vec_elem(state, &a.v, i),
 							b,
 							op);
 				else
 					cur = MML_apply_binary_op(state,
 							a,
-							MML_eval_expr(state, b.v.ptr[i]),
+							MML_vec_elem(state, &b.v, i),
 							op);
 				data[i].type = cur.type;
 				memcpy(&data[i].w, &cur.w, sizeof(cur.w));
@@ -399,20 +569,82 @@ MML_value MML_apply_binary_op(MML_state *restrict state, MML_value a, MML_value
 			}
 			return (MML_value) { Vector_type, .v = ret };
 		default:
-			MML_log_warn("invalid binary operator on %s and %s operands: %s\n",
-					EXPR_TYPE_STRINGS[a.type], EXPR_TYPE_STRINGS[b.type],
-					TOK_STRINGS[op]);
+			MML_report(state, MML_ERR_BINARY_OP, MML_LOG_WARN,
+					.op = op, .types = { a.type, b.type },
+					.args = { vec_len(a), vec_len(b) });
 			return VAL_INVAL;
 		}
 
 	}
 
-	MML_log_warn("invalid binary operator on %s and %s operands: %s\n",
-			EXPR_TYPE_STRINGS[a.type], EXPR_TYPE_STRINGS[b.type],
-			TOK_STRINGS[op]);
+	MML_report(state, MML_ERR_BINARY_OP, MML_LOG_WARN,
+			.op = op, .types = { a.type, b.type },
+			.args = { vec_len(a), vec_len(b) });
 	return VAL_INVAL;
 }
 
+static uint64_t monotonic_nsecs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static void begin_budget(MML_state *restrict state)
+{
+	state->nodes_visited = 0;
+	state->abort_code = MML_ERROR_INVAL;
+	state->arena_start = arena_bytes_used(MML_eval_arena(state));
+	state->deadline_nsecs = (state->budget.max_nsecs != 0)
+		? monotonic_nsecs() + state->budget.max_nsecs
+		: 0;
+}
+
+// the clock is only read once every this many nodes
+#define BUDGET_CLOCK_INTERVAL 1024
+
+// Returns the reason the current evaluation has to stop, or `MML_ERROR_INVAL`
+// if it may continue.
+static int64_t check_budget(MML_state *restrict state)
+{
+	const MML_eval_budget *b = &state->budget;
+
+	if (atomic_exchange_explicit(&state->cancel_requested, false, memory_order_relaxed))
+	{
+		MML_log_warn("evaluation cancelled\n");
+		return MML_CANCELLED_INVAL;
+	}
+	if (b->max_depth != 0 && state->depth >= b->max_depth)
+	{
+		MML_log_err("evaluation stopped: nesting depth limit (%" PRIu32 ") reached "
+				"(is a variable defined in terms of itself?)\n", b->max_depth);
+		return MML_DEPTH_LIMIT_INVAL;
+	}
+	if (b->max_nodes != 0 && state->nodes_visited > b->max_nodes)
+	{
+		MML_log_err("evaluation stopped: node limit (%" PRIu64 ") reached\n", b->max_nodes);
+		return MML_NODE_LIMIT_INVAL;
+	}
+	if (b->max_arena_bytes != 0
+	 && arena_bytes_used(MML_eval_arena(state)) - state->arena_start > b->max_arena_bytes)
+	{
+		MML_log_err("evaluation stopped: memory limit (%zu bytes) reached\n", b->max_arena_bytes);
+		return MML_MEMORY_LIMIT_INVAL;
+	}
+	if (state->deadline_nsecs != 0
+	 && state->nodes_visited % BUDGET_CLOCK_INTERVAL == 0
+	 && monotonic_nsecs() > state->deadline_nsecs)
+	{
+		MML_log_err("evaluation stopped: time limit (%.3fs) reached\n",
+				(double)b->max_nsecs / 1e9);
+		return MML_TIME_LIMIT_INVAL;
+	}
+
+	return MML_ERROR_INVAL;
+}
+
+static MML_value eval_node(MML_state *restrict state, const MML_expr *expr);
+
 MML_value MML_eval_expr_recurse(MML_state *restrict state, const MML_expr *expr)
 {
 	if (!state->is_init)
@@ -421,6 +653,49 @@ MML_value MML_eval_expr_recurse(MML_state *restrict state, const MML_expr *expr)
 		return VAL_INVAL;
 	}
 
+	if (state->depth == 0)
+		begin_budget(state);
+	else if (state->abort_code != MML_ERROR_INVAL)
+		return (MML_value) { Invalid_type, .i = state->abort_code };
+
+	++state->nodes_visited;
+	const int64_t abort_code = check_budget(state);
+	if (abort_code != MML_ERROR_INVAL)
+	{
+		MML_trace2(MML_TRACE_WARN, "eval.stopped", (uint64_t)abort_code, state->nodes_visited);
+		state->abort_code = abort_code;
+		return (MML_value) { Invalid_type, .i = abort_code };
+	}
+
+	++state->depth;
+	MML_value ret = eval_node(state, expr);
+	--state->depth;
+
+	// whatever the operators made of the unwinding values, the caller gets
+	// the reason the evaluation stopped
+	if (state->depth == 0 && state->abort_code != MML_ERROR_INVAL)
+		return (MML_value) { Invalid_type, .i = state->abort_code };
+
+	return ret;
+}
+
+// Gives the error the operator of EXPR reported, if any, EXPR as its node;
+// N_ERRORS is the count of errors before it was applied.
+static inline MML_value failed_at(MML_state *restrict state, const MML_expr *expr,
+		uint64_t n_errors, MML_value ret)
+{
+	MML_error_ring *errors = &state->errors;
+	if (ret.type == Invalid_type && errors->n_errors != n_errors)
+	{
+		MML_error *last = &errors->ring[(errors->n_errors - 1) % MML_ERROR_RING_SIZE];
+		if (last->expr == NULL)
+			last->expr = expr;
+	}
+	return ret;
+}
+
+static MML_value eval_node(MML_state *restrict state, const MML_expr *expr)
+{
 	if (expr == NULL)
 		return VAL_INVAL;
 	switch (expr->type) {
@@ -434,19 +709,30 @@ MML_value MML_eval_expr_recurse(MML_state *restrict state, const MML_expr *expr)
 		return VAL_CNUM(expr->cn);
 	case Boolean_type:
 		return VAL_BOOL(expr->b);
+	case Slot_type:
+		return VAL_NUM(**expr->slot);
 	case Identifier_type: {
-		MML_value *val;
 		if (expr->s.len == 3 && strncmp(expr->s.s, "ans", 3) == 0)
 			return state->last_val;
-		if (hashmap_get(eval_builtin_maps[0], expr->s.s, expr->s.len, (uintptr_t *)&val))
-			return *val;
+		const MML_builtin *builtin = MML_builtin_get(expr->s);
+		if (builtin != NULL && builtin->is_constant)
+			return builtin->constant;
 		
+		MML_value kept;
+		if (state->memo != NULL && MML_memo_get(state->memo, expr->s, &kept))
+			return kept;
 		MML_expr *e = MML_eval_get_variable(state, expr->s);
 		if (e != NULL)
-			return MML_eval_expr_recurse(state, e);
+		{
+			const MML_value val = MML_eval_expr_recurse(state, e);
+			// a value made while unwinding isn't the variable's
+			if (state->memo != NULL && state->abort_code == MML_ERROR_INVAL)
+				MML_memo_put(state->memo, expr->s, val);
+			return val;
+		}
 
-		MML_log_warn("undefined identifier: '%.*s'\n",
-				(int)expr->s.len, expr->s.s);
+		MML_report_span(state, MML_ERR_UNDEFINED_IDENT, MML_LOG_WARN, expr->s,
+				.expr = expr);
 		return VAL_INVAL;
 	}
 	default:
@@ -459,7 +745,10 @@ MML_value MML_eval_expr_recurse(MML_state *restrict state, const MML_expr *expr)
 	if (expr->o.op == MML_OP_ASSERT_EQUAL && left != NULL && left->type == Identifier_type)
 	{
 		MML_eval_set_variable(state, left->s, right);
-		return MML_eval_expr_recurse(state, right);
+		const MML_value val = MML_eval_expr_recurse(state, right);
+		if (state->memo != NULL && state->abort_code == MML_ERROR_INVAL)
+			MML_memo_put(state->memo, left->s, val);
+		return val;
 	} else if (expr->o.op == MML_OP_FUNC_CALL_TOK)
 	{
 		if (left == NULL
@@ -471,13 +760,18 @@ MML_value MML_eval_expr_recurse(MML_state *restrict state, const MML_expr *expr)
 		if (right_val_vec.type == Invalid_type)
 			return VAL_INVAL;
 
-		return apply_func(state, left->s, right_val_vec);
+		const uint64_t n_errors = state->errors.n_errors;
+		return failed_at(state, expr, n_errors,
+				apply_func(state, left->s, right_val_vec));
 	}
 
-	return MML_apply_binary_op(state,
-			MML_eval_expr_recurse(state, left),
-			(right != NULL) ? MML_eval_expr_recurse(state, right) : VAL_INVAL,
-			expr->o.op);
+	// errors of the operands have their own nodes by the time they return
+	const uint64_t n_errors = state->errors.n_errors;
+	return failed_at(state, expr, n_errors,
+			MML_apply_binary_op(state,
+				MML_eval_expr_recurse(state, left),
+				(right != NULL) ? MML_eval_expr_recurse(state, right) : VAL_INVAL,
+				expr->o.op));
 }
 inline MML_value MML_eval_expr(MML_state *restrict state, const MML_expr *expr)
 {
@@ -487,6 +781,21 @@ inline MML_value MML_eval_expr(MML_state *restrict state, const MML_expr *expr)
 
 MML_value MML_eval_parse(MML_state *restrict state, const char *s)
 {
+	if (state->parse_cache != NULL)
+	{
+		const MML_expr_dvec *stmts = MML_parse_cache_get(state->parse_cache, s);
+		if (stmts == NULL)
+			return VAL_INVAL;
+		MML_value cur = VAL_INVAL;
+		MML_expr **cur_i;
+		dv_foreach(*stmts, cur_i)
+			cur = MML_eval_expr(state, *cur_i);
+		// a vector value points into the trees it was evaluated from
+		MML_parse_cache_trim(state->parse_cache,
+				state->last_val.type == Vector_type);
+		return cur;
+	}
+
 	MML_expr_dvec exprs = MML_parse_stmts(s);
 	MML_value cur;
 	MML_expr **cur_i;
@@ -497,3 +806,352 @@ MML_value MML_eval_parse(MML_state *restrict state, const char *s)
 
 	return cur;
 }
+
+// A cancelled batch stops; the items it never got to are marked cancelled too.
+static inline size_t finish_cancelled_batch(MML_value *out, size_t done, size_t n)
+{
+	for (size_t i = done; i < n; ++i)
+		out[i] = (MML_value) { Invalid_type, .i = MML_CANCELLED_INVAL };
+	return done;
+}
+
+// a batch parses the trees of one source at a time into its scratch arena
+#define SCRATCH_BUCKET_SIZE 4096
+
+size_t MML_eval_parse_many(MML_state *restrict state,
+		const char *const *srcs, size_t n, MML_value *out)
+{
+	// the trees of a source are parsed into SCRATCH, which is reset for the
+	// next one unless something still points into them
+	Arena *scratch = arena_make(SCRATCH_BUCKET_SIZE);
+	size_t i = 0;
+	for (; i < n; ++i)
+	{
+		// statements are evaluated as soon as they're parsed, so a batch
+		// never collects them into a vector
+		const char *s = srcs[i];
+		struct parser_state pstate = { .arena = scratch };
+		bool has_more;
+		bool assigns = false;
+		MML_value cur = VAL_INVAL;
+		do
+		{
+			const MML_expr *expr = MML_parse_next_stmt(&s, &pstate, &has_more);
+			assigns = assigns || MML_expr_assigns(expr);
+			cur = MML_eval_expr(state, expr);
+		} while (has_more && !VAL_IS_ABORT(cur));
+		out[i] = cur;
+
+		// variables point into the trees that define them, and a vector
+		// value into the trees it was evaluated from
+		if (scratch != NULL && (assigns || cur.type == Vector_type))
+		{
+			arena_merge(MML_eval_arena(state), scratch);
+			scratch = arena_make(SCRATCH_BUCKET_SIZE);
+		} else if (scratch != NULL)
+			arena_reset(scratch);
+
+		if (cur.type == Invalid_type && cur.i == MML_CANCELLED_INVAL)
+			break;
+	}
+
+	if (scratch != NULL)
+		arena_destroy(scratch);
+	return (i < n) ? finish_cancelled_batch(out, i + 1, n) : n;
+}
+
+size_t MML_eval_expr_many(MML_state *restrict state,
+		const MML_expr *const *exprs, size_t n, MML_value *out)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		out[i] = MML_eval_expr(state, exprs[i]);
+		if (out[i].type == Invalid_type && out[i].i == MML_CANCELLED_INVAL)
+			return finish_cancelled_batch(out, i + 1, n);
+	}
+
+	return n;
+}
+
+
+struct MML_prepared {
+	MML_state *state;
+	MML_expr_dvec stmts;
+	size_t n_params;
+	// where each parameter is read from
+	const double **locs;
+	bool *host_bound;
+	// copies of the ARGS of the last call, which parameters not bound to a
+	// host location read (variables of P may be read after the call)
+	double *arg_vals;
+	// the parameters each statement reads (see `MML_prepared_deps`)
+	uint64_t *deps;
+};
+
+// what unbound parameters read before the first `MML_call`
+static const double unset_param = NAN;
+
+// Replaces the call EXPR with its value if it calls a pure typed builtin on
+// number literals, which gives the same value on every evaluation. The
+// literals are read directly, so nothing about STATE's evaluations changes.
+static void fold_call(MML_state *restrict state, MML_expr *expr)
+{
+	const MML_expr *left = expr->o.left, *right = expr->o.right;
+	if (left == NULL || left->type != Identifier_type
+	 || right == NULL || right->type != Vector_type || right->v.packed != NULL
+	 || right->v.n == 0)
+		return;
+	const MML_builtin *builtin = MML_builtin_get(left->s);
+	if (builtin == NULL || builtin->fn.impure || builtin->fn.vec != NULL)
+		return;
+	for (size_t i = 0; i < right->v.n; ++i)
+		if (!VAL_IS_NUM(*right->v.ptr[i]))
+			return;
+
+	MML_value *vals __attribute__((cleanup(MML_free_pp)))
+		= malloc(right->v.n * sizeof(MML_value));
+	if (vals == NULL)
+		return;
+	for (size_t i = 0; i < right->v.n; ++i)
+		vals[i] = (MML_value) { right->v.ptr[i]->type, .w = right->v.ptr[i]->w };
+
+	// a call that fails is left to report its error when evaluated, so the
+	// (at most one) error it records now is undone
+	MML_error_ring *errors = &state->errors;
+	const bool quiet = errors->quiet;
+	const uint64_t n_errors = errors->n_errors;
+	const MML_error overwritten = errors->ring[n_errors % MML_ERROR_RING_SIZE];
+	errors->quiet = true;
+	const MML_value val = call_native(state, left->s, builtin, &right->v, vals, right->v.n);
+	errors->quiet = quiet;
+	errors->n_errors = n_errors;
+	errors->ring[n_errors % MML_ERROR_RING_SIZE] = overwritten;
+
+	if (VAL_IS_NUM(val))
+	{
+		expr->type = val.type;
+		expr->w = val.w;
+	}
+}
+
+// Turns references to parameters into slots and builtin constants into
+// literals, so evaluating the result never looks up an identifier by name.
+static void bind_params(MML_prepared *p, MML_expr *expr, const char *const *param_names)
+{
+	if (expr == NULL)
+		return;
+
+	switch (expr->type) {
+	case Identifier_type:
+		for (size_t i = 0; i < p->n_params; ++i)
+			if (strlen(param_names[i]) == expr->s.len
+			 && strncmp(param_names[i], expr->s.s, expr->s.len) == 0)
+			{
+				expr->type = Slot_type;
+				expr->slot = &p->locs[i];
+				return;
+			}
+
+		const MML_builtin *builtin = MML_builtin_get(expr->s);
+		if (builtin != NULL && builtin->is_constant && VAL_IS_NUM(builtin->constant))
+		{
+			expr->type = builtin->constant.type;
+			expr->w = builtin->constant.w;
+		}
+		return;
+	case Vector_type:
+		for (size_t i = 0; expr->v.packed == NULL && i < expr->v.n; ++i)
+			bind_params(p, expr->v.ptr[i], param_names);
+		return;
+	case Operation_type:
+		// assignment targets and function names aren't values
+		if (expr->o.op != MML_OP_ASSERT_EQUAL && expr->o.op != MML_OP_FUNC_CALL_TOK)
+			bind_params(p, expr->o.left, param_names);
+		bind_params(p, expr->o.right, param_names);
+		if (expr->o.op == MML_OP_FUNC_CALL_TOK)
+			fold_call(p->state, expr);
+		return;
+	default:
+		return;
+	}
+}
+
+// Returns the parameters EXPR reads, directly or through the variables in
+// ASSIGNED (mapped to the parameters any of their definitions reads). Sets
+// *CHANGED if an assignment in EXPR adds to those.
+static uint64_t stmt_deps(const MML_prepared *p, const MML_expr *expr,
+		hashmap *assigned, bool *changed)
+{
+	if (expr == NULL)
+		return 0;
+
+	uintptr_t deps;
+	switch (expr->type) {
+	case Slot_type:
+		const size_t i = expr->slot - (const double *const *)p->locs;
+		return 1ull << ((i < 63) ? i : 63);
+	case Identifier_type:
+		return hashmap_get(assigned, expr->s.s, expr->s.len, &deps) ? deps : 0;
+	case Vector_type:
+		deps = 0;
+		for (size_t i = 0; expr->v.packed == NULL && i < expr->v.n; ++i)
+			deps |= stmt_deps(p, expr->v.ptr[i], assigned, changed);
+		return deps;
+	case Operation_type:
+		if (expr->o.op == MML_OP_ASSERT_EQUAL
+		 && expr->o.left != NULL && expr->o.left->type == Identifier_type)
+		{
+			const strbuf name = expr->o.left->s;
+			deps = stmt_deps(p, expr->o.right, assigned, changed);
+			uintptr_t old = 0;
+			hashmap_get(assigned, name.s, name.len, &old);
+			if ((deps & ~old) != 0)
+			{
+				hashmap_set(assigned, name.s, name.len, old | deps);
+				*changed = true;
+			}
+			return deps;
+		}
+		if (expr->o.op == MML_OP_FUNC_CALL_TOK)
+			return stmt_deps(p, expr->o.right, assigned, changed);
+		return stmt_deps(p, expr->o.left, assigned, changed)
+			| stmt_deps(p, expr->o.right, assigned, changed);
+	default:
+		return 0;
+	}
+}
+
+MML_prepared *MML_compile(MML_state *restrict state, const char *src, const char *const *param_names)
+{
+	MML_prepared *p = calloc(1, sizeof(MML_prepared));
+	if (p == NULL)
+		return NULL;
+	p->state = state;
+
+	while (param_names != NULL && param_names[p->n_params] != NULL)
+		++p->n_params;
+
+	p->locs = malloc(p->n_params * sizeof(*p->locs));
+	p->host_bound = calloc(p->n_params, sizeof(*p->host_bound));
+	p->arg_vals = malloc(p->n_params * sizeof(*p->arg_vals));
+	if ((p->locs == NULL || p->host_bound == NULL || p->arg_vals == NULL) && p->n_params != 0)
+	{
+		MML_log_err("failed to allocate %zu parameters for prepared expression\n", p->n_params);
+		MML_prepared_free(p);
+		return NULL;
+	}
+	for (size_t i = 0; i < p->n_params; ++i)
+		p->locs[i] = &unset_param;
+
+	p->stmts = MML_parse_stmts(src);
+	MML_expr **cur;
+	dv_foreach(p->stmts, cur)
+	{
+		if (*cur == NULL)
+		{
+			MML_log_err("failed to parse prepared expression: '%s'\n", src);
+			MML_prepared_free(p);
+			return NULL;
+		}
+		bind_params(p, *cur, param_names);
+	}
+
+	p->deps = malloc(dv_n(p->stmts) * sizeof(*p->deps));
+	hashmap *assigned = hashmap_create();
+	if ((p->deps == NULL && dv_n(p->stmts) != 0) || assigned == NULL)
+	{
+		MML_log_err("failed to allocate prepared expression dependencies\n");
+		if (assigned != NULL)
+			hashmap_free(assigned);
+		MML_prepared_free(p);
+		return NULL;
+	}
+	// variables are read when used, not when assigned, so a statement may
+	// read one assigned by a later statement; go over them until no
+	// variable gains a dependency
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+		for (size_t i = 0; i < dv_n(p->stmts); ++i)
+			p->deps[i] = stmt_deps(p, _dv_ptr(p->stmts)[i], assigned, &changed);
+	}
+	hashmap_free(assigned);
+
+	return p;
+}
+
+void MML_prepared_bind(MML_prepared *p, size_t param, const double *loc)
+{
+	if (param >= p->n_params)
+	{
+		MML_log_err("prepared expression has no parameter %zu\n", param);
+		return;
+	}
+
+	p->host_bound[param] = loc != NULL;
+	p->locs[param] = (loc != NULL) ? loc : &unset_param;
+}
+
+static void load_args(MML_prepared *p, const double *args)
+{
+	if (args != NULL)
+		for (size_t i = 0; i < p->n_params; ++i)
+			if (!p->host_bound[i])
+			{
+				p->arg_vals[i] = args[i];
+				p->locs[i] = &p->arg_vals[i];
+			}
+}
+
+MML_value MML_call(MML_prepared *p, const double *args)
+{
+	load_args(p, args);
+
+	MML_value ret = VAL_INVAL;
+	MML_expr **cur;
+	dv_foreach(p->stmts, cur)
+		ret = MML_eval_expr(p->state, *cur);
+
+	return ret;
+}
+
+size_t MML_prepared_n_stmts(const MML_prepared *p)
+{
+	return dv_n(p->stmts);
+}
+
+const MML_expr *MML_prepared_stmt(const MML_prepared *p, size_t stmt)
+{
+	return (stmt < dv_n(p->stmts)) ? _dv_ptr(p->stmts)[stmt] : NULL;
+}
+
+uint64_t MML_prepared_deps(const MML_prepared *p, size_t stmt)
+{
+	return (stmt < dv_n(p->stmts)) ? p->deps[stmt] : 0;
+}
+
+MML_value MML_call_stmt(MML_prepared *p, size_t stmt, const double *args)
+{
+	if (stmt >= dv_n(p->stmts))
+	{
+		MML_log_err("prepared expression has no statement %zu\n", stmt);
+		return VAL_INVAL;
+	}
+	load_args(p, args);
+
+	return MML_eval_expr(p->state, _dv_ptr(p->stmts)[stmt]);
+}
+
+void MML_prepared_free(MML_prepared *p)
+{
+	if (p == NULL)
+		return;
+
+	dv_destroy(p->stmts);
+	free(p->locs);
+	free(p->host_bound);
+	free(p->arg_vals);
+	free(p->deps);
+	free(p);
+}
@@ -4,74 +4,348 @@
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "arena/arena.h"
 #include "mml/parser.h"
 #include "mml/eval.h"
 #include "mml/expr.h"
 #include "mml/config.h"
+#include "mml/dtoa.h"
+#include "mml/outbuf.h"
 
 void MML_print_indent(uint32_t indent)
 {
 	printf("%*s", indent, "");
 }
 
+static void fprint_indent(FILE *out, uint32_t indent)
+{
+	fprintf(out, "%*s", indent, "");
+}
+
+// Writes X the way the config asks for: "%.*f" with --full-prec-floats,
+// the shortest round-trip form with --shortest-floats, "%.*g" otherwise.
+static void print_number(MML_outbuf *out, const struct MML_config *config, double x)
+{
+	size_t (*fmt)(char *, size_t, double, uint32_t) = (config->full_prec_floats)
+		? MML_dtoa_f
+		: MML_dtoa_g;
+
+	char *p = MML_outbuf_reserve(out, MML_DTOA_BUF_SIZE);
+	if (p == NULL)
+		return;
+	size_t n = (config->shortest_floats && !config->full_prec_floats)
+		? MML_dtoa_shortest(p, MML_DTOA_BUF_SIZE, x)
+		: fmt(p, MML_DTOA_BUF_SIZE, x, config->precision);
+	if (n >= MML_DTOA_BUF_SIZE)
+	{
+		// only long "%f" output gets here
+		p = MML_outbuf_reserve(out, n + 1);
+		if (p == NULL)
+			return;
+		fmt(p, n + 1, x, config->precision);
+	}
+	out->len += n;
+}
+
+static void print_shortest(MML_outbuf *out, double x)
+{
+	char *p = MML_outbuf_reserve(out, MML_DTOA_BUF_SIZE);
+	if (p != NULL)
+		out->len += MML_dtoa_shortest(p, MML_DTOA_BUF_SIZE, x);
+}
+
+static void put_le64(MML_outbuf *out, uint64_t v)
+{
+	uint8_t bytes[8];
+	for (uint32_t i = 0; i < 8; ++i)
+		bytes[i] = (uint8_t)(v >> (8*i));
+	MML_outbuf_write(out, (const char *)bytes, 8);
+}
+static inline void put_le_double(MML_outbuf *out, double x)
+{
+	uint64_t bits;
+	memcpy(&bits, &x, sizeof(bits));
+	put_le64(out, bits);
+}
+
+static void print_binary_header(MML_outbuf *out, uint8_t kind, uint8_t elem, uint64_t count)
+{
+	const uint8_t head[8] = { kind, elem };
+	MML_outbuf_write(out, (const char *)head, sizeof(head));
+	put_le64(out, count);
+}
+
+static void print_binary(MML_state *state, const MML_value *val)
+{
+	MML_outbuf *out = &state->out;
+	switch (val->type) {
+	case Integer_type:
+		print_binary_header(out, MML_BIN_SCALAR, MML_BIN_I64, 1);
+		put_le64(out, (uint64_t)val->i);
+		return;
+	case RealNumber_type:
+	case Boolean_type:
+		print_binary_header(out, MML_BIN_SCALAR, MML_BIN_F64, 1);
+		put_le_double(out, MML_get_number(val));
+		return;
+	case ComplexNumber_type:
+		print_binary_header(out, MML_BIN_SCALAR, MML_BIN_C128, 1);
+		put_le_double(out, creal(val->cn));
+		put_le_double(out, cimag(val->cn));
+		return;
+	case Vector_type:
+		break;
+	default:
+		print_binary_header(out, MML_BIN_INVALID, MML_BIN_F64, 0);
+		return;
+	}
+
+	if (val->v.packed != NULL)
+	{
+		print_binary_header(out, MML_BIN_VECTOR, MML_BIN_F64, val->v.n);
+		for (size_t i = 0; i < val->v.n; ++i)
+			put_le_double(out, val->v.packed[i]);
+		return;
+	}
+
+	// the element type is only known once every element is evaluated
+	MML_value *elems __attribute__((cleanup(MML_free_pp)))
+		= malloc(val->v.n * sizeof(MML_value));
+	if (elems == NULL && val->v.n != 0)
+	{
+		MML_log_err("failed to allocate %zu values for binary output\n", val->v.n);
+		print_binary_header(out, MML_BIN_INVALID, MML_BIN_F64, 0);
+		return;
+	}
+
+	bool is_complex = false;
+	bool all_ints = val->v.n != 0;
+	for (size_t i = 0; i < val->v.n; ++i)
+	{
+		elems[i] = MML_vec_elem(state, &val->v, i);
+		all_ints &= elems[i].type == Integer_type;
+		// integers are converted below unless every element is one
+		if (elems[i].type == Integer_type)
+			continue;
+		if (!VAL_IS_NUM(elems[i]))
+		{
+			MML_log_warn("binary output only supports vectors of numbers, not %s elements\n",
+					EXPR_TYPE_STRINGS[elems[i].type]);
+			print_binary_header(out, MML_BIN_INVALID, MML_BIN_F64, 0);
+			return;
+		}
+		is_complex |= elems[i].type == ComplexNumber_type;
+	}
+
+	if (all_ints)
+	{
+		print_binary_header(out, MML_BIN_VECTOR, MML_BIN_I64, val->v.n);
+		for (size_t i = 0; i < val->v.n; ++i)
+			put_le64(out, (uint64_t)elems[i].i);
+		return;
+	}
+	for (size_t i = 0; i < val->v.n; ++i)
+		if (elems[i].type == Integer_type)
+			elems[i] = VAL_NUM((double)elems[i].i);
+
+	print_binary_header(out, MML_BIN_VECTOR, (is_complex) ? MML_BIN_C128 : MML_BIN_F64, val->v.n);
+	for (size_t i = 0; i < val->v.n; ++i)
+	{
+		if (!is_complex)
+		{
+			put_le_double(out, MML_get_number(&elems[i]));
+			continue;
+		}
+		const _Complex double cn = MML_get_complex(&elems[i]);
+		put_le_double(out, creal(cn));
+		put_le_double(out, cimag(cn));
+	}
+}
+
+// Writes one CSV field (two for complex numbers). Returns false for values
+// CSV can't hold.
+static bool print_csv_field(MML_outbuf *out, const MML_value *val)
+{
+	switch (val->type) {
+	case Integer_type:
+		MML_outbuf_printf(out, "%" PRIi64, val->i);
+		return true;
+	case RealNumber_type:
+		print_shortest(out, val->n);
+		return true;
+	case Boolean_type:
+		MML_outbuf_putc(out, (val->b) ? '1' : '0');
+		return true;
+	case ComplexNumber_type:
+		print_shortest(out, creal(val->cn));
+		MML_outbuf_putc(out, ',');
+		print_shortest(out, cimag(val->cn));
+		return true;
+	default:
+		return false;
+	}
+}
+
+static void print_csv_row(MML_state *state, const MML_expr_vec *v)
+{
+	MML_outbuf *out = &state->out;
+	for (size_t i = 0; i < v->n; ++i)
+	{
+		const MML_value elem = MML_vec_elem(state, v, i);
+		if (i != 0)
+			MML_outbuf_putc(out, ',');
+		if (!print_csv_field(out, &elem))
+			MML_log_warn("CSV output can't hold %s values\n", EXPR_TYPE_STRINGS[elem.type]);
+	}
+	MML_outbuf_putc(out, '\n');
+}
+
+static void print_csv(MML_state *state, const MML_value *val)
+{
+	if (val->type != Vector_type)
+	{
+		if (!print_csv_field(&state->out, val))
+			MML_log_warn("CSV output can't hold %s values\n", EXPR_TYPE_STRINGS[val->type]);
+		MML_outbuf_putc(&state->out, '\n');
+		return;
+	}
+
+	// a vector of vectors is a table, one row per vector
+	if (val->v.n == 0 || MML_vec_elem(state, &val->v, 0).type != Vector_type)
+	{
+		print_csv_row(state, &val->v);
+		return;
+	}
+	for (size_t i = 0; i < val->v.n; ++i)
+	{
+		const MML_value row = MML_vec_elem(state, &val->v, i);
+		if (row.type == Vector_type)
+			print_csv_row(state, &row.v);
+		else
+			MML_log_warn("CSV output can't mix vectors and %s values\n", EXPR_TYPE_STRINGS[row.type]);
+	}
+}
+
+static void print_json_number(MML_outbuf *out, double x)
+{
+	if (isfinite(x))
+		print_shortest(out, x);
+	else
+		MML_outbuf_write(out, "null", 4);
+}
+
+static void print_json(MML_state *state, const MML_value *val)
+{
+	MML_outbuf *out = &state->out;
+	switch (val->type) {
+	case Integer_type:
+		MML_outbuf_printf(out, "%" PRIi64, val->i);
+		break;
+	case RealNumber_type:
+		print_json_number(out, val->n);
+		break;
+	case ComplexNumber_type:
+		MML_outbuf_write(out, "{\"re\":", 6);
+		print_json_number(out, creal(val->cn));
+		MML_outbuf_write(out, ",\"im\":", 6);
+		print_json_number(out, cimag(val->cn));
+		MML_outbuf_putc(out, '}');
+		break;
+	case Boolean_type:
+		if (val->b)
+			MML_outbuf_write(out, "true", 4);
+		else
+			MML_outbuf_write(out, "false", 5);
+		break;
+	case Identifier_type:
+		// identifiers are letters, digits and underscores; nothing to escape
+		MML_outbuf_putc(out, '"');
+		MML_outbuf_write(out, val->s.s, val->s.len);
+		MML_outbuf_putc(out, '"');
+		break;
+	case Vector_type:
+		MML_outbuf_putc(out, '[');
+		for (size_t i = 0; i < val->v.n; ++i)
+		{
+			const MML_value elem = MML_vec_elem(state, &val->v, i);
+			if (i != 0)
+				MML_outbuf_putc(out, ',');
+			print_json(state, &elem);
+		}
+		MML_outbuf_putc(out, ']');
+		break;
+	default:
+		MML_outbuf_write(out, "null", 4);
+		break;
+	}
+}
+
 MML_value MML_print_typedval(MML_state *state, const MML_value *val)
 {
+	MML_outbuf *out = &state->out;
 	if (val == nullptr)
 	{
-		printf("(null)");
+		MML_outbuf_write(out, "(null)", 6);
 		return VAL_INVAL;
 	}
+
+	// in the machine-readable formats, every printed value is one record
+	switch (state->config->output_format) {
+	case MML_OUTPUT_TEXT:
+		break;
+	case MML_OUTPUT_BINARY:
+		print_binary(state, val);
+		return (MML_value) { Invalid_type, .n = NAN };
+	case MML_OUTPUT_CSV:
+		print_csv(state, val);
+		return (MML_value) { Invalid_type, .n = NAN };
+	case MML_OUTPUT_JSON:
+		print_json(state, val);
+		MML_outbuf_putc(out, '\n');
+		return (MML_value) { Invalid_type, .n = NAN };
+	}
 	switch (val->type) {
 	case Integer_type:
-		printf("%" PRIi64, val->i);
+		MML_outbuf_printf(out, "%" PRIi64, val->i);
 		break;
 	case RealNumber_type:
-		if (state->config->full_prec_floats)
-			printf("%.*f", state->config->precision, val->n);
-		else
-			printf("%.*g", state->config->precision, val->n);
+		print_number(out, state->config, val->n);
 		break;
 	case ComplexNumber_type:
-		if (state->config->full_prec_floats)
-			printf("%.*f%+.*fi",
-					state->config->precision, creal(val->cn),
-					state->config->precision, cimag(val->cn));
-		else
-			printf("%.*g%+.*gi",
-					state->config->precision, creal(val->cn),
-					state->config->precision, cimag(val->cn));
+		print_number(out, state->config, creal(val->cn));
+		// like "%+": a negative imaginary part brings its own sign
+		if (!signbit(cimag(val->cn)))
+			MML_outbuf_putc(out, '+');
+		print_number(out, state->config, cimag(val->cn));
+		MML_outbuf_putc(out, 'i');
 		break;
 	case Boolean_type:
-		if (FLAG_IS_SET(BOOLS_PRINT_NUM))
-		{
-			if (state->config->full_prec_floats)
-				printf("%.*f",
-						state->config->precision, (val->b) ? 1.0 : 0.0);
-			else
-				printf("%.*g",
-						state->config->precision, (val->b) ? 1.0 : 0.0);
-		} else
-			printf("%s", (val->b) ? "true" : "false");
+		if (CFLAG_IS_SET(state->config, BOOLS_PRINT_NUM))
+			print_number(out, state->config, (val->b) ? 1.0 : 0.0);
+		else if (val->b)
+			MML_outbuf_write(out, "true", 4);
+		else
+			MML_outbuf_write(out, "false", 5);
 		break;
 	case Identifier_type:
-		printf("%.*s", (int)val->s.len, val->s.s);
+		MML_outbuf_write(out, val->s.s, val->s.len);
 		break;
 	case Vector_type:
-		fputc('[', stdout);
+		MML_outbuf_putc(out, '[');
 		MML_value cur_val;
 		for (size_t i = 0; i < val->v.n; ++i)
 		{
-			cur_val = MML_eval_expr(state, val->v.ptr[i]);
+			cur_val = MML_vec_elem(state, &val->v, i);
 			MML_print_typedval(state, &cur_val);
 			if (i < val->v.n-1)
-				fputs(", ", stdout);
+				MML_outbuf_write(out, ", ", 2);
 		}
-		fputc(']', stdout);
+		MML_outbuf_putc(out, ']');
 		break;
 	default:
-		printf("(null)");
+		MML_outbuf_write(out, "(null)", 6);
 		break;
 	}
 
@@ -82,7 +356,8 @@ MML_value MML_print_typedval(MML_state *state, const MML_value *val)
 inline MML_value MML_println_typedval(MML_state *state, const MML_value *val)
 {
 	MML_value ret = MML_print_typedval(state, val);
-	fputc('\n', stdout);
+	if (state->config->output_format == MML_OUTPUT_TEXT)
+		MML_outbuf_putc(&state->out, '\n');
 	state->config->last_print_was_newline = true;
 	return ret;
 }
@@ -92,7 +367,8 @@ MML_value MML_print_typedval_multiargs(MML_state *state, MML_expr_vec *args)
 	{
 		MML_value cur_val = MML_eval_expr(state, args->ptr[i]);
 		MML_print_typedval(state, &cur_val);
-		if (i < args->n-1) fputc(' ', stdout);
+		if (i < args->n-1 && state->config->output_format == MML_OUTPUT_TEXT)
+			MML_outbuf_putc(&state->out, ' ');
 	}
 
 	return (MML_value) { Invalid_type, .n = NAN };
@@ -104,79 +380,87 @@ MML_value MML_println_typedval_multiargs(MML_state *state, MML_expr_vec *args)
 		MML_value cur_val = MML_eval_expr(state, args->ptr[i]);
 		MML_println_typedval(state, &cur_val);
 	}
-	if (args->n == 0)
-		fputc('\n', stdout);
+	if (args->n == 0 && state->config->output_format == MML_OUTPUT_TEXT)
+		MML_outbuf_putc(&state->out, '\n');
 
 	return (MML_value) { Invalid_type, .n = NAN };
 }
 
-void MML_print_expr(struct MML_config *config, const MML_expr *expr, uint32_t indent)
+void MML_print_expr(FILE *out, struct MML_config *config, const MML_expr *expr, uint32_t indent)
 {
-	MML_print_indent(indent);
+	fprint_indent(out, indent);
 	if (expr == nullptr)
 	{
-		printf("(null)\n");
+		fprintf(out, "(null)\n");
 		return;
 	}
 	switch (expr->type) {
 	case Operation_type:
-		printf("Operation(%s):\n", TOK_STRINGS[expr->o.op]);
-		MML_print_indent(indent+2);
+		fprintf(out, "Operation(%s):\n", TOK_STRINGS[expr->o.op]);
+		fprint_indent(out, indent+2);
 
-		printf("Left:\n");
-		MML_print_expr(config, expr->o.left, indent+4);
+		fprintf(out, "Left:\n");
+		MML_print_expr(out, config, expr->o.left, indent+4);
 		if (expr->o.right)
 		{
-			fputc('\n', stdout);
-			MML_print_indent(indent+2);
-			printf("Right:\n");
-			MML_print_expr(config, expr->o.right, indent+4);
+			fputc('\n', out);
+			fprint_indent(out, indent+2);
+			fprintf(out, "Right:\n");
+			MML_print_expr(out, config, expr->o.right, indent+4);
 		}
 		break;
 	case Integer_type:
-		printf("Integer(%" PRIi64 ")", expr->i);
+		fprintf(out, "Integer(%" PRIi64 ")", expr->i);
 		break;
 	case RealNumber_type:
 		if (config->full_prec_floats)
-			printf("RealNumber(%.*f)", config->precision, expr->n);
+			fprintf(out, "RealNumber(%.*f)", config->precision, expr->n);
 		else
-			printf("RealNumber(%.*g)", config->precision, expr->n);
+			fprintf(out, "RealNumber(%.*g)", config->precision, expr->n);
 		break;
 	case ComplexNumber_type:
 		if (config->full_prec_floats)
-			printf("ComplexNumber(%.*g%+.*gi)",
+			fprintf(out, "ComplexNumber(%.*g%+.*gi)",
 					config->precision, creal(expr->cn),
 					config->precision, cimag(expr->cn));
 		else
-			printf("ComplexNumber(%.*g%+.*gi)",
+			fprintf(out, "ComplexNumber(%.*g%+.*gi)",
 					config->precision, creal(expr->cn),
 					config->precision, cimag(expr->cn));
 		break;
 	case Boolean_type:
-		if (FLAG_IS_SET(BOOLS_PRINT_NUM))
+		if (CFLAG_IS_SET(config, BOOLS_PRINT_NUM))
 		{
 			if (config->full_prec_floats)
-				printf("Boolean(%.*f)",
+				fprintf(out, "Boolean(%.*f)",
 						config->precision, (expr->b) ? 1.0 : 0.0);
 			else
-				printf("Boolean(%.*g)",
+				fprintf(out, "Boolean(%.*g)",
 						config->precision, (expr->b) ? 1.0 : 0.0);
 		} else
-			printf("Boolean(%s)", (expr->b) ? "true" : "false");
+			fprintf(out, "Boolean(%s)", (expr->b) ? "true" : "false");
 		break;
 	case Identifier_type:
-		printf("Identifier('%.*s')", (int)expr->s.len, expr->s.s);
+		fprintf(out, "Identifier('%.*s')", (int)expr->s.len, expr->s.s);
+		break;
+	case Slot_type:
+		fprintf(out, "Slot(%.*g)", config->precision, **expr->slot);
 		break;
 	case Vector_type:
-		printf("Vector(n=%zu):\n", expr->v.n);
+		fprintf(out, "Vector(n=%zu):\n", expr->v.n);
 		for (size_t i = 0; i < expr->v.n; ++i)
 		{
-			MML_print_expr(config, expr->v.ptr[i], indent+2);
-			if (i < expr->v.n - 1) fputc('\n', stdout);
+			if (expr->v.packed != NULL)
+			{
+				const MML_expr elem = EXPR_NUM(expr->v.packed[i]);
+				MML_print_expr(out, config, &elem, indent+2);
+			} else
+				MML_print_expr(out, config, expr->v.ptr[i], indent+2);
+			if (i < expr->v.n - 1) fputc('\n', out);
 		}
 		break;
 	default:
-		printf("Invalid()");
+		fprintf(out, "Invalid()");
 		break;
 	}
 
@@ -185,14 +469,16 @@ void MML_print_expr(struct MML_config *config, const MML_expr *expr, uint32_t in
 
 inline void MML_print_exprh(const MML_expr *expr)
 {
-	MML_print_expr(&MML_global_config, expr, 0);
+	MML_print_expr(stdout, &MML_global_config, expr, 0);
 	fputc('\n', stdout);
 	MML_global_config.last_print_was_newline = true;
 }
 inline MML_value MML_print_exprh_tv_func(MML_state *state, MML_expr_vec *args)
 {
-	MML_print_expr(state->config, args->ptr[0], 0);
-	fputc('\n', stdout);
+	// the tree is printed straight to the sink, after what's buffered
+	MML_outbuf_flush(&state->out);
+	MML_print_expr(state->out.sink, state->config, args->ptr[0], 0);
+	fputc('\n', state->out.sink);
 	state->config->last_print_was_newline = true;
 
 	return VAL_INVAL;
@@ -0,0 +1,263 @@
+#include "mml/lexer.h"
+
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "mml/config.h"
+#include "mml/number.h"
+#include "mml/parser.h"
+
+enum char_class {
+	CC_SPACE = 1 << 0,	// what `isspace` matches in the C locale
+	CC_DIGIT = 1 << 1,
+	CC_IDENT = 1 << 2,	// letters, digits and '_'
+};
+
+// the classes of each byte, which unlike <ctype.h> don't depend on the locale
+static const uint8_t CHAR_CLASS[256] = {
+	['\t' ... '\r'] = CC_SPACE,
+	[' '] = CC_SPACE,
+	['0' ... '9'] = CC_DIGIT | CC_IDENT,
+	['A' ... 'Z'] = CC_IDENT,
+	['a' ... 'z'] = CC_IDENT,
+	['_'] = CC_IDENT,
+};
+
+#if defined(__SSE2__)
+// unsigned lo <= x <= hi is min(x - lo, hi - lo) == x - lo
+static inline __m128i in_range(__m128i x, char lo, char hi)
+{
+	const __m128i d = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+	return _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(hi - lo)), d);
+}
+
+static inline __m128i class_mask(__m128i x, enum char_class cls)
+{
+	switch (cls) {
+	case CC_SPACE:
+		return _mm_or_si128(in_range(x, '\t', '\r'), _mm_cmpeq_epi8(x, _mm_set1_epi8(' ')));
+	case CC_DIGIT:
+		return in_range(x, '0', '9');
+	default:
+		// setting bit 5 maps upper case letters onto lower case ones
+		return _mm_or_si128(
+				_mm_or_si128(in_range(x, '0', '9'),
+					in_range(_mm_or_si128(x, _mm_set1_epi8(0x20)), 'a', 'z')),
+				_mm_cmpeq_epi8(x, _mm_set1_epi8('_')));
+	}
+}
+#elif defined(__ARM_NEON)
+static inline uint8x16_t in_range(uint8x16_t x, char lo, char hi)
+{
+	return vcleq_u8(vsubq_u8(x, vdupq_n_u8(lo)), vdupq_n_u8(hi - lo));
+}
+
+static inline uint8x16_t class_mask(uint8x16_t x, enum char_class cls)
+{
+	switch (cls) {
+	case CC_SPACE:
+		return vorrq_u8(in_range(x, '\t', '\r'), vceqq_u8(x, vdupq_n_u8(' ')));
+	case CC_DIGIT:
+		return in_range(x, '0', '9');
+	default:
+		return vorrq_u8(
+				vorrq_u8(in_range(x, '0', '9'),
+					in_range(vorrq_u8(x, vdupq_n_u8(0x20)), 'a', 'z')),
+				vceqq_u8(x, vdupq_n_u8('_')));
+	}
+}
+#endif
+
+/* Returns the first byte from S on that isn't in CLS. The NUL ending the
+ * text is in no class, so the run always ends there at the latest. Runs are
+ * usually a byte or two, so S is walked with the table up to a 16-byte
+ * boundary; past it, aligned 16-byte loads can't cross into an unmapped page
+ * even if they read beyond the NUL. */
+static inline const char *skip_class(const char *s, enum char_class cls)
+{
+	while (((uintptr_t)s & 15) != 0)
+	{
+		if (!(CHAR_CLASS[(unsigned char)*s] & cls))
+			return s;
+		++s;
+	}
+#if defined(__SSE2__)
+	for (;; s += 16)
+	{
+		const __m128i x = _mm_load_si128((const __m128i *)s);
+		const uint32_t mask = ~_mm_movemask_epi8(class_mask(x, cls)) & 0xffff;
+		if (mask != 0)
+			return s + __builtin_ctz(mask);
+	}
+#elif defined(__ARM_NEON)
+	for (;; s += 16)
+	{
+		const uint8x16_t x = vld1q_u8((const uint8_t *)s);
+		// narrow to 4 bits per byte to get a scalar mask
+		const uint64_t mask = ~vget_lane_u64(vreinterpret_u64_u8(
+					vshrn_n_u16(vreinterpretq_u16_u8(class_mask(x, cls)), 4)), 0);
+		if (mask != 0)
+			return s + (__builtin_ctzll(mask) >> 2);
+	}
+#else
+	while (CHAR_CLASS[(unsigned char)*s] & cls)
+		++s;
+	return s;
+#endif
+}
+
+// Returns the end of the number starting with the digit at S.
+static const char *number_end(const char *s)
+{
+	const char *end = skip_class(s, CC_DIGIT);
+	if (*end == '.')
+		end = skip_class(end + 1, CC_DIGIT);
+	// an exponent needs its digits, so `2e` and `2e-x` are still 2 times `e`
+	if (*end == 'e' || *end == 'E')
+	{
+		const char *exp = end + 1;
+		if (*exp == '+' || *exp == '-')
+			++exp;
+		if (CHAR_CLASS[(unsigned char)*exp] & CC_DIGIT)
+			end = skip_class(exp, CC_DIGIT);
+	}
+	return end;
+}
+
+size_t MML_lex(const char **sp, const char *end, MML_token_type prev,
+		MML_token *out, size_t n)
+{
+	const char *s = *sp;
+	size_t n_toks = 0;
+	while (n_toks < n)
+	{
+		s = skip_class(s, CC_SPACE);
+		if (end != NULL && s >= end)
+		{
+			out[n_toks++] = nToken(MML_EOF_TOK, end, 0);
+			*sp = end;
+			return n_toks;
+		}
+
+		MML_token tok;
+		const MML_token_type type = TOK_BY_CHAR[(unsigned char)*s];
+		switch (type) {
+		case MML_EOF_TOK:
+			out[n_toks++] = nToken(MML_EOF_TOK, s, 0);
+			*sp = s;
+			return n_toks;
+		case MML_OP_DOT_TOK:
+		case MML_OP_AT_TOK:
+		case MML_OP_POW_TOK:
+		case MML_OP_MUL_TOK:
+		case MML_OP_DIV_TOK:
+		case MML_OP_MOD_TOK:
+		case MML_OP_ADD_TOK:
+		case MML_OP_SUB_TOK:
+		case MML_OPEN_PAREN_TOK:
+		case MML_CLOSE_PAREN_TOK:
+		case MML_OPEN_BRAC_TOK:
+		case MML_CLOSE_BRAC_TOK:
+		case MML_OPEN_BRACKET_TOK:
+		case MML_CLOSE_BRACKET_TOK:
+		case MML_COMMA_TOK:
+		case MML_PIPE_TOK:
+		case MML_SEMICOLON_TOK:
+		case MML_TILDE_TOK:
+			tok = nToken(type, s, 1);
+			break;
+		case MML_OP_LESS_TOK:
+			tok = (s[1] == '=')
+				? nToken(MML_OP_LESSEQ_TOK, s, 2)
+				: nToken(MML_OP_LESS_TOK, s, 1);
+			break;
+		case MML_OP_GREATER_TOK:
+			tok = (s[1] == '=')
+				? nToken(MML_OP_GREATEREQ_TOK, s, 2)
+				: nToken(MML_OP_GREATER_TOK, s, 1);
+			break;
+		case MML_OP_EQ_TOK:
+			if (s[1] != '=')
+				tok = nToken(MML_OP_ASSERT_EQUAL, s, 1);
+			else if (s[2] != '=')
+				tok = nToken(MML_OP_EQ_TOK, s, 2);
+			else
+				tok = nToken(MML_OP_EXACT_EQ, s, 3);
+			break;
+		case MML_OP_NOT_TOK:
+			if (s[1] != '=')
+				tok = nToken(MML_OP_NOT_TOK, s, 1);
+			else if (s[2] != '=')
+				tok = nToken(MML_OP_NOTEQ_TOK, s, 2);
+			else
+				tok = nToken(MML_OP_EXACT_NOTEQ, s, 3);
+			break;
+		case MML_DIGIT_TOK: {
+			const char *num_end = (prev != MML_OP_DOT_TOK)
+				? number_end(s)
+				: skip_class(s, CC_DIGIT);
+			tok = nToken(MML_NUMBER_TOK, s, num_end - s);
+			break;
+		}
+		case MML_LETTER_TOK:
+		case MML_UNDERSCORE_TOK:
+			tok = nToken(MML_IDENT_TOK, s, skip_class(s + 1, CC_IDENT) - s);
+			break;
+		default:
+			tok = nToken(MML_INVALID_TOK, s, 1);
+			break;
+		}
+
+		out[n_toks++] = tok;
+		s += tok.buf.len;
+		prev = tok.type;
+	}
+	*sp = s;
+	return n_toks;
+}
+
+size_t MML_lex_numbers(const char **sp, const char *end, double *out, size_t n,
+		bool *closed)
+{
+	const char *s = *sp;
+	size_t n_nums = 0;
+	*closed = false;
+	while (n_nums < n)
+	{
+		const char *p = skip_class(s, CC_SPACE);
+		// `[1, 2,]` ends like `[1, 2]`
+		if (*p == ']' && n_nums != 0 && (end == NULL || p < end))
+		{
+			s = p + 1;
+			*closed = true;
+			break;
+		}
+		const bool neg = *p == '-';
+		if (neg)
+			p = skip_class(p + 1, CC_SPACE);
+		if (!(CHAR_CLASS[(unsigned char)*p] & CC_DIGIT))
+			break;
+		const char *num = p;
+		p = number_end(num);
+		const char *sep = skip_class(p, CC_SPACE);
+		if ((*sep != ',' && *sep != ']') || (end != NULL && sep >= end))
+			break;
+
+		double x = 0.0;
+		MML_parse_double(num, p, &x);
+		out[n_nums++] = neg ? -x : x;
+		s = sep + 1;
+		if (*sep == ']')
+		{
+			*closed = true;
+			break;
+		}
+	}
+	*sp = s;
+	return n_nums;
+}
@@ -2,13 +2,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
+#include <string.h>
 #include <inttypes.h>
 
+#include "mml/cache.h"
 #include "mml/eval.h"
 #include "mml/expr.h"
 #include "mml/parser.h"
 #include "mml/config.h"
+#include "mml/number.h"
 #include "mml/prompt.h"
+#include "mml/records.h"
+#include "mml/server.h"
+#include "mml/snapshot.h"
+#include "mml/stream.h"
+#include "mml/trace.h"
 #include "cvi/dvec/dvec.h"
 
 extern strbuf expression;
@@ -21,6 +29,27 @@ void sig_handler(int32_t signum)
 	exit(2);
 }
 
+// Splits the comma-separated NAMES in place into a NULL-terminated list.
+static char **split_names(char *names)
+{
+	size_t n = 1;
+	for (const char *c = names; *c; ++c)
+		n += (*c == ',');
+
+	char **ret = malloc((n + 1) * sizeof(char *));
+	if (ret == NULL)
+		return NULL;
+	ret[0] = names;
+	for (size_t i = 1; i < n; ++i)
+	{
+		names = strchr(names, ',');
+		*names++ = '\0';
+		ret[i] = names;
+	}
+	ret[n] = NULL;
+	return ret;
+}
+
 #define print_vec(p, n, fmt) { \
 fputc('[', stdout); \
 for (size_t i = 0; i < (n); ++i) \
@@ -32,10 +61,31 @@ int32_t main(int32_t argc, char **argv)
 	signal(SIGINT, sig_handler);
 	signal(SIGTERM, sig_handler);
 	signal(SIGQUIT, sig_handler);
+	MML_trace_dump_on_signal(SIGUSR1);
 
 	MML_global_config.eval_state = MML_init_state();
 	MML_arg_parse(argc, argv);
 
+	if (MML_global_config.read_vec_name != nullptr)
+	{
+		const strbuf name = {
+			MML_global_config.read_vec_name,
+			strlen(MML_global_config.read_vec_name)
+		};
+		if (MML_read_vector(MML_global_config.eval_state, name, stdin) != 0)
+		{
+			MML_cleanup_state(MML_global_config.eval_state);
+			return 1;
+		}
+	}
+
+	if (MML_global_config.serve_path != nullptr)
+	{
+		const int32_t ret = MML_serve(MML_global_config.serve_path);
+		MML_cleanup_state(MML_global_config.eval_state);
+		return (ret == 0) ? 0 : 1;
+	}
+
 	if (FLAG_IS_SET(RUN_PROMPT))
 	{
 		MML_run_prompt(MML_global_config.eval_state);
@@ -44,30 +94,119 @@ int32_t main(int32_t argc, char **argv)
 	}
 
 	if (FLAG_IS_SET(READ_STDIN))
-		expression = MML_read_string_from_stream(stdin);
+	{
+		// statements are evaluated as they are read, so stdin is never
+		// held in memory all at once
+		MML_stmt_reader *reader = MML_stmt_reader_open(stdin);
+		if (reader == NULL)
+		{
+			MML_log_err("failed to allocate stdin reader\n");
+			MML_cleanup_state(MML_global_config.eval_state);
+			return 1;
+		}
+
+		MML_expr *expr;
+		MML_value val = VAL_INVAL;
+		while (MML_stmt_reader_next(reader, &expr))
+			if (!FLAG_IS_SET(NO_EVAL))
+				val = MML_eval_expr(MML_global_config.eval_state, expr);
+		MML_stmt_reader_close(reader);
+
+		if (!FLAG_IS_SET(NO_EVAL) && FLAG_IS_SET(PRINT))
+			MML_print_typedval(MML_global_config.eval_state, &val);
+
+		MML_cleanup_state(MML_global_config.eval_state);
+		return 0;
+	}
+
+	// a mapped script stays mapped until the end, so its identifiers don't
+	// need to be copied
+	strbuf script = { NULL, 0 };
+	if (MML_global_config.script_path != nullptr)
+	{
+		script = MML_map_file(MML_global_config.script_path);
+		if (script.s == NULL)
+		{
+			MML_cleanup_state(MML_global_config.eval_state);
+			return 1;
+		}
+	}
+
+	if (MML_global_config.record_inputs != nullptr)
+	{
+		const char *src = (script.s != NULL) ? script.s : expression.s;
+		char **names __attribute__((cleanup(MML_free_pp)))
+			= split_names(MML_global_config.record_inputs);
+		const int32_t ret = (src != NULL && names != NULL)
+			? MML_stream_records(MML_global_config.eval_state, src,
+					(const char *const *)names, stdin)
+			: -1;
+		MML_cleanup_state(MML_global_config.eval_state);
+		MML_unmap_file(script);
+		return (ret == 0) ? 0 : 1;
+	}
 
 	//Expr *expr = parse(expression.s);
 	//eval_push_expr(&eval_state, expr);
-	MML_expr_dvec exprs = MML_parse_stmts(expression.s);
+	MML_expr_dvec exprs = (script.s != NULL)
+		? MML_parse_stmts_parallel(MML_global_arena, script.s, true, MML_global_config.reduce.threads)
+		: MML_parse_stmts(expression.s);
+
+	// with a cache, a run that was already done only replays its output; a
+	// replay doesn't set variables, so runs that save a snapshot don't use it
+	MML_cache *cache = (MML_global_config.cache_dir != nullptr && !FLAG_IS_SET(NO_EVAL)
+			&& MML_global_config.snapshot_out == nullptr)
+		? MML_cache_open(MML_global_config.cache_dir)
+		: NULL;
+	MML_cache_key cache_key;
+	if (cache != NULL && !MML_cache_key_make(MML_global_config.eval_state,
+				(const MML_expr *const *)_dv_ptr(exprs), dv_n(exprs), &cache_key))
+	{
+		MML_cache_close(cache);
+		cache = NULL;
+	}
+	bool replayed = false;
+	if (cache != NULL)
+	{
+		replayed = MML_cache_replay(cache, cache_key, stdout);
+		if (!replayed)
+			MML_cache_capture(cache, MML_global_config.eval_state);
+	}
 
-	if (!FLAG_IS_SET(NO_EVAL))
+	if (!FLAG_IS_SET(NO_EVAL) && !replayed)
 	{
+		const uint64_t n_problems = MML_global_config.n_problems_logged;
+		bool aborted = false;
 		MML_expr **cur;
 		dv_foreach(exprs, cur)
 		{
 			MML_value val = MML_eval_expr(
 					MML_global_config.eval_state,
 					*cur);
+			aborted |= VAL_IS_ABORT(val);
 
 			if ((size_t)(cur - _dv_ptr(exprs)) == dv_n(exprs)-1 && FLAG_IS_SET(PRINT))
 				MML_print_typedval(MML_global_config.eval_state, &val);
 		}
+
+		// a run cut short by a limit isn't the result of the expression, and
+		// a replay couldn't repeat the errors or warnings a run logged
+		if (cache != NULL)
+			MML_cache_commit(cache, MML_global_config.eval_state, cache_key,
+					!aborted && MML_global_config.n_problems_logged == n_problems);
 	}
+	MML_cache_close(cache);
+
+	int32_t ret = 0;
+	if (MML_global_config.snapshot_out != nullptr
+	 && MML_save_snapshot(MML_global_config.eval_state, MML_global_config.snapshot_out) != 0)
+		ret = 1;
 	dv_destroy(exprs);
 
 	//if (expression.allocd)
 	//	free(expression.s);
 	MML_cleanup_state(MML_global_config.eval_state);
+	MML_unmap_file(script);
 
-	return 0;
+	return ret;
 }
@@ -0,0 +1,244 @@
+#include "mml/memo.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mml/builtins.h"
+#include "mml/config.h"
+#include "mml/eval.h"
+#include "mml/parser.h"
+#include "arena/arena.h"
+#include "c-hashmap/map.h"
+
+struct memo_var {
+	strbuf name;	// the key it is stored under
+	MML_value value;
+	bool has_value;
+	bool defined;	// has been passed to `MML_memo_define`, not only read
+	// false if its expression, or one it reads (directly or not), can't be kept
+	bool cacheable;
+	// the variables whose expressions read this one (name -> unused)
+	hashmap *dependents;
+	uint64_t visited;	// the last `MML_memo_define` that reached it
+};
+
+struct MML_memo {
+	hashmap *vars;	// name -> `struct memo_var *`
+	uint64_t n_defines;
+};
+
+struct name_stack {
+	strbuf *p;
+	size_t n, cap;
+	bool failed;
+};
+
+static void push_name(struct name_stack *stack, strbuf name)
+{
+	if (stack->n == stack->cap)
+	{
+		const size_t cap = (stack->cap != 0) ? stack->cap * 2 : 16;
+		strbuf *p = realloc(stack->p, cap * sizeof(*p));
+		if (p == NULL)
+		{
+			stack->failed = true;
+			return;
+		}
+		stack->p = p;
+		stack->cap = cap;
+	}
+	stack->p[stack->n++] = name;
+}
+
+MML_memo *MML_memo_make(void)
+{
+	MML_memo *m = calloc(1, sizeof(*m));
+	if (m == NULL || (m->vars = hashmap_create()) == NULL)
+	{
+		free(m);
+		return NULL;
+	}
+	return m;
+}
+
+static int32_t free_var(const void *, size_t, uintptr_t value, void *)
+{
+	struct memo_var *var = (struct memo_var *)value;
+	if (var->dependents != NULL)
+		hashmap_free(var->dependents);
+	free(var);
+	return 0;
+}
+
+void MML_memo_free(MML_memo *m)
+{
+	if (m == NULL)
+		return;
+	hashmap_iterate(m->vars, free_var, NULL);
+	hashmap_free(m->vars);
+	free(m);
+}
+
+static struct memo_var *get_var(MML_memo *m, strbuf name, bool create)
+{
+	struct memo_var *var;
+	if (hashmap_get(m->vars, name.s, name.len, (uintptr_t *)&var))
+		return var;
+	if (!create || (var = calloc(1, sizeof(*var))) == NULL)
+		return NULL;
+	// the map keeps the key's address, like `MML_eval_set_variable`'s
+	char *key_copy = arena_alloc_T(MML_global_arena, name.len, char);
+	memcpy(key_copy, name.s, name.len);
+	if (hashmap_set(m->vars, key_copy, name.len, (uintptr_t)var) < 0)
+	{
+		free(var);
+		return NULL;
+	}
+	var->name = (strbuf) { key_copy, name.len };
+	return var;
+}
+
+// builtins that print or change the configuration (see `MML_native`)
+static bool is_impure_func(strbuf name)
+{
+	const MML_builtin *builtin = MML_builtin_get(name);
+	return builtin != NULL && builtin->fn.impure;
+}
+
+struct reads {
+	struct name_stack *names;
+	bool cacheable;
+};
+
+static bool collect_read(const MML_expr *expr, const MML_expr *parent, void *usr)
+{
+	struct reads *reads = usr;
+	if (expr == NULL)
+		return true;
+
+	switch (expr->type) {
+	case Identifier_type:
+		// the name of a called function isn't a variable
+		if (parent != NULL && parent->type == Operation_type
+		 && parent->o.op == MML_OP_FUNC_CALL_TOK && parent->o.left == expr)
+		{
+			if (is_impure_func(expr->s))
+				reads->cacheable = false;
+			break;
+		}
+		if (expr->s.len == 3 && memcmp(expr->s.s, "ans", 3) == 0)
+			reads->cacheable = false;
+		push_name(reads->names, expr->s);
+		break;
+	case Operation_type:
+		if (expr->o.op == MML_OP_ASSERT_EQUAL)
+			reads->cacheable = false;
+		break;
+	case Slot_type:
+		// set by the host between evaluations
+		reads->cacheable = false;
+		break;
+	default:
+		break;
+	}
+	return true;
+}
+
+// Pushes the names EXPR reads to *NAMES, and returns whether its value can
+// be kept.
+static bool collect_reads(const MML_expr *expr, struct name_stack *names)
+{
+	struct reads reads = { names, true };
+	const bool walked = MML_expr_walk(expr, collect_read, &reads);
+	return reads.cacheable && walked && !names->failed;
+}
+
+static int32_t push_dependent(const void *name, size_t name_len, uintptr_t, void *usr)
+{
+	push_name(usr, (strbuf) { (char *)name, name_len });
+	return 0;
+}
+
+void MML_memo_define(MML_memo *m, strbuf name, const MML_expr *expr)
+{
+	struct memo_var *var = get_var(m, name, true);
+	if (var == NULL)
+	{
+		// without a record the old value can't be found to be dropped
+		MML_memo_clear(m);
+		return;
+	}
+	var->defined = true;
+
+	struct name_stack stack = { NULL, 0, 0, false };
+	var->cacheable = collect_reads(expr, &stack);
+	for (size_t i = 0; i < stack.n; ++i)
+	{
+		struct memo_var *read = get_var(m, stack.p[i], true);
+		if (read == NULL
+		 || (read->dependents == NULL && (read->dependents = hashmap_create()) == NULL)
+		 || hashmap_set(read->dependents, var->name.s, var->name.len, 0) < 0)
+		{
+			// an edge that isn't recorded would leave a stale value
+			var->cacheable = false;
+			break;
+		}
+		// the value of a read that isn't kept may change, e.g. by printing
+		if (read->defined && !read->cacheable)
+			var->cacheable = false;
+	}
+
+	// forget NAME and everything that reads it, which can't be kept either
+	// if NAME can't; old edges are kept, so a variable that stopped reading
+	// NAME is only forgotten (or not kept) needlessly
+	const bool cacheable = var->cacheable;
+	const uint64_t visit = ++m->n_defines;
+	stack.n = 0;
+	push_name(&stack, name);
+	while (stack.n != 0 && !stack.failed)
+	{
+		struct memo_var *cur = get_var(m, stack.p[--stack.n], false);
+		if (cur == NULL || cur->visited == visit)
+			continue;
+		cur->visited = visit;
+		cur->has_value = false;
+		cur->cacheable &= cacheable;
+		if (cur->dependents != NULL)
+			hashmap_iterate(cur->dependents, push_dependent, &stack);
+	}
+	if (stack.failed)
+		MML_memo_clear(m);
+	free(stack.p);
+}
+
+bool MML_memo_get(MML_memo *m, strbuf name, MML_value *out)
+{
+	const struct memo_var *var = get_var(m, name, false);
+	if (var == NULL || !var->has_value)
+		return false;
+	*out = var->value;
+	return true;
+}
+
+void MML_memo_put(MML_memo *m, strbuf name, MML_value val)
+{
+	if (val.type == Invalid_type)
+		return;
+	struct memo_var *var = get_var(m, name, false);
+	if (var != NULL && var->cacheable)
+	{
+		var->value = val;
+		var->has_value = true;
+	}
+}
+
+static int32_t forget_value(const void *, size_t, uintptr_t value, void *)
+{
+	((struct memo_var *)value)->has_value = false;
+	return 0;
+}
+
+void MML_memo_clear(MML_memo *m)
+{
+	hashmap_iterate(m->vars, forget_value, NULL);
+}
@@ -0,0 +1,418 @@
+// mremap
+#define _GNU_SOURCE
+#include "mml/number.h"
+
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "mml/config.h"
+#include "mml/eval.h"
+#include "cvi/dvec/dvec.h"
+
+#include "number_tables_incl.c"
+
+#define READ_CHUNK (1u << 20)
+
+// the powers of ten that are exact doubles
+static const double exact_pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+#define MAX_EXACT_POW10 22
+#define MAX_EXACT_MANT (1ull << 53)
+
+static inline bool is_digit(char c)
+{
+	return (uint8_t)(c - '0') < 10;
+}
+
+static inline bool is_delim(char c)
+{
+	return (uint8_t)c <= ' ' || c == ',' || c == ';';
+}
+
+// `strtod` on a copy of [S, END), which isn't NUL-terminated
+static bool parse_double_slow(const char *s, const char *end, double *out)
+{
+	const size_t len = end - s;
+	char small[64];
+	char *buf __attribute__((cleanup(MML_free_pp)))
+		= (len < sizeof(small)) ? NULL : malloc(len + 1);
+	char *copy = (len < sizeof(small)) ? small : buf;
+	if (copy == NULL)
+		return false;
+	memcpy(copy, s, len);
+	copy[len] = '\0';
+
+	char *parsed_end;
+	*out = strtod(copy, &parsed_end);
+	return len != 0 && parsed_end == copy + len;
+}
+
+/* The Eisel-Lemire algorithm: rounds W * 10^EXP10 (W != 0) to the nearest
+ * double, or returns false in the rare cases where the 128-bit power of five
+ * isn't precise enough to tell which way to round. W * 5^EXP10 is taken from
+ * the high bits of W times the normalized power, and 2^EXP10 only moves the
+ * exponent. */
+static bool eisel_lemire(uint64_t w, int32_t exp10, bool neg, double *out)
+{
+	if (exp10 < POW5_128_MIN_EXP10 || exp10 > POW5_128_MAX_EXP10)
+		return false;
+
+	const int32_t lz = __builtin_clzll(w);
+	w <<= lz;
+	const uint64_t *pow5 = POW5_128[exp10 - POW5_128_MIN_EXP10];
+	unsigned __int128 prod = (unsigned __int128)w * pow5[0];
+	uint64_t hi = prod >> 64, lo = (uint64_t)prod;
+	// below the 55 bits that decide the rounding, all ones could still carry
+	// into them, so the next 64 bits of the power are needed
+	if ((hi & 0x1ff) == 0x1ff)
+	{
+		const uint64_t next = ((unsigned __int128)w * pow5[1]) >> 64;
+		lo += next;
+		hi += (lo < next);
+		if (lo == UINT64_MAX)
+			return false;
+	}
+
+	// the product has its top bit in bit 127 or 126; keep 54 bits of it
+	const uint32_t upper_bit = hi >> 63;
+	uint64_t mant = hi >> (upper_bit + 9);
+	// floor(log2(10^exp10)) + 1 is (217706 * exp10 >> 16) + 1 for |exp10| < 1650
+	int32_t exp2 = ((217706 * exp10) >> 16) + 63 + 1023 + (int32_t)upper_bit - lz;
+
+	if (exp2 <= 0)
+	{
+		// subnormal; exactly halfway can't happen this far from 10^0
+		if (1 - exp2 >= 64)
+		{
+			*out = (neg) ? -0.0 : 0.0;
+			return true;
+		}
+		mant >>= 1 - exp2;
+		mant += mant & 1;
+		mant >>= 1;
+		exp2 = (mant < (1ull << 52)) ? 0 : 1;
+	} else
+	{
+		// W * 10^EXP10 can only be exactly halfway between two doubles for
+		// -4 <= EXP10 <= 23; round it to even rather than up
+		if (lo <= 1 && exp10 >= -4 && exp10 <= 23 && (mant & 3) == 1
+		 && (mant << (upper_bit + 9)) == hi)
+			mant &= ~1ull;
+		mant += mant & 1;
+		mant >>= 1;
+		if (mant >= (1ull << 53))
+		{
+			mant = 1ull << 52;
+			++exp2;
+		}
+		if (exp2 >= 2047)
+			return false;
+	}
+
+	const uint64_t bits = (mant & ((1ull << 52) - 1)) | ((uint64_t)exp2 << 52)
+		| ((uint64_t)neg << 63);
+	memcpy(out, &bits, sizeof(bits));
+	return true;
+}
+
+bool MML_parse_double(const char *s, const char *end, double *out)
+{
+	const char *p = s;
+	const bool neg = (p < end && *p == '-');
+	if (p < end && (*p == '-' || *p == '+'))
+		++p;
+
+	// up to 19 significant digits fit in MANT; after that, only zeros can
+	// be dropped without rounding
+	uint64_t mant = 0;
+	int32_t n_sig = 0;
+	int32_t exp10 = 0;
+	bool any_digits = false;
+	bool truncated = false;
+	for (; p < end && is_digit(*p); ++p)
+	{
+		any_digits = true;
+		if (n_sig < 19)
+		{
+			mant = mant*10 + (*p - '0');
+			n_sig += (mant != 0);
+		} else
+		{
+			++exp10;
+			truncated |= (*p != '0');
+		}
+	}
+	if (p < end && *p == '.')
+	{
+		for (++p; p < end && is_digit(*p); ++p)
+		{
+			any_digits = true;
+			if (n_sig < 19)
+			{
+				mant = mant*10 + (*p - '0');
+				n_sig += (mant != 0);
+				--exp10;
+			} else
+				truncated |= (*p != '0');
+		}
+	}
+	if (!any_digits)
+		return parse_double_slow(s, end, out);
+
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		++p;
+		const bool exp_neg = (p < end && *p == '-');
+		if (p < end && (*p == '-' || *p == '+'))
+			++p;
+		if (p == end || !is_digit(*p))
+			return false;
+		int32_t e = 0;
+		for (; p < end && is_digit(*p); ++p)
+			if (e < 100000)
+				e = e*10 + (*p - '0');
+		exp10 += (exp_neg) ? -e : e;
+	}
+	if (p != end)
+		return parse_double_slow(s, end, out);
+
+#if FLT_EVAL_METHOD == 0
+	// Clinger's fast path: both MANT and the power of ten are exact doubles,
+	// so the one rounding of the product or quotient is the correct one
+	if (!truncated && mant <= MAX_EXACT_MANT)
+	{
+		double x = (double)mant;
+		if (mant == 0 || (exp10 >= 0 && exp10 <= MAX_EXACT_POW10))
+			x *= exact_pow10[(mant == 0) ? 0 : exp10];
+		else if (exp10 < 0 && exp10 >= -MAX_EXACT_POW10)
+			x /= exact_pow10[-exp10];
+		else if (exp10 > MAX_EXACT_POW10 && exp10 <= MAX_EXACT_POW10 + 15
+		      && mant <= MAX_EXACT_MANT / (uint64_t)exact_pow10[exp10 - MAX_EXACT_POW10])
+			// move the extra powers into MANT while it stays exact
+			x = (double)(mant * (uint64_t)exact_pow10[exp10 - MAX_EXACT_POW10])
+				* exact_pow10[MAX_EXACT_POW10];
+		else
+			goto not_exact;
+
+		*out = (neg) ? -x : x;
+		return true;
+	}
+not_exact:
+#endif
+	if (mant == 0)
+	{
+		*out = (neg) ? -0.0 : 0.0;
+		return true;
+	}
+	// with digits dropped, the number is between MANT and MANT+1 times the
+	// power, so either both round the same way or it takes `strtod`
+	double x;
+	if (eisel_lemire(mant, exp10, neg, &x))
+	{
+		double x_up;
+		if (!truncated || (eisel_lemire(mant + 1, exp10, neg, &x_up) && x_up == x))
+		{
+			*out = x;
+			return true;
+		}
+	}
+	return parse_double_slow(s, end, out);
+}
+
+const char *MML_find_delim(const char *s, const char *end)
+{
+#if defined(__SSE2__)
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i comma = _mm_set1_epi8(',');
+	const __m128i semicolon = _mm_set1_epi8(';');
+	for (; end - s >= 16; s += 16)
+	{
+		const __m128i x = _mm_loadu_si128((const __m128i *)s);
+		// unsigned x <= ' ' is min(x, ' ') == x
+		const __m128i m = _mm_or_si128(
+				_mm_cmpeq_epi8(_mm_min_epu8(x, space), x),
+				_mm_or_si128(_mm_cmpeq_epi8(x, comma), _mm_cmpeq_epi8(x, semicolon)));
+		const uint32_t mask = _mm_movemask_epi8(m);
+		if (mask != 0)
+			return s + __builtin_ctz(mask);
+	}
+#elif defined(__ARM_NEON)
+	const uint8x16_t space = vdupq_n_u8(' ');
+	const uint8x16_t comma = vdupq_n_u8(',');
+	const uint8x16_t semicolon = vdupq_n_u8(';');
+	for (; end - s >= 16; s += 16)
+	{
+		const uint8x16_t x = vld1q_u8((const uint8_t *)s);
+		const uint8x16_t m = vorrq_u8(vcleq_u8(x, space),
+				vorrq_u8(vceqq_u8(x, comma), vceqq_u8(x, semicolon)));
+		// narrow to 4 bits per byte to get a scalar mask
+		const uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(
+					vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+		if (mask != 0)
+			return s + (__builtin_ctzll(mask) >> 2);
+	}
+#endif
+	while (s < end && !is_delim(*s))
+		++s;
+	return s;
+}
+
+int64_t MML_parse_doubles(const char *s, const char *end, double *out, size_t n)
+{
+	int64_t count = 0;
+	while (s < end)
+	{
+		if (is_delim(*s))
+		{
+			++s;
+			continue;
+		}
+
+		const char *tok_end = MML_find_delim(s, end);
+		double x;
+		if (!MML_parse_double(s, tok_end, &x))
+			return -1;
+		if ((size_t)count < n)
+			out[count] = x;
+		++count;
+		s = tok_end;
+	}
+	return count;
+}
+
+// The numbers are kept in an anonymous mapping that grows with `mremap`,
+// so they are never copied, and which ends up sized the way
+// `MML_unmap_file` expects.
+struct packed_out {
+	double *vals;
+	size_t n;
+	size_t map_len;
+};
+
+static size_t mapping_len(size_t bytes)
+{
+	const size_t page_size = sysconf(_SC_PAGESIZE);
+	return (bytes / page_size + 1) * page_size;
+}
+
+static bool packed_out_resize(struct packed_out *o, size_t map_len)
+{
+	void *p = (o->vals == NULL)
+		? mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+		: mremap(o->vals, o->map_len, map_len, MREMAP_MAYMOVE);
+	if (p == MAP_FAILED)
+	{
+		MML_log_err("failed to map %zu bytes for a vector\n", map_len);
+		return false;
+	}
+	o->vals = p;
+	o->map_len = map_len;
+	return true;
+}
+
+// Parses every number in [S, END) onto O. Returns false on a malformed one.
+static bool parse_column(struct packed_out *o, const char *s, const char *end)
+{
+	while (s < end)
+	{
+		if (is_delim(*s))
+		{
+			++s;
+			continue;
+		}
+
+		const char *tok_end = MML_find_delim(s, end);
+		if ((o->n + 1) * sizeof(double) > o->map_len
+		 && !packed_out_resize(o, o->map_len * 2))
+			return false;
+		if (!MML_parse_double(s, tok_end, &o->vals[o->n]))
+		{
+			MML_log_err("malformed number '%.*s' at element %zu of vector input\n",
+					(int)(tok_end - s), s, o->n);
+			return false;
+		}
+		++o->n;
+		s = tok_end;
+	}
+	return true;
+}
+
+int32_t MML_read_vector(MML_state *restrict state, strbuf name, FILE *stream)
+{
+	char *buf __attribute__((cleanup(MML_free_pp))) = malloc(READ_CHUNK);
+	size_t cap = READ_CHUNK;
+	size_t len = 0;
+	struct packed_out o = { NULL, 0, 0 };
+	if (buf == NULL || !packed_out_resize(&o, mapping_len(READ_CHUNK)))
+		return -1;
+
+	for (;;)
+	{
+		len += fread(buf + len, 1, cap - len, stream);
+		// `fread` only comes up short at the end of the stream or on an error
+		const bool at_end = (len < cap);
+		if (at_end && ferror(stream))
+		{
+			MML_log_err("failed to read vector input\n");
+			goto fail;
+		}
+		if (at_end)
+		{
+			if (!parse_column(&o, buf, buf + len))
+				goto fail;
+			break;
+		}
+
+		// only parse up to the last delimiter; the number after it may
+		// continue in the next chunk
+		size_t parse_len = len;
+		while (parse_len != 0 && !is_delim(buf[parse_len - 1]))
+			--parse_len;
+		if (parse_len == 0)
+		{
+			// a single number longer than the buffer
+			char *bigger = realloc(buf, cap * 2);
+			if (bigger == NULL)
+				goto fail;
+			buf = bigger;
+			cap *= 2;
+			continue;
+		}
+		if (!parse_column(&o, buf, buf + parse_len))
+			goto fail;
+		memmove(buf, buf + parse_len, len - parse_len);
+		len -= parse_len;
+	}
+
+	const size_t bytes = o.n * sizeof(double);
+	if (!packed_out_resize(&o, mapping_len(bytes)))
+		goto fail;
+	mprotect(o.vals, o.map_len, PROT_READ);
+	madvise(o.vals, bytes, MADV_SEQUENTIAL);
+	dv_push(state->mapped_files, ((strbuf) { (char *)o.vals, bytes }));
+
+	MML_expr *vec = arena_alloc_T(MML_global_arena, 1, MML_expr);
+	vec->type = Vector_type;
+	vec->v = (MML_expr_vec) {
+		.ptr = NULL,
+		.n = o.n,
+		.packed = o.vals,
+	};
+
+	return MML_eval_set_variable(state, name, vec);
+
+fail:
+	munmap(o.vals, o.map_len);
+	return -1;
+}
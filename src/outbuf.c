@@ -0,0 +1,128 @@
+#include "mml/outbuf.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mml/config.h"
+
+void MML_outbuf_init(MML_outbuf *o, FILE *sink)
+{
+	o->buf = malloc(MML_OUTBUF_SIZE);
+	o->cap = (o->buf != NULL) ? MML_OUTBUF_SIZE : 0;
+	o->len = 0;
+	o->sink = o->copy = nullptr;
+	MML_outbuf_set_sink(o, sink);
+}
+
+void MML_outbuf_destroy(MML_outbuf *o)
+{
+	MML_outbuf_flush(o);
+	free(o->buf);
+	o->buf = NULL;
+	o->cap = 0;
+}
+
+void MML_outbuf_set_sink(MML_outbuf *o, FILE *sink)
+{
+	MML_outbuf_flush(o);
+	o->sink = sink;
+	o->line_buffered = sink != NULL && isatty(fileno(sink));
+}
+
+void MML_outbuf_set_copy(MML_outbuf *o, FILE *copy)
+{
+	MML_outbuf_flush(o);
+	o->copy = copy;
+}
+
+// Writes S to the sink (and the copy) without flushing the sink itself.
+static void put(MML_outbuf *o, const char *s, size_t n)
+{
+	if (o->sink == NULL)
+		return;
+	fwrite(s, 1, n, o->sink);
+	if (o->copy != NULL)
+		fwrite(s, 1, n, o->copy);
+}
+
+// Writes the buffer to the sink without flushing the sink itself.
+static void drain(MML_outbuf *o)
+{
+	if (o->len != 0)
+		put(o, o->buf, o->len);
+	o->len = 0;
+}
+
+void MML_outbuf_flush(MML_outbuf *o)
+{
+	drain(o);
+	if (o->sink != NULL)
+		fflush(o->sink);
+}
+
+char *MML_outbuf_reserve(MML_outbuf *o, size_t n)
+{
+	if (o->cap - o->len >= n)
+		return o->buf + o->len;
+
+	drain(o);
+	if (o->cap < n)
+	{
+		char *buf = realloc(o->buf, n);
+		if (buf == NULL)
+		{
+			MML_log_err("failed to grow output buffer to %zu bytes\n", n);
+			return NULL;
+		}
+		o->buf = buf;
+		o->cap = n;
+	}
+
+	return o->buf;
+}
+
+void MML_outbuf_write(MML_outbuf *o, const char *s, size_t n)
+{
+	if (n > o->cap - o->len)
+	{
+		drain(o);
+		// too big to be worth copying
+		if (n >= o->cap)
+		{
+			put(o, s, n);
+			if (o->line_buffered && memchr(s, '\n', n) != NULL)
+				fflush(o->sink);
+			return;
+		}
+	}
+
+	memcpy(o->buf + o->len, s, n);
+	o->len += n;
+	if (o->line_buffered && memchr(s, '\n', n) != NULL)
+		MML_outbuf_flush(o);
+}
+
+void MML_outbuf_printf(MML_outbuf *o, const char *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	va_list args_copy;
+	va_copy(args_copy, args);
+
+	const int32_t n = vsnprintf(o->buf + o->len, o->cap - o->len, fmt, args);
+	if (n >= 0 && (size_t)n >= o->cap - o->len)
+	{
+		char *p = MML_outbuf_reserve(o, (size_t)n + 1);
+		if (p != NULL)
+			vsnprintf(p, (size_t)n + 1, fmt, args_copy);
+	}
+	va_end(args_copy);
+	va_end(args);
+
+	if (n < 0 || o->cap - o->len < (size_t)n)
+		return;
+	o->len += n;
+	if (o->line_buffered && memchr(o->buf + o->len - n, '\n', n) != NULL)
+		MML_outbuf_flush(o);
+}
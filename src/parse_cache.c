@@ -0,0 +1,198 @@
+#include "mml/parse_cache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mml/config.h"
+#include "mml/eval.h"
+#include "mml/hash.h"
+#include "mml/parser.h"
+#include "mml/trace.h"
+#include "arena/arena.h"
+#include "cvi/dvec/dvec.h"
+#include "c-hashmap/map.h"
+
+// trees of a short source fit in the first bucket
+#define ENTRY_ARENA_BUCKET 1024
+
+struct entry {
+	// the LRU list, most recently used first
+	struct entry *prev, *next;
+	uint64_t hash;
+	strbuf src;	// NUL-terminated, in ARENA
+	Arena *arena;
+	MML_expr_dvec stmts;
+	size_t bytes;
+	// a statement assigns a variable, which then points into the trees
+	bool pinned;
+};
+
+struct MML_parse_cache {
+	hashmap *by_hash;	// `hash` -> `struct entry *`
+	struct entry *head, *tail;
+	MML_parse_cache_stats stats;
+};
+
+static uint64_t hash_source(const char *s, size_t len)
+{
+	uint64_t h = len * 0x9e3779b97f4a7c15ull;
+	for (; len >= 8; s += 8, len -= 8)
+	{
+		uint64_t w;
+		memcpy(&w, s, 8);
+		h = (h ^ MML_hash_fmix(w)) * 0x87c37b91114253d5ull;
+	}
+	uint64_t w = 0;
+	memcpy(&w, s, len);
+	return MML_hash_fmix(h ^ w);
+}
+
+static void unlink_entry(MML_parse_cache *c, struct entry *e)
+{
+	if (e->prev != NULL)
+		e->prev->next = e->next;
+	else
+		c->head = e->next;
+	if (e->next != NULL)
+		e->next->prev = e->prev;
+	else
+		c->tail = e->prev;
+	e->prev = e->next = NULL;
+}
+
+static void push_front(MML_parse_cache *c, struct entry *e)
+{
+	e->next = c->head;
+	if (c->head != NULL)
+		c->head->prev = e;
+	else
+		c->tail = e;
+	c->head = e;
+}
+
+static void drop_entry(MML_parse_cache *c, struct entry *e, bool keep_trees)
+{
+	unlink_entry(c, e);
+	hashmap_remove(c->by_hash, &e->hash, sizeof(e->hash));
+	c->stats.bytes -= e->bytes;
+	--c->stats.n_entries;
+	++c->stats.evictions;
+	MML_trace2(MML_TRACE_DEBUG, "parse_cache.evict", e->bytes, e->pinned);
+
+	if (keep_trees || e->pinned)
+		arena_merge(MML_global_arena, e->arena);
+	else
+		arena_destroy(e->arena);
+	dv_destroy(e->stmts);
+	free(e);
+}
+
+const MML_expr_dvec *MML_parse_cache_get(MML_parse_cache *c, const char *s)
+{
+	const size_t len = strlen(s);
+	const uint64_t hash = hash_source(s, len);
+
+	struct entry *e;
+	if (hashmap_get(c->by_hash, &hash, sizeof(hash), (uintptr_t *)&e))
+	{
+		if (e->src.len == len && memcmp(e->src.s, s, len) == 0)
+		{
+			++c->stats.hits;
+			unlink_entry(c, e);
+			push_front(c, e);
+			return &e->stmts;
+		}
+		// only one source per hash is kept; collisions are rare enough that
+		// the old trees are kept in case the last value points into them
+		drop_entry(c, e, true);
+	}
+	++c->stats.misses;
+	MML_trace1(MML_TRACE_DEBUG, "parse_cache.miss", len);
+
+	e = calloc(1, sizeof(*e));
+	if (e == NULL)
+		return NULL;
+	e->arena = arena_make(ENTRY_ARENA_BUCKET);
+	e->hash = hash;
+	// rounded up so the trees after it stay aligned
+	e->src = (strbuf) { arena_alloc(e->arena, (len + 8) & ~(size_t)7), len };
+	memcpy(e->src.s, s, len + 1);
+
+	// identifiers point into the copy of the source, which lives as long
+	e->stmts = MML_parse_stmts_in(e->arena, e->src.s, true);
+	e->pinned = MML_stmts_assign(&e->stmts);
+	e->bytes = sizeof(*e) + arena_bytes_used(e->arena)
+		+ dv_n(e->stmts) * sizeof(MML_expr *);
+
+	if (hashmap_set(c->by_hash, &e->hash, sizeof(e->hash), (uintptr_t)e) < 0)
+	{
+		arena_merge(MML_global_arena, e->arena);
+		dv_destroy(e->stmts);
+		free(e);
+		return NULL;
+	}
+	push_front(c, e);
+	c->stats.bytes += e->bytes;
+	++c->stats.n_entries;
+	return &e->stmts;
+}
+
+void MML_parse_cache_trim(MML_parse_cache *c, bool keep_trees)
+{
+	while (c->stats.bytes > c->stats.max_bytes && c->tail != c->head)
+		drop_entry(c, c->tail, keep_trees);
+}
+
+void MML_parse_cache_free(MML_parse_cache *c)
+{
+	if (c == NULL)
+		return;
+	while (c->head != NULL)
+	{
+		struct entry *e = c->head;
+		c->head = e->next;
+		arena_destroy(e->arena);
+		dv_destroy(e->stmts);
+		free(e);
+	}
+	hashmap_free(c->by_hash);
+	free(c);
+}
+
+int32_t MML_eval_set_parse_cache(MML_state *restrict state, size_t max_bytes)
+{
+	if (max_bytes == 0)
+	{
+		// variables may still point into pinned trees
+		if (state->parse_cache != NULL)
+		{
+			state->parse_cache->stats.max_bytes = 0;
+			while (state->parse_cache->head != NULL)
+				drop_entry(state->parse_cache, state->parse_cache->head, true);
+		}
+		MML_parse_cache_free(state->parse_cache);
+		state->parse_cache = NULL;
+		return 0;
+	}
+
+	if (state->parse_cache == NULL)
+	{
+		MML_parse_cache *c = calloc(1, sizeof(*c));
+		if (c == NULL || (c->by_hash = hashmap_create()) == NULL)
+		{
+			free(c);
+			MML_log_err("failed to allocate the parse cache\n");
+			return -1;
+		}
+		state->parse_cache = c;
+	}
+	state->parse_cache->stats.max_bytes = max_bytes;
+	return 0;
+}
+
+MML_parse_cache_stats MML_eval_parse_cache_stats(const MML_state *restrict state)
+{
+	return (state->parse_cache != NULL)
+		? state->parse_cache->stats
+		: (MML_parse_cache_stats) { 0 };
+}
@@ -1,12 +1,17 @@
+#include <math.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
-#include <ctype.h>
+#include <string.h>
 
 #include "mml/parser.h"
+#include "mml/lexer.h"
+#include "mml/number.h"
 #include "mml/eval.h"
 #include "mml/expr.h"
 #include "mml/token.h"
 #include "mml/config.h"
+#include "mml/trace.h"
 #include "arena/arena.h"
 #include "cvi/dvec/dvec.h"
 
@@ -80,129 +85,59 @@ const char *const EXPR_TYPE_STRINGS[] = {
 	"boolean",
 	"identifier",
 	"vector",
+	"slot",
 };
 
+// Logs a problem with the input with `MML_log_<KIND>`, or only notes it in
+// STATE if STATE is quiet.
+#define PARSE_LOG(state, kind, ...) do { \
+	if ((state)->quiet) \
+		(state)->had_problem = true; \
+	else \
+		MML_log_##kind(__VA_ARGS__); \
+} while (0)
+
+// Lexes the next tokens into the window once the parser has read all of it.
+static void fill_tokens(const char *s, struct parser_state *state)
+{
+	if (state->lex_s == NULL)
+	{
+		state->lex_s = s;
+		state->n_toks = state->tok_pos = 0;
+	}
+	if (state->tok_pos != state->n_toks)
+		return;
+
+	const MML_token_type prev = (state->n_toks != 0)
+		? state->toks[state->n_toks-1].type
+		: MML_EOF_TOK;
+	state->n_toks = MML_lex(&state->lex_s, state->lex_end, prev,
+			state->toks, PARSER_TOK_WINDOW);
+	state->tok_pos = 0;
+
+	for (size_t i = 0; i < state->n_toks; ++i)
+		if (state->toks[i].type == MML_INVALID_TOK)
+			PARSE_LOG(state, warn, "invalid token starts at '%.5s'\n", state->toks[i].buf.s);
+}
 
 // Gets the next token and advances the string pointer.
 static MML_token get_next_token(const char **s, struct parser_state *state)
 {
-	MML_token ret = nToken(MML_INVALID_TOK, NULL, 0);
-
 	if (state->has_peeked) {
 		state->has_peeked = false;
+		state->tok_pos = state->peeked_pos;
 		*s = state->saved_s;
 		return state->peeked_tok;
 	}
 
-	const char *cached_s = *s;
-	while (isspace(*cached_s)) ++cached_s;
-
-	MML_token_type type = TOK_BY_CHAR[(unsigned char)*cached_s];
-	switch (type) {
-	case MML_EOF_TOK:
-		*s = cached_s;
-		return state->current_tok = nToken(MML_EOF_TOK, NULL, 0);
-	case MML_OP_DOT_TOK:
-	case MML_OP_AT_TOK:
-	case MML_OP_POW_TOK:
-	case MML_OP_MUL_TOK:
-	case MML_OP_DIV_TOK:
-	case MML_OP_MOD_TOK:
-	case MML_OP_ADD_TOK:
-	case MML_OP_SUB_TOK:
-	case MML_OPEN_PAREN_TOK:
-	case MML_CLOSE_PAREN_TOK:
-	case MML_OPEN_BRAC_TOK:
-	case MML_CLOSE_BRAC_TOK:
-	case MML_OPEN_BRACKET_TOK:
-	case MML_CLOSE_BRACKET_TOK:
-	case MML_COMMA_TOK:
-	case MML_PIPE_TOK:
-	case MML_SEMICOLON_TOK:
-	case MML_TILDE_TOK:
-		ret = nToken(type, cached_s, 1);
-		++cached_s;
-		break;
-	case MML_OP_LESS_TOK:
-		if ((cached_s)[1] == '=')
-		{
-			ret = nToken(MML_OP_LESSEQ_TOK, cached_s, 2);
-			cached_s += 2;
-			break;
-		}
-		ret = nToken(MML_OP_LESS_TOK, cached_s, 1);
-		++cached_s;
-		break;
-	case MML_OP_GREATER_TOK:
-		if ((cached_s)[1] == '=')
-		{
-			ret = nToken(MML_OP_GREATEREQ_TOK, cached_s, 2);
-			cached_s += 2;
-			break;
-		}
-		ret = nToken(MML_OP_GREATER_TOK, cached_s, 1);
-		++cached_s;
-		break;
-	case MML_OP_EQ_TOK:
-		if (cached_s[1] != '=')
-		{
-			ret = nToken(MML_OP_ASSERT_EQUAL, cached_s, 1);
-			++cached_s;
-		} else if (cached_s[2] != '=')
-		{
-			ret = nToken(MML_OP_EQ_TOK, cached_s, 2);
-			cached_s += 2;
-		} else
-		{
-			ret = nToken(MML_OP_EXACT_EQ, cached_s, 3);
-			cached_s += 3;
-		}
-		break;
-	case MML_OP_NOT_TOK:
-		if ((cached_s)[1] != '=')
-		{
-			ret = nToken(MML_OP_NOT_TOK, cached_s, 1);
-			++cached_s;
-		} else if ((cached_s)[2] != '=')
-		{
-			ret = nToken(MML_OP_NOTEQ_TOK, cached_s, 2);
-			cached_s += 2;
-		} else
-		{
-			ret = nToken(MML_OP_EXACT_NOTEQ, cached_s, 3);
-			cached_s += 3;
-		}
-		break;
-	case MML_DIGIT_TOK: {
-		const char *const start = cached_s;
-		while (isdigit(*cached_s))
-			++cached_s;
-		if (!state->looking_for_int && *cached_s == '.')
-		{
-			++cached_s;
-			while (isdigit(*cached_s))
-				++cached_s;
-		}
-		ret = nToken(MML_NUMBER_TOK, start, cached_s - start);
-		break;
-	}
-	case MML_LETTER_TOK:
-	case MML_UNDERSCORE_TOK: {
-		const char *const start = (char *)cached_s;
-		do {
-			++cached_s;
-		} while (isalnum(*cached_s) || *cached_s == '_');
-		ret = nToken(MML_IDENT_TOK, start, cached_s - start);
-		break;
-	}
-	default:
-		MML_log_warn("invalid token starts at '%.5s'\n", cached_s++);
-		break;
-	}
-
+	fill_tokens(*s, state);
+	const MML_token ret = state->toks[state->tok_pos];
+	// the EOF token is the last one lexed, and is returned from then on
+	if (ret.type != MML_EOF_TOK)
+		++state->tok_pos;
 
 	state->current_tok = ret;
-	*s = cached_s;
+	*s = ret.buf.s + ret.buf.len;
 	return ret;
 }
 
@@ -212,8 +147,12 @@ static MML_token peek_token(const char **s, struct parser_state *state)
 	if (!state->has_peeked)
 	{
 		const char *s_copy = *s;
+		fill_tokens(*s, state);
+		const size_t tok_pos = state->tok_pos;
 		state->peeked_tok = get_next_token(&s_copy, state);
 		state->saved_s = s_copy;
+		state->peeked_pos = state->tok_pos;
+		state->tok_pos = tok_pos;
 		state->has_peeked = true;
 	}
 	return state->peeked_tok;
@@ -231,13 +170,88 @@ static bool op_is_right_associative(MML_token_type op)
 	return op == MML_OP_POW_TOK || op_is_unary(op);
 }
 
-static bool in_pipe_block = false;
+static inline Arena *parser_arena(const struct parser_state *state)
+{
+	return (state->arena != NULL) ? state->arena : MML_global_arena;
+}
+
+static strbuf ident_text(const struct parser_state *state, strbuf ident)
+{
+	if (state->borrow_idents)
+		return ident;
+	strbuf ret = { arena_alloc_T(parser_arena(state), ident.len, char), ident.len };
+	memcpy(ret.s, ident.s, ident.len);
+	return ret;
+}
+
+/* Parses the elements of the vector literal whose `[` was just read, for as
+ * long as each is a number or a negated one followed by `,` or `]`. Data
+ * pasted into a script is usually all such, and is then read straight from
+ * the text into packed doubles in VEC, without tokens or a node per element;
+ * this returns true once the `]` is read. Otherwise this returns false, with
+ * nodes for the elements read so far (the same ones `parse_expr` would have
+ * made) in *ELEMS. */
+static bool parse_packed_vector(const char **s, struct parser_state *state,
+		MML_expr *vec, MML_expr_dvec *elems)
+{
+	dvec_t(double) nums = DVEC_INIT;
+	double chunk[512];
+	bool closed = false;
+	size_t n;
+	do
+	{
+		n = MML_lex_numbers(s, state->lex_end, chunk, 512, &closed);
+		for (size_t i = 0; i < n; ++i)
+			dv_push(nums, chunk[i]);
+	} while (n == 512 && !closed);
+	if (dv_n(nums) == 0)
+		return false;
+
+	// the tokens lexed ahead start inside the literal, so lexing restarts
+	// where it was left
+	state->lex_s = *s;
+	state->n_toks = state->tok_pos = 0;
+	if (closed)
+		state->current_tok = nToken(MML_CLOSE_BRACKET_TOK, *s - 1, 1);
+
+	Arena *arena = parser_arena(state);
+	if (closed)
+	{
+		// the arena doesn't align, and the elements may be read as a whole
+		char *p = arena_alloc(arena, dv_n(nums) * sizeof(double) + sizeof(double) - 1);
+		double *packed = (double *)(((uintptr_t)p + sizeof(double) - 1) & ~(uintptr_t)(sizeof(double) - 1));
+		memcpy(packed, _dv_ptr(nums), dv_n(nums) * sizeof(double));
+		vec->type = Vector_type;
+		vec->v = (MML_expr_vec) { NULL, dv_n(nums), packed };
+	} else
+	{
+		double *x;
+		dv_foreach(nums, x)
+		{
+			MML_expr *e = arena_alloc_T(arena, 1, MML_expr);
+			*e = EXPR_NUM(fabs(*x));
+			if (signbit(*x))
+			{
+				MML_expr *negated = e;
+				e = arena_alloc_T(arena, 1, MML_expr);
+				e->type = Operation_type;
+				e->o.op = MML_OP_NEGATE;
+				e->o.left = negated;
+				e->o.right = NULL;
+			}
+			dv_push(*elems, e);
+		}
+	}
+	dv_destroy(nums);
+	return closed;
+}
 
 static MML_expr *parse_expr(const char **s, uint32_t max_preced, struct parser_state *state)
 {
 	MML_token tok = get_next_token(s, state);
+	Arena *arena = parser_arena(state);
 
-	MML_expr *left = arena_alloc_T(MML_global_arena, 1, MML_expr);
+	MML_expr *left = arena_alloc_T(arena, 1, MML_expr);
 	left->type = Invalid_type;
 
 	if (tok.type == MML_OP_SUB_TOK || tok.type == MML_OP_ADD_TOK
@@ -262,9 +276,9 @@ static MML_expr *parse_expr(const char **s, uint32_t max_preced, struct parser_s
 
 		if (tok.type == MML_IDENT_TOK && next_tok.type == MML_OPEN_BRAC_TOK)
 		{
-			MML_expr *name = arena_alloc_T(MML_global_arena, 1, MML_expr);
+			MML_expr *name = arena_alloc_T(arena, 1, MML_expr);
 			name->type = Identifier_type;
-			name->s = strbuf_dup(ident.buf);
+			name->s = ident_text(state, ident.buf);
 
 			left->type = Operation_type;
 			left->o.left = name;
@@ -272,7 +286,7 @@ static MML_expr *parse_expr(const char **s, uint32_t max_preced, struct parser_s
 
 			get_next_token(s, state);
 
-			left->o.right = arena_alloc(MML_global_arena, sizeof(MML_expr));
+			left->o.right = arena_alloc(arena, sizeof(MML_expr));
 			left->o.right->type = Vector_type;
 			// temporary dvec because we don't know how many elements it'll have
 			MML_expr_dvec temp = DVEC_INIT;
@@ -285,8 +299,9 @@ static MML_expr *parse_expr(const char **s, uint32_t max_preced, struct parser_s
 				//if (next_expr != nullptr)
 				//	--next_expr->num_refs;
 			} while (get_next_token(s, state).type == MML_COMMA_TOK);
-			left->o.right->v.ptr = arena_alloc_T(MML_global_arena, dv_n(temp), MML_expr *);
+			left->o.right->v.ptr = arena_alloc_T(arena, dv_n(temp), MML_expr *);
 			left->o.right->v.n = dv_n(temp);
+			left->o.right->v.packed = NULL;
 			// copy `temp` into the actual vector
 			memcpy(
 				left->o.right->v.ptr,
@@ -305,23 +320,29 @@ static MML_expr *parse_expr(const char **s, uint32_t max_preced, struct parser_s
 		} else
 		{
 			left->type = Identifier_type;
-			left->s = strbuf_dup(ident.buf);
+			left->s = ident_text(state, ident.buf);
 		}
 	} else if (tok.type == MML_OPEN_PAREN_TOK)
 	{
 		left = parse_expr(s, PARSER_MAX_PRECED, state);
-		MML_log_dbg("left type = %s\n", EXPR_TYPE_STRINGS[left->type]);
+		MML_trace1(MML_TRACE_DEBUG, "parse.paren_type", left->type);
 		MML_token close_paren_tok = get_next_token(s, state);
 		if (close_paren_tok.type != MML_CLOSE_PAREN_TOK)
 			get_next_token(s, state);
 	} else if (tok.type == MML_OPEN_BRACKET_TOK)
 	{
 		MML_expr_dvec temp = DVEC_INIT;
+		if (parse_packed_vector(s, state, left, &temp))
+			goto operand_done;
 		while (tok.type != MML_CLOSE_BRACKET_TOK)
 		{
 			tok = peek_token(s, state);
+			// `[]`, or a `,` before the `]`
 			if (tok.type == MML_CLOSE_BRACKET_TOK)
+			{
+				get_next_token(s, state);
 				break;
+			}
 
 			MML_expr *e = parse_expr(s, PARSER_MAX_PRECED, state);
 			dv_push(temp, e);
@@ -330,7 +351,7 @@ static MML_expr *parse_expr(const char **s, uint32_t max_preced, struct parser_s
 			if (tok.type != MML_CLOSE_BRACKET_TOK
 			 && tok.type != MML_COMMA_TOK)
 			{
-				MML_log_err("unexpected token %s found after element"
+				PARSE_LOG(state, err, "unexpected token %s found after element"
 						" in vector literal (expected CLOSE_BRACKET_TOK or COMMA_TOK)\n",
 					 TOK_STRINGS[tok.type]);
 				dv_destroy(temp);
@@ -340,8 +361,9 @@ static MML_expr *parse_expr(const char **s, uint32_t max_preced, struct parser_s
 		}
 		
 		left->type = Vector_type;
-		left->v.ptr = arena_alloc_T(MML_global_arena, dv_n(temp), MML_expr *);
+		left->v.ptr = arena_alloc_T(arena, dv_n(temp), MML_expr *);
 		left->v.n = dv_n(temp);
+		left->v.packed = NULL;
 		memcpy(
 			left->v.ptr,
 			_dv_ptr(temp),
@@ -354,11 +376,11 @@ static MML_expr *parse_expr(const char **s, uint32_t max_preced, struct parser_s
 		tok = peek_token(s, state);
 		if (tok.type == MML_PIPE_TOK)
 		{
-			MML_log_err("expected expression in pipe block\n");
+			PARSE_LOG(state, err, "expected expression in pipe block\n");
 			return NULL;
 		}
 
-		in_pipe_block = true;
+		state->in_pipe_block = true;
 
 		left = parse_expr(s, PARSER_MAX_PRECED, state);
 		MML_token close_pipe_tok = get_next_token(s, state);
@@ -366,10 +388,10 @@ static MML_expr *parse_expr(const char **s, uint32_t max_preced, struct parser_s
 		if (close_pipe_tok.type != MML_PIPE_TOK)
 			get_next_token(s, state);
 
-		in_pipe_block = false;
+		state->in_pipe_block = false;
 		//MML_expr *opnode = Pipe(left);
 
-		MML_expr *opnode = arena_alloc_T(MML_global_arena, 1, MML_expr);
+		MML_expr *opnode = arena_alloc_T(arena, 1, MML_expr);
 		opnode->type = Operation_type;
 		opnode->o.op = MML_PIPE_TOK;
 		opnode->o.left = left;
@@ -378,15 +400,14 @@ static MML_expr *parse_expr(const char **s, uint32_t max_preced, struct parser_s
 		left = opnode;
 	} else if (tok.type == MML_NUMBER_TOK)
 	{
-		if (state->looking_for_int)
-			*left = EXPR_NUM((double)strtoll(tok.buf.s, NULL, 10));
-		else
-			*left = EXPR_NUM(strtod(tok.buf.s, NULL)); 
-		state->looking_for_int = false;
+		double x = 0.0;
+		MML_parse_double(tok.buf.s, tok.buf.s + tok.buf.len, &x);
+		*left = EXPR_NUM(x);
 	} else {
 		return NULL;
 	}
 
+operand_done:
 	for (;;)
 	{
 		MML_token op_tok = peek_token(s, state);
@@ -398,7 +419,7 @@ static MML_expr *parse_expr(const char **s, uint32_t max_preced, struct parser_s
 		 || op_tok.type == MML_NUMBER_TOK
 		 || op_tok.type == MML_OPEN_PAREN_TOK
 		 || op_tok.type == MML_OPEN_BRACKET_TOK
-		 || (op_tok.type == MML_PIPE_TOK && !in_pipe_block))
+		 || (op_tok.type == MML_PIPE_TOK && !state->in_pipe_block))
 		{
 			op_tok.type = MML_OP_MUL_TOK;
 			do_advance = false;
@@ -412,21 +433,18 @@ static MML_expr *parse_expr(const char **s, uint32_t max_preced, struct parser_s
 
 		if (do_advance) get_next_token(s, state);
 
-		if (op_tok.type == MML_OP_DOT_TOK)
-			state->looking_for_int = true;
-
 		MML_expr *right = parse_expr(s,
 				op_is_right_associative(op_tok.type)
 					? preced
 					: preced-1, state);
 
 		if (right == NULL) {
-			MML_log_err("expected expression after operator %s\n",
+			PARSE_LOG(state, err, "expected expression after operator %s\n",
 					TOK_STRINGS[op_tok.type]);
 			return NULL;
 		}
 
-		MML_expr *opnode = arena_alloc_T(MML_global_arena, 1, MML_expr);
+		MML_expr *opnode = arena_alloc_T(arena, 1, MML_expr);
 		opnode->type = Operation_type;
 		opnode->o.left = left;
 		opnode->o.right = right;
@@ -440,17 +458,231 @@ static MML_expr *parse_expr(const char **s, uint32_t max_preced, struct parser_s
 
 MML_expr *MML_parse(const char *s)
 {
-	struct parser_state state = {0};
+	return MML_parse_in(MML_global_arena, s);
+}
+MML_expr *MML_parse_in(Arena *arena, const char *s)
+{
+	struct parser_state state = { .arena = arena };
 	return parse_expr(&s, PARSER_MAX_PRECED, &state);
 }
-MML_expr_dvec MML_parse_stmts(const char *s)
+static MML_expr_dvec parse_stmts(const char *s, struct parser_state *state)
 {
 	MML_expr_dvec temp = DVEC_INIT;
-	struct parser_state state = {0};
 	do
 	{
-		dv_push(temp, parse_expr(&s, PARSER_MAX_PRECED, &state));
-	} while (get_next_token(&s, &state).type == MML_SEMICOLON_TOK);
+		dv_push(temp, parse_expr(&s, PARSER_MAX_PRECED, state));
+	} while (get_next_token(&s, state).type == MML_SEMICOLON_TOK);
 
 	return temp;
 }
+MML_expr_dvec MML_parse_stmts(const char *s)
+{
+	return MML_parse_stmts_in(MML_global_arena, s, false);
+}
+MML_expr_dvec MML_parse_stmts_borrowed(const char *s)
+{
+	return MML_parse_stmts_in(MML_global_arena, s, true);
+}
+MML_expr_dvec MML_parse_stmts_in(Arena *arena, const char *s, bool borrow_idents)
+{
+	struct parser_state state = { .arena = arena, .borrow_idents = borrow_idents };
+	return parse_stmts(s, &state);
+}
+
+struct walk_entry {
+	const MML_expr *expr, *parent;
+};
+
+struct walk_stack {
+	struct walk_entry *p;
+	size_t n, cap;
+	bool failed;
+};
+
+static void push(struct walk_stack *stack, const MML_expr *expr, const MML_expr *parent)
+{
+	if (stack->n == stack->cap)
+	{
+		const size_t cap = (stack->cap != 0) ? stack->cap * 2 : 64;
+		struct walk_entry *p = realloc(stack->p, cap * sizeof(*p));
+		if (p == NULL)
+		{
+			stack->failed = true;
+			return;
+		}
+		stack->p = p;
+		stack->cap = cap;
+	}
+	stack->p[stack->n++] = (struct walk_entry) { expr, parent };
+}
+
+bool MML_expr_walk(const MML_expr *expr, MML_expr_visit visit, void *usr)
+{
+	// an explicit stack, since trees parsed from long sums are deeper than
+	// the C stack allows; children are pushed last first
+	struct walk_stack stack = { NULL, 0, 0, false };
+	push(&stack, expr, NULL);
+	while (stack.n != 0 && !stack.failed)
+	{
+		const struct walk_entry cur = stack.p[--stack.n];
+		if (!visit(cur.expr, cur.parent, usr))
+			break;
+		if (cur.expr == NULL)
+			continue;
+
+		if (cur.expr->type == Operation_type)
+		{
+			push(&stack, cur.expr->o.right, cur.expr);
+			push(&stack, cur.expr->o.left, cur.expr);
+		} else if (cur.expr->type == Vector_type && cur.expr->v.packed == NULL)
+		{
+			for (size_t i = cur.expr->v.n; i-- != 0; )
+				push(&stack, cur.expr->v.ptr[i], cur.expr);
+		}
+	}
+	free(stack.p);
+	return !stack.failed;
+}
+
+static bool find_assign(const MML_expr *expr, const MML_expr *, void *usr)
+{
+	bool *found = usr;
+	*found = expr != NULL && expr->type == Operation_type
+		&& expr->o.op == MML_OP_ASSERT_EQUAL;
+	return !*found;
+}
+
+bool MML_expr_assigns(const MML_expr *expr)
+{
+	bool found = false;
+	return !MML_expr_walk(expr, find_assign, &found) || found;
+}
+
+bool MML_stmts_assign(const MML_expr_dvec *stmts)
+{
+	MML_expr **cur;
+	dv_foreach(*stmts, cur)
+		if (MML_expr_assigns(*cur))
+			return true;
+	return false;
+}
+
+// parts of a script parsed in parallel are at least this long
+#define PARSE_PART_MIN (256u << 10)
+
+struct parse_job {
+	const char *start, *end;	// END is NULL for the last part
+	Arena *arena;
+	bool borrow_idents;
+	MML_expr_dvec stmts;
+	// the last statement of the part ended with the `;` just before END
+	bool ends_at_end;
+	// something would have been logged; parts are parsed quietly, as
+	// logging isn't thread-safe and the script may be parsed again
+	bool had_problem;
+};
+
+static void *parse_part_worker(void *arg)
+{
+	struct parse_job *job = arg;
+	struct parser_state state = {
+		.lex_end = job->end,
+		.borrow_idents = job->borrow_idents,
+		.quiet = true,
+		.arena = job->arena,
+	};
+	if (job->end == NULL)
+	{
+		job->stmts = parse_stmts(job->start, &state);
+		job->ends_at_end = true;
+		job->had_problem = state.had_problem;
+		return NULL;
+	}
+
+	const char *s = job->start;
+	bool has_more;
+	do
+		dv_push(job->stmts, MML_parse_next_stmt(&s, &state, &has_more));
+	while (has_more && s != job->end);
+	job->ends_at_end = has_more && s == job->end;
+	job->had_problem = state.had_problem;
+	return NULL;
+}
+
+MML_expr_dvec MML_parse_stmts_parallel(Arena *arena, const char *s,
+		bool borrow_idents, uint32_t n_threads)
+{
+	const size_t len = strlen(s);
+	if (n_threads > MML_REDUCE_MAX_THREADS)
+		n_threads = MML_REDUCE_MAX_THREADS;
+	if (n_threads > len / PARSE_PART_MIN)
+		n_threads = len / PARSE_PART_MIN;
+	if (n_threads < 2)
+		return MML_parse_stmts_in(arena, s, borrow_idents);
+
+	// each part but the first starts after the first `;` past an even split
+	struct parse_job jobs[n_threads];
+	uint32_t n_parts = 0;
+	const char *start = s;
+	for (uint32_t i = 1; i < n_threads; ++i)
+	{
+		const char *split = s + len / n_threads * i;
+		if (split < start)
+			continue;
+		const char *semi = memchr(split, ';', s + len - split);
+		if (semi == NULL)
+			break;
+		jobs[n_parts++] = (struct parse_job) { .start = start, .end = semi + 1 };
+		start = semi + 1;
+	}
+	jobs[n_parts++] = (struct parse_job) { .start = start };
+	for (uint32_t i = 0; i < n_parts; ++i)
+	{
+		jobs[i].arena = arena_make(8192);
+		jobs[i].borrow_idents = borrow_idents;
+		jobs[i].stmts = (MML_expr_dvec)DVEC_INIT;
+	}
+
+	MML_trace2(MML_TRACE_INFO, "parse.parallel", len, n_parts);
+	pthread_t tids[n_parts];
+	uint32_t started = 1;
+	for (; started < n_parts; ++started)
+		if (pthread_create(&tids[started], NULL, parse_part_worker, &jobs[started]) != 0)
+			break;
+	// anything that failed to start is parsed on this thread
+	for (uint32_t i = started; i < n_parts; ++i)
+		parse_part_worker(&jobs[i]);
+	parse_part_worker(&jobs[0]);
+	for (uint32_t i = 1; i < started; ++i)
+		pthread_join(tids[i], NULL);
+
+	// with a problem, the script is parsed again in one piece, which logs it
+	bool split_ok = true;
+	for (uint32_t i = 0; i < n_parts; ++i)
+		split_ok &= jobs[i].ends_at_end && !jobs[i].had_problem;
+
+	MML_expr_dvec ret = DVEC_INIT;
+	for (uint32_t i = 0; i < n_parts; ++i)
+	{
+		if (split_ok)
+		{
+			MML_expr **cur;
+			dv_foreach(jobs[i].stmts, cur)
+				dv_push(ret, *cur);
+			arena_merge(arena, jobs[i].arena);
+		} else
+			arena_destroy(jobs[i].arena);
+		dv_destroy(jobs[i].stmts);
+	}
+	if (!split_ok)
+		return MML_parse_stmts_in(arena, s, borrow_idents);
+	return ret;
+}
+
+MML_expr *MML_parse_next_stmt(const char **s, struct parser_state *state, bool *has_more)
+{
+	MML_expr *ret = parse_expr(s, PARSER_MAX_PRECED, state);
+	*has_more = get_next_token(s, state).type == MML_SEMICOLON_TOK;
+
+	return ret;
+}
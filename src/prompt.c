@@ -1,5 +1,7 @@
 #include "mml/prompt.h"
 
+#include <errno.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,8 +14,10 @@
 #include "mml/config.h"
 #include "mml/expr.h"
 #include "mml/eval.h"
+#include "mml/lexer.h"
 #include "mml/parser.h"
 #include "cvi/dvec/dvec.h"
+#include "c-hashmap/map.h"
 
 #define NSEC_IN_SEC 1000000000
 
@@ -25,133 +29,384 @@
 
 #define PROMPT_STR "==> "
 
-enum KEY_CODES {
-	KC_UP_ARROW		= 0x0000'0000'0041'5b1b,
-	KC_DOWN_ARROW	= 0x0000'0000'0042'5b1b,
-	KC_LEFT_ARROW	= 0x0000'0000'0044'5b1b,
-	KC_RIGHT_ARROW	= 0x0000'0000'0043'5b1b,
-	KC_ALT_UP_ARROW	= 0x0000'4133'3b31'5b1b,
-	KC_ALT_DOWN_ARROW	= 0x0000'4233'3b31'5b1b,
-	KC_ALT_LEFT_ARROW	= 0x0000'0000'0000'621b,
-	KC_ALT_RIGHT_ARROW= 0x0000'0000'0000'661b,
-	KC_ALT_D		= 0x0000'0000'0000'641b,
-	KC_BACKSPACE	= 0x0000'0000'0000'0008,
-	KC_DELETE		= 0x0000'0000'0000'007f,
-	KC_EOF		= 0x0000'0000'0000'0004,
-	KC_ESC		= 0x0000'0000'0000'001b,
+constexpr size_t LINE_MAX_LEN = 4096;
+
+// how long the rest of an escape sequence may take to arrive before ESC is
+// taken to be a key of its own
+#define ESC_TIMEOUT_MS 25
+
+enum key {
+	KEY_NONE,	// an escape sequence the prompt doesn't use
+	KEY_CHAR,
+	KEY_ENTER,
+	KEY_EOF,
+	KEY_ESC,
+	KEY_BACKSPACE,
+	KEY_UP,
+	KEY_DOWN,
+	KEY_LEFT,
+	KEY_RIGHT,
+	KEY_LINE_START,	// ALT+UP or ALT+LEFT
+	KEY_LINE_END,	// ALT+DOWN or ALT+RIGHT
+	KEY_CLEAR_LINE,	// ALT+D
 };
 
+/* Bytes read from stdin but not decoded yet. Each `read` takes as many as
+ * are available, so a paste is decoded in one pass, and bytes after the end
+ * of a line are kept for the next one. */
+static struct {
+	unsigned char buf[4096];
+	size_t pos, len;
+	bool eof;
+} input = { 0 };
+
+// Reads more input, waiting at most TIMEOUT_MS milliseconds (forever if it's
+// negative). Returns false if none arrived.
+static bool fill_input(int32_t timeout_ms)
+{
+	if (input.eof)
+		return false;
+
+	struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+	int32_t ready;
+	while ((ready = poll(&pfd, 1, timeout_ms)) < 0 && errno == EINTR)
+		;
+	if (ready <= 0)
+		return false;
+
+	ssize_t n;
+	while ((n = read(STDIN_FILENO, input.buf, sizeof(input.buf))) < 0 && errno == EINTR)
+		;
+	if (n <= 0)
+	{
+		input.eof = true;
+		return false;
+	}
+	input.pos = 0;
+	input.len = n;
+	return true;
+}
+
+// Returns the next input byte, or -1 if none arrives within TIMEOUT_MS.
+static int32_t next_byte(int32_t timeout_ms)
+{
+	if (input.pos == input.len && !fill_input(timeout_ms))
+		return -1;
+	return input.buf[input.pos++];
+}
+
+// Decodes the rest of a CSI sequence (`ESC [ params final`).
+static enum key decode_csi(void)
+{
+	uint32_t params[2] = { 0, 0 };
+	size_t n_params = 0;
+	int32_t c;
+	while ((c = next_byte(ESC_TIMEOUT_MS)) >= 0 && (c < 0x40 || c > 0x7e))
+	{
+		if (c >= '0' && c <= '9' && n_params < 2)
+			params[n_params] = params[n_params]*10 + (c - '0');
+		else if (c == ';')
+			++n_params;
+	}
+
+	// `ESC [ 1 ; 3 A` is ALT+UP; other modifiers are taken as no modifier
+	const bool alt = n_params == 1 && params[1] == 3;
+	switch (c) {
+	case 'A': return alt ? KEY_LINE_START : KEY_UP;
+	case 'B': return alt ? KEY_LINE_END : KEY_DOWN;
+	case 'C': return alt ? KEY_LINE_END : KEY_RIGHT;
+	case 'D': return alt ? KEY_LINE_START : KEY_LEFT;
+	case 'H': return KEY_LINE_START;
+	case 'F': return KEY_LINE_END;
+	default:  return KEY_NONE;
+	}
+}
+
+// Waits for and decodes the next key, storing the byte of a `KEY_CHAR` in *C.
+static enum key next_key(char *c)
+{
+	const int32_t b = next_byte(-1);
+	switch (b) {
+	case -1:
+	case 0x04:
+		return KEY_EOF;
+	case '\n':
+	case '\r':
+		return KEY_ENTER;
+	case 0x08:
+	case 0x7f:
+		return KEY_BACKSPACE;
+	case 0x1b:
+		break;
+	default:
+		*c = (char)b;
+		return KEY_CHAR;
+	}
+
+	switch (next_byte(ESC_TIMEOUT_MS)) {
+	case -1:  return KEY_ESC;
+	case '[': return decode_csi();
+	case 'O': // SS3, which some terminals send for the arrow keys
+		switch (next_byte(ESC_TIMEOUT_MS)) {
+		case 'A': return KEY_UP;
+		case 'B': return KEY_DOWN;
+		case 'C': return KEY_RIGHT;
+		case 'D': return KEY_LEFT;
+		default:  return KEY_NONE;
+		}
+	case 'b': return KEY_LINE_START;
+	case 'f': return KEY_LINE_END;
+	case 'd': return KEY_CLEAR_LINE;
+	default:  return KEY_NONE;
+	}
+}
+
 /*static constexpr size_t HIST_MAX_LEN = 40;
 static char *hist_storage[HIST_MAX_LEN] = {nullptr};
 static size_t hist_in_use = 0;*/
 
+/* The line being edited, kept as a gap buffer: the text before the cursor is
+ * at the start of BUF and the text after it at the end, so typing or deleting
+ * at the cursor doesn't move the rest of the line. */
+struct line_editor {
+	char buf[LINE_MAX_LEN];
+	size_t gap_start, gap_end;
+};
+
+// Moves the gap (and so the cursor) to TO, which must be within the line.
+static void editor_move(struct line_editor *ed, size_t to)
+{
+	if (to < ed->gap_start)
+	{
+		const size_t n = ed->gap_start - to;
+		memmove(ed->buf + ed->gap_end - n, ed->buf + to, n);
+		ed->gap_start -= n;
+		ed->gap_end -= n;
+	} else if (to > ed->gap_start)
+	{
+		const size_t n = to - ed->gap_start;
+		if (n > LINE_MAX_LEN - ed->gap_end)
+			return;
+		memmove(ed->buf + ed->gap_start, ed->buf + ed->gap_end, n);
+		ed->gap_start += n;
+		ed->gap_end += n;
+	}
+}
+
+static void redraw(const struct line_editor *ed, bool is_block_cursor)
+{
+	fputs("\r" PROMPT_STR "\x1b[K", stdout);
+	fwrite(ed->buf, 1, ed->gap_start, stdout);
+	fwrite(ed->buf + ed->gap_end, 1, LINE_MAX_LEN - ed->gap_end, stdout);
+	fprintf(stdout, "\x1b[%dG%s",
+			(int)(sizeof(PROMPT_STR) + ed->gap_start),
+			(is_block_cursor) ? "\x1b[1 q" : "\x1b[5 q");
+	fflush(stdout);
+}
 
+/* Reads a line of at most LEN-1 bytes into OUT. Returns the number of bytes
+ * written including the NUL, -1 on CTRL+D (or the end of stdin) at the start
+ * of a line, or -2 if the line was dropped with CTRL+D. */
 ssize_t get_prompt_line(char *out, size_t len)
 {
-	char *cursor = out;
+	static struct line_editor ed;
+	ed.gap_start = 0;
+	ed.gap_end = LINE_MAX_LEN;
+	const size_t max_len = (len - 1 < LINE_MAX_LEN) ? len - 1 : LINE_MAX_LEN;
 
-	uint64_t c = 0;
 	bool needs_update = false;
 	bool is_block_cursor = false;
-	//size_t cur_hist_index = hist_in_use;
-
-	while ((size_t)(cursor - out) < len)
+	for (;;)
 	{
-		if (read(STDIN_FILENO, &c, sizeof(c)) > 0)
-		{
-			switch (c) {
-			case KC_ESC:
-				is_block_cursor = true;
-				needs_update = true;
-				break;
-			case KC_EOF:
-				if (cursor == out)
-					return -1;
-				return -2;
-			case '\n':
-				goto break_prompt_line_loop;
-				break;
-			case KC_ALT_UP_ARROW:
-			case KC_ALT_LEFT_ARROW:
-				cursor = out;
-				is_block_cursor = true;
-				needs_update = true;
-				break;
-			case KC_ALT_DOWN_ARROW:
-			case KC_ALT_RIGHT_ARROW:
-				cursor = strchr(out, '\0');
-				is_block_cursor = true;
-				needs_update = true;
-				break;
-			case KC_UP_ARROW:
-			case KC_DOWN_ARROW:
-				break;
-			case KC_LEFT_ARROW:
-				if (cursor == out)
-					break;
-				--cursor;
-				is_block_cursor = true;
-				needs_update = true;
-				break;
-			case KC_BACKSPACE:
-			case KC_DELETE:
-				// somehow truncates the string to end where the deleted character was (maybe misplaced null terminator?)
-				if (cursor == out)
-						break;
-				memmove(cursor-1, cursor, len - (cursor - out));
-				--cursor;
-				is_block_cursor = false;
-				needs_update = true;
+		char c = '\0';
+		const size_t line_len = ed.gap_start + (LINE_MAX_LEN - ed.gap_end);
+		switch (next_key(&c)) {
+		case KEY_ENTER:
+			goto break_prompt_line_loop;
+		case KEY_EOF:
+			return (line_len == 0) ? -1 : -2;
+		case KEY_ESC:
+			is_block_cursor = true;
+			needs_update = true;
+			break;
+		case KEY_LINE_START:
+			editor_move(&ed, 0);
+			is_block_cursor = true;
+			needs_update = true;
+			break;
+		case KEY_LINE_END:
+			editor_move(&ed, line_len);
+			is_block_cursor = true;
+			needs_update = true;
+			break;
+		case KEY_LEFT:
+			if (ed.gap_start == 0)
 				break;
-			case KC_ALT_D:
-				*out = '\0';
-				cursor = out;
-				is_block_cursor = false;
-				needs_update = true;
+			editor_move(&ed, ed.gap_start - 1);
+			is_block_cursor = true;
+			needs_update = true;
+			break;
+		case KEY_RIGHT:
+			if (ed.gap_end == LINE_MAX_LEN)
 				break;
-			case KC_RIGHT_ARROW:
-				if (!cursor[0] && !cursor[1])
-					break;
-				is_block_cursor = true;
-				++cursor;
-				needs_update = true;
+			editor_move(&ed, ed.gap_start + 1);
+			is_block_cursor = true;
+			needs_update = true;
+			break;
+		case KEY_BACKSPACE:
+			if (ed.gap_start == 0)
 				break;
-			default:
-				// somehow truncates the string to end just after the inserted character (maybe misplaced null terminator?)
-				memmove(cursor+1, cursor, len - (cursor - out) - 1);
-				*cursor++ = c;
-				is_block_cursor = false;
-				needs_update = true;
+			--ed.gap_start;
+			is_block_cursor = false;
+			needs_update = true;
+			break;
+		case KEY_CLEAR_LINE:
+			ed.gap_start = 0;
+			ed.gap_end = LINE_MAX_LEN;
+			is_block_cursor = false;
+			needs_update = true;
+			break;
+		case KEY_CHAR:
+			if (line_len == max_len)
 				break;
-			}
-			c = 0;
+			ed.buf[ed.gap_start++] = c;
+			is_block_cursor = false;
+			needs_update = true;
+			break;
+		case KEY_UP:
+		case KEY_DOWN:
+		case KEY_NONE:
+			break;
 		}
 
-		if (needs_update)
+		// the rest of a paste is already buffered, so draw the line once
+		// after all of it rather than once per key
+		if (needs_update && input.pos == input.len)
 		{
-			//fprintf(stderr, "\n[debug] text from cursor: '%s'\n", cursor);
-			//fprintf(stderr, "[debug] text from out: '%s'\n", out);
-			fprintf(stdout, "\r%s\x1b[K%s\x1b[%dG%s",
-					PROMPT_STR,
-					out, (int)(5+(cursor-out)), (is_block_cursor)
-						? "\x1b[1 q"
-						: "\x1b[5 q");
-			fflush(stdout);
+			redraw(&ed, is_block_cursor);
 			needs_update = false;
 		}
 	}
 break_prompt_line_loop:
-	*cursor++ = '\0';
+	if (needs_update)
+		redraw(&ed, is_block_cursor);
+	editor_move(&ed, ed.gap_start + (LINE_MAX_LEN - ed.gap_end));
+	memcpy(out, ed.buf, ed.gap_start);
+	out[ed.gap_start] = '\0';
 
-	return cursor - out;
+	return ed.gap_start + 1;
 }
 
-constexpr size_t LINE_MAX_LEN = 4096;
+
+/* A definition (`NAME = ...`) entered at the prompt, keyed on its text.
+ * Entering the same text again reuses it instead of evaluating it, as long
+ * as NAME wasn't set to something else since. */
+struct prompt_def {
+	char *src;	// the statement without surrounding whitespace; the key
+	const MML_expr *value;	// what NAME was set to
+	MML_expr ident;	// NAME, to evaluate
+};
+
+static int32_t free_def(const void *, size_t, uintptr_t value, void *)
+{
+	struct prompt_def *def = (struct prompt_def *)value;
+	free(def->src);
+	free(def);
+	return 0;
+}
+
+static void remember_def(hashmap *defs, const MML_expr *stmt, const char *src, size_t len)
+{
+	struct prompt_def *def;
+	if (!hashmap_get(defs, src, len, (uintptr_t *)&def))
+	{
+		if ((def = calloc(1, sizeof(*def))) == NULL)
+			return;
+		if ((def->src = malloc(len)) == NULL)
+		{
+			free(def);
+			return;
+		}
+		memcpy(def->src, src, len);
+		if (hashmap_set(defs, def->src, len, (uintptr_t)def) < 0)
+		{
+			free_def(NULL, 0, (uintptr_t)def, NULL);
+			return;
+		}
+	}
+	// the name lives in the tree, which is never freed
+	def->value = stmt->o.right;
+	def->ident = (MML_expr) { Identifier_type, .s = stmt->o.left->s };
+}
+
+// If SRC is the text of a definition whose value is still in effect,
+// returns that definition.
+static const struct prompt_def *find_unchanged_def(MML_state *state, hashmap *defs,
+		const char *src, size_t len)
+{
+	const struct prompt_def *def;
+	if (!hashmap_get(defs, src, len, (uintptr_t *)&def)
+	 || MML_eval_get_variable(state, def->ident.s) != def->value)
+		return NULL;
+	return def;
+}
+
+static bool is_space(char c)
+{
+	return c != '\0' && strchr(" \t\n\v\f\r", c) != NULL;
+}
+
+/* Evaluates the statements of LINE one at a time, so a definition that
+ * hasn't changed since it was last entered isn't evaluated again, and only
+ * what reads a changed one is recomputed. The parser decides where each
+ * statement ends, as it does for `MML_parse_stmts`. */
+static MML_value run_line(MML_state *state, hashmap *defs, const char *line,
+		uint64_t *parse_nsecs, uint64_t *eval_nsecs)
+{
+	MML_value cur_val = VAL_INVAL;
+	struct parser_state parser = { 0 };
+	const char *s = line;
+	bool has_more = true;
+	while (has_more)
+	{
+		const char *start = s;
+		MML_expr *expr;
+		uint64_t nsecs;
+		time_blck(&nsecs, expr = MML_parse_next_stmt(&s, &parser, &has_more));
+		*parse_nsecs += nsecs;
+		if (expr == NULL)
+			continue;
+
+		// the statement's text, without the `;` that ended it
+		const char *end = (has_more) ? s - 1 : start + strlen(start);
+		while (is_space(*start))
+			++start;
+		while (end > start && is_space(end[-1]))
+			--end;
+		const size_t len = end - start;
+
+		const struct prompt_def *def = find_unchanged_def(state, defs, start, len);
+		time_blck(&nsecs, cur_val = MML_eval_expr(state, (def != NULL) ? &def->ident : expr));
+		*eval_nsecs += nsecs;
+
+		if (def == NULL && expr->type == Operation_type && expr->o.op == MML_OP_ASSERT_EQUAL
+		 && expr->o.left != NULL && expr->o.left->type == Identifier_type
+		 && MML_eval_get_variable(state, expr->o.left->s) == expr->o.right)
+			remember_def(defs, expr, start, len);
+	}
+
+	return cur_val;
+}
 
 void MML_run_prompt(MML_state *state)
 {
 	MML_term_set_raw_mode();
 
+	// definitions reuse their values until something they read is redefined
+	const bool had_memo = state->memo != NULL;
+	MML_eval_set_memoize(state, true);
+	hashmap *defs = hashmap_create();
+
 	char line_in[LINE_MAX_LEN+1] = {0};
 
 	MML_value cur_val = VAL_INVAL;
@@ -163,8 +418,7 @@ void MML_run_prompt(MML_state *state)
 		printf("%s", PROMPT_STR);
 		fflush(stdout);
 
-		memset(line_in, '\0', (n_read>0) ? (size_t)n_read : LINE_MAX_LEN);
-		n_read = get_prompt_line(line_in, LINE_MAX_LEN);
+		n_read = get_prompt_line(line_in, sizeof(line_in));
 		puts("");
 		if (n_read == -1)
 			break;
@@ -174,32 +428,15 @@ void MML_run_prompt(MML_state *state)
 		//printf("buf: '%s'\n", line_in);
 	#endif
 
-		uint64_t nsecs;
-		MML_expr_dvec exprs;
-		if (!FLAG_IS_SET(DBG_TIME))
-			exprs = MML_parse_stmts(line_in);
-		else {
-			time_blck(&nsecs, exprs = MML_parse_stmts(line_in));
-			MML_log_dbg("parsed in %.6fs\n", (double)nsecs/NSEC_IN_SEC);
-		}
-
-		MML_expr **cur;
-		if (!FLAG_IS_SET(DBG_TIME))
-		{
-			dv_foreach(exprs, cur)
-				if (*cur != NULL)
-					cur_val = MML_eval_expr(state, *cur);
-		} else
+		uint64_t parse_nsecs = 0, eval_nsecs = 0;
+		cur_val = run_line(state, defs, line_in, &parse_nsecs, &eval_nsecs);
+		if (FLAG_IS_SET(DBG_TIME))
 		{
-			time_blck(&nsecs, 
-			dv_foreach(exprs, cur)
-			{
-				if (*cur != NULL)
-					cur_val = MML_eval_expr(state, *cur);
-			});
-			MML_log_dbg("evaluated in %.6fs\n", (double)nsecs/NSEC_IN_SEC);
+			MML_log_dbg("parsed in %.6fs\n", (double)parse_nsecs/NSEC_IN_SEC);
+			MML_log_dbg("evaluated in %.6fs\n", (double)eval_nsecs/NSEC_IN_SEC);
 		}
 
+		MML_outbuf_flush(&state->out);
 		if (!state->config->last_print_was_newline)
 			puts("\033[7m%\033[0m");
 		state->config->last_print_was_newline = true;
@@ -219,8 +456,7 @@ void MML_run_prompt(MML_state *state)
 			}
 		}
 
-		dv_destroy(exprs);
-
+		MML_outbuf_flush(&state->out);
 		fflush(stdout);
 		fflush(stderr);
 	}
@@ -228,5 +464,10 @@ void MML_run_prompt(MML_state *state)
 	/*for (size_t i = 0; i < hist_in_use; ++i)
 		free(hist_storage[i]);*/
 
+	hashmap_iterate(defs, free_def, NULL);
+	hashmap_free(defs);
+	if (!had_memo)
+		MML_eval_set_memoize(state, false);
+
 	MML_term_restore();
 }
@@ -0,0 +1,159 @@
+// getline
+#define _GNU_SOURCE
+#include "mml/records.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mml/config.h"
+#include "mml/eval.h"
+#include "mml/number.h"
+
+#define MAX_INPUTS 64
+
+static bool is_assignment(const MML_expr *stmt)
+{
+	return stmt != NULL && stmt->type == Operation_type
+		&& stmt->o.op == MML_OP_ASSERT_EQUAL;
+}
+
+static void print_record(MML_state *state, MML_expr_vec *outs)
+{
+	if (state->config->output_format != MML_OUTPUT_TEXT)
+	{
+		const MML_value record = { Vector_type, .v = *outs };
+		MML_println_typedval(state, &record);
+		return;
+	}
+
+	for (size_t i = 0; i < outs->n; ++i)
+	{
+		const MML_value val = { outs->ptr[i]->type, .w = outs->ptr[i]->w };
+		if (i != 0)
+			MML_outbuf_write(&state->out, ", ", 2);
+		MML_print_typedval(state, &val);
+	}
+	MML_outbuf_putc(&state->out, '\n');
+}
+
+int32_t MML_stream_records(MML_state *restrict state, const char *src,
+		const char *const *input_names, FILE *stream)
+{
+	size_t n_inputs = 0;
+	while (input_names[n_inputs] != NULL)
+		++n_inputs;
+	if (n_inputs > MAX_INPUTS)
+	{
+		MML_log_err("record streams take at most %d inputs, not %zu\n", MAX_INPUTS, n_inputs);
+		return -1;
+	}
+
+	MML_prepared *p = MML_compile(state, src, input_names);
+	if (p == NULL)
+		return -1;
+
+	double inputs[MAX_INPUTS];
+	double prev[MAX_INPUTS];
+	memset(prev, 0xff, sizeof(prev));
+	for (size_t i = 0; i < n_inputs; ++i)
+		MML_prepared_bind(p, i, &inputs[i]);
+
+	// the outputs are the statements that aren't assignments; each keeps its
+	// value until one of its inputs changes
+	const size_t n_stmts = MML_prepared_n_stmts(p);
+	size_t *out_stmts __attribute__((cleanup(MML_free_pp)))
+		= malloc(n_stmts * sizeof(size_t));
+	MML_value *vals __attribute__((cleanup(MML_free_pp)))
+		= malloc(n_stmts * sizeof(MML_value));
+	MML_expr *out_exprs __attribute__((cleanup(MML_free_pp)))
+		= malloc(n_stmts * sizeof(MML_expr));
+	MML_expr **out_ptrs __attribute__((cleanup(MML_free_pp)))
+		= malloc(n_stmts * sizeof(MML_expr *));
+	if ((out_stmts == NULL || vals == NULL || out_exprs == NULL || out_ptrs == NULL)
+	 && n_stmts != 0)
+	{
+		MML_log_err("failed to allocate %zu record outputs\n", n_stmts);
+		MML_prepared_free(p);
+		return -1;
+	}
+	MML_expr_vec outs = { out_ptrs, 0, NULL };
+	for (size_t i = 0; i < n_stmts; ++i)
+		if (!is_assignment(MML_prepared_stmt(p, i)))
+		{
+			out_ptrs[outs.n] = &out_exprs[outs.n];
+			out_stmts[outs.n++] = i;
+		}
+
+	// the values a record makes are made again for the next one, so they go
+	// in an arena that is reset between records; statements with a vector
+	// value are evaluated every time, as their elements live there too.
+	// The cache of variable values keeps values across records, so with it
+	// they stay in `MML_global_arena`
+	Arena *record_arena = NULL;
+	if (state->memo == NULL)
+	{
+		record_arena = arena_make(8192);
+		state->arena = record_arena;
+	}
+
+	char *line __attribute__((cleanup(MML_free_pp))) = NULL;
+	size_t line_cap = 0;
+	ssize_t line_len;
+	size_t line_n = 0;
+	bool first = true;
+	while ((line_len = getline(&line, &line_cap, stream)) >= 0)
+	{
+		++line_n;
+		const int64_t n_fields = MML_parse_doubles(line, line + line_len, inputs, n_inputs);
+		if (n_fields == 0)
+			continue;
+		if (n_fields != (int64_t)n_inputs)
+		{
+			if (n_fields < 0)
+				MML_log_err("record %zu: malformed number\n", line_n);
+			else
+				MML_log_err("record %zu: expected %zu fields, got %" PRId64 "\n",
+						line_n, n_inputs, n_fields);
+			// the inputs may be half overwritten, so compare them all again
+			memset(prev, 0xff, sizeof(prev));
+			continue;
+		}
+
+		uint64_t changed = 0;
+		for (size_t i = 0; i < n_inputs; ++i)
+			if (memcmp(&inputs[i], &prev[i], sizeof(double)) != 0)
+				changed |= 1ull << i;
+		memcpy(prev, inputs, n_inputs * sizeof(double));
+
+		if (record_arena != NULL)
+			arena_reset(record_arena);
+		for (size_t i = 0; i < n_stmts; ++i)
+			if (first || (MML_prepared_deps(p, i) & changed) != 0
+			 || (record_arena != NULL && vals[i].type == Vector_type))
+				vals[i] = MML_call_stmt(p, i, NULL);
+		first = false;
+
+		for (size_t i = 0; i < outs.n; ++i)
+		{
+			out_exprs[i].type = vals[out_stmts[i]].type;
+			out_exprs[i].w = vals[out_stmts[i]].w;
+		}
+		print_record(state, &outs);
+	}
+	MML_outbuf_flush(&state->out);
+
+	if (record_arena != NULL)
+	{
+		state->arena = NULL;
+		state->last_val = VAL_INVAL;
+		arena_destroy(record_arena);
+	}
+	MML_prepared_free(p);
+	if (ferror(stream))
+	{
+		MML_log_err("failed to read records\n");
+		return -1;
+	}
+	return 0;
+}
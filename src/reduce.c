@@ -0,0 +1,131 @@
+#include "mml/reduce.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mml/config.h"
+
+typedef struct partial {
+	double sum;
+	double comp;
+} partial;
+
+// Neumaier's variant of Kahan summation; COMP collects the low-order bits
+// lost when adding X to SUM.
+static inline void neumaier_add(partial *p, double x)
+{
+	const double t = p->sum + x;
+	if (fabs(p->sum) >= fabs(x))
+		p->comp += (p->sum - t) + x;
+	else
+		p->comp += (x - t) + p->sum;
+	p->sum = t;
+}
+
+static partial sum_block(const double *xs, size_t n, bool compensated)
+{
+	partial p = { 0.0, 0.0 };
+	if (compensated)
+	{
+		for (size_t i = 0; i < n; ++i)
+			neumaier_add(&p, xs[i]);
+	} else
+	{
+		for (size_t i = 0; i < n; ++i)
+			p.sum += xs[i];
+	}
+	return p;
+}
+
+static inline partial combine(partial a, partial b, bool compensated)
+{
+	if (!compensated)
+		return (partial) { a.sum + b.sum, 0.0 };
+
+	neumaier_add(&a, b.sum);
+	a.comp += b.comp;
+	return a;
+}
+
+struct block_job {
+	const double *xs;
+	size_t n;
+	partial *out;
+	size_t first_block;
+	size_t n_blocks;
+	size_t stride;
+	bool compensated;
+};
+
+static void *sum_blocks_worker(void *arg)
+{
+	const struct block_job *job = arg;
+	for (size_t b = job->first_block; b < job->n_blocks; b += job->stride)
+	{
+		const size_t start = b * MML_REDUCE_BLOCK;
+		const size_t len = (job->n - start < MML_REDUCE_BLOCK)
+			? job->n - start
+			: MML_REDUCE_BLOCK;
+		job->out[b] = sum_block(job->xs + start, len, job->compensated);
+	}
+	return NULL;
+}
+
+double MML_reduce_sum(const double *restrict xs, size_t n, const MML_reduce_opts *opts)
+{
+	const bool compensated = opts != NULL && opts->compensated;
+	uint32_t threads = (opts != NULL) ? opts->threads : 1;
+
+	if (n <= MML_REDUCE_BLOCK)
+	{
+		const partial p = sum_block(xs, n, compensated);
+		return p.sum + p.comp;
+	}
+
+	const size_t n_blocks = (n + MML_REDUCE_BLOCK - 1) / MML_REDUCE_BLOCK;
+	partial *parts = malloc(n_blocks * sizeof(partial));
+	if (parts == NULL)
+	{
+		MML_log_err("failed to allocate %zu partial sums for reduction\n", n_blocks);
+		return NAN;
+	}
+
+	if (n < MML_REDUCE_PARALLEL_MIN || threads < 2)
+		threads = 1;
+	if (threads > MML_REDUCE_MAX_THREADS)
+		threads = MML_REDUCE_MAX_THREADS;
+	if (threads > n_blocks)
+		threads = n_blocks;
+
+	// blocks are handed out round-robin; which thread sums a block has no
+	// effect on its partial sum, so the thread count can't change the result
+	struct block_job jobs[threads];
+	pthread_t tids[threads];
+	uint32_t started = 1;
+	for (uint32_t t = 0; t < threads; ++t)
+		jobs[t] = (struct block_job) {
+			xs, n, parts, t, n_blocks, threads, compensated
+		};
+	for (; started < threads; ++started)
+		if (pthread_create(&tids[started], NULL, sum_blocks_worker, &jobs[started]) != 0)
+			break;
+	// anything that failed to start is picked up on this thread
+	for (uint32_t t = started; t < threads; ++t)
+		sum_blocks_worker(&jobs[t]);
+	sum_blocks_worker(&jobs[0]);
+	for (uint32_t t = 1; t < started; ++t)
+		pthread_join(tids[t], NULL);
+
+	// fixed pairwise tree over the block partials
+	for (size_t width = 1; width < n_blocks; width *= 2)
+		for (size_t i = 0; i + width < n_blocks; i += 2*width)
+			parts[i] = combine(parts[i], parts[i + width], compensated);
+
+	const double ret = parts[0].sum + parts[0].comp;
+	free(parts);
+
+	return ret;
+}
@@ -0,0 +1,560 @@
+// accept4, open_memstream
+#define _GNU_SOURCE
+
+#include "mml/server.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "mml/config.h"
+#include "mml/eval.h"
+#include "mml/expr.h"
+#include "mml/parser.h"
+#include "arena/arena.h"
+#include "c-hashmap/map.h"
+#include "cvi/dvec/dvec.h"
+
+// parsed sources kept per connection; anything past this is parsed every time
+#define MAX_CACHED_SOURCES 4096
+#define READ_CHUNK 65536
+#define MAX_EVENTS 64
+// a connection isn't read from while this much of its output is unsent
+#define MAX_PENDING_OUT (4u << 20)
+
+typedef struct bytebuf {
+	uint8_t *p;
+	size_t len;
+	size_t cap;
+} bytebuf;
+
+static bool bytebuf_reserve(bytebuf *b, size_t extra)
+{
+	if (b->len + extra <= b->cap)
+		return true;
+
+	size_t cap = (b->cap != 0) ? b->cap : 4096;
+	while (cap < b->len + extra)
+		cap *= 2;
+
+	uint8_t *p = realloc(b->p, cap);
+	if (p == NULL)
+		return false;
+	b->p = p;
+	b->cap = cap;
+	return true;
+}
+
+typedef struct conn {
+	int32_t fd;
+	MML_state *state;
+	// a copy of the global config, so `config_set` only affects this client
+	struct MML_config config;
+
+	// the trees of cached requests and of ones that define variables (which
+	// point into them), and the sources of the cached ones
+	Arena *arena;
+	// source text -> `MML_expr_dvec *`; keys live in ARENA
+	hashmap *stmt_cache;
+	dvec_t(MML_expr_dvec *) cached;
+	// what a request makes while being answered, reset after the reply
+	Arena *results;
+	// a copy of the value of the last request (`ans`), in one of these;
+	// the other one is reset for the next copy
+	Arena *ans_arenas[2];
+	uint8_t ans_arena;
+
+	// everything the state prints while answering a request
+	FILE *capture;
+	char *capture_buf;
+	size_t capture_len;
+
+	bytebuf in;
+	size_t in_off;
+	bytebuf out;
+	size_t out_off;
+	uint32_t events;	// what the connection is registered for in epoll
+	bool peer_done;	// the client won't send anything else
+	bool quit;		// a request evaluated `exit`
+
+	struct conn *prev;
+	struct conn *next;
+} conn;
+
+// every open connection, so they can be closed on shutdown
+static conn *open_conns = NULL;
+
+static volatile sig_atomic_t serve_stop = 0;
+
+static void serve_sig_handler(int32_t signum)
+{
+	(void)signum;
+	serve_stop = 1;
+}
+
+static inline uint32_t read_le32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline void write_le32(uint8_t *p, uint32_t v)
+{
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+	p[3] = (v >> 24) & 0xff;
+}
+
+static conn *conn_open(int32_t fd)
+{
+	conn *c = calloc(1, sizeof(conn));
+	if (c == NULL)
+		return NULL;
+
+	c->fd = fd;
+	c->state = MML_init_state();
+	c->state->budget = MML_global_config.eval_state->budget;
+	c->config = MML_global_config;
+	c->config.eval_state = c->state;
+	c->state->config = &c->config;
+	c->stmt_cache = hashmap_create();
+	c->arena = arena_make(8192);
+	c->results = arena_make(8192);
+	c->ans_arenas[0] = arena_make(1024);
+	c->ans_arenas[1] = arena_make(1024);
+	c->state->arena = c->results;
+	c->capture = open_memstream(&c->capture_buf, &c->capture_len);
+	if (c->capture == NULL)
+	{
+		MML_log_err("failed to open capture stream for connection: %s\n", strerror(errno));
+		hashmap_free(c->stmt_cache);
+		MML_cleanup_state(c->state);
+		arena_destroy(c->arena);
+		arena_destroy(c->results);
+		arena_destroy(c->ans_arenas[0]);
+		arena_destroy(c->ans_arenas[1]);
+		free(c);
+		return NULL;
+	}
+	MML_outbuf_set_sink(&c->state->out, c->capture);
+
+	c->next = open_conns;
+	if (open_conns != NULL)
+		open_conns->prev = c;
+	open_conns = c;
+
+	return c;
+}
+
+static void conn_close(int32_t epfd, conn *c)
+{
+	epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+	close(c->fd);
+
+	if (c->prev != NULL)
+		c->prev->next = c->next;
+	else
+		open_conns = c->next;
+	if (c->next != NULL)
+		c->next->prev = c->prev;
+
+	MML_expr_dvec **cur;
+	dv_foreach(c->cached, cur)
+	{
+		dv_destroy(**cur);
+		free(*cur);
+	}
+	dv_destroy(c->cached);
+	hashmap_free(c->stmt_cache);
+
+	// flushes the state's output into the capture, so it goes first
+	MML_cleanup_state(c->state);
+	arena_destroy(c->arena);
+	arena_destroy(c->results);
+	arena_destroy(c->ans_arenas[0]);
+	arena_destroy(c->ans_arenas[1]);
+
+	fclose(c->capture);
+	free(c->capture_buf);
+	free(c->in.p);
+	free(c->out.p);
+	free(c);
+}
+
+static MML_expr_dvec *lookup_stmts(conn *c, const char *src, size_t len, bool *is_cached)
+{
+	MML_expr_dvec *stmts;
+	if (hashmap_get(c->stmt_cache, src, len, (uintptr_t *)&stmts))
+	{
+		*is_cached = true;
+		return stmts;
+	}
+
+	// the parser wants a NUL-terminated string, and a cached key has to
+	// outlive the request buffer anyway; the trees don't point into it
+	*is_cached = dv_n(c->cached) < MAX_CACHED_SOURCES;
+	char *src_copy = arena_alloc_T(*is_cached ? c->arena : c->results, len + 1, char);
+	memcpy(src_copy, src, len);
+	src_copy[len] = '\0';
+
+	stmts = malloc(sizeof(MML_expr_dvec));
+	if (stmts == NULL)
+		return NULL;
+	// trees that are neither cached nor pointed to by a variable only have
+	// to last until the reply
+	*stmts = MML_parse_stmts_in(*is_cached ? c->arena : c->results, src_copy, false);
+	if (!*is_cached && MML_stmts_assign(stmts))
+	{
+		dv_destroy(*stmts);
+		*stmts = MML_parse_stmts_in(c->arena, src_copy, false);
+	}
+
+	if (*is_cached)
+	{
+		hashmap_set(c->stmt_cache, src_copy, len, (uintptr_t)stmts);
+		dv_push(c->cached, stmts);
+	}
+
+	return stmts;
+}
+
+// Copies the vectors in VAL (which may be in `conn.results`) to ARENA. The
+// elements that aren't values yet point into the trees of the connection,
+// which stay.
+static MML_value copy_value(Arena *arena, MML_value val)
+{
+	if (val.type != Vector_type)
+		return val;
+
+	MML_expr_vec v = val.v;
+	if (v.packed != NULL)
+	{
+		double *packed = arena_alloc_T(arena, v.n, double);
+		memcpy(packed, v.packed, v.n * sizeof(double));
+		v.packed = packed;
+		return (MML_value) { Vector_type, .v = v };
+	}
+
+	v.ptr = arena_alloc_T(arena, v.n, MML_expr *);
+	MML_expr *data = arena_alloc_T(arena, v.n, MML_expr);
+	for (size_t i = 0; i < v.n; ++i)
+	{
+		const MML_value elem = copy_value(arena,
+				(MML_value) { val.v.ptr[i]->type, .w = val.v.ptr[i]->w });
+		data[i].type = elem.type;
+		data[i].w = elem.w;
+		v.ptr[i] = &data[i];
+	}
+	return (MML_value) { Vector_type, .v = v };
+}
+
+static bool handle_request(conn *c, const char *src, size_t len)
+{
+	bool is_cached;
+	MML_expr_dvec *stmts = lookup_stmts(c, src, len, &is_cached);
+	if (stmts == NULL)
+		return false;
+
+	MML_value val = VAL_INVAL;
+	MML_expr **cur;
+	dv_foreach(*stmts, cur)
+		if (*cur != NULL)
+			val = MML_eval_expr(c->state, *cur);
+
+	uint8_t status = MML_SERVE_OK;
+	if (VAL_IS_ABORT(val))
+		status = MML_SERVE_STOPPED;
+	else if (val.type == Invalid_type)
+		status = MML_SERVE_INVALID;
+	else
+	{
+		MML_println_typedval(c->state, &val);
+		// the value may be in `c->results` (or be the last copy)
+		c->ans_arena ^= 1;
+		arena_reset(c->ans_arenas[c->ans_arena]);
+		c->state->last_val = copy_value(c->ans_arenas[c->ans_arena], val);
+	}
+
+	if (val.type == Invalid_type && val.i == MML_QUIT_INVAL)
+		c->quit = true;
+
+	if (!is_cached)
+	{
+		dv_destroy(*stmts);
+		free(stmts);
+	}
+
+	MML_outbuf_flush(&c->state->out);
+	size_t text_len = c->capture_len;
+	if (text_len > MML_SERVE_MAX_REPLY)
+	{
+		status = MML_SERVE_TOO_LONG;
+		text_len = 0;
+	}
+	if (!bytebuf_reserve(&c->out, 5 + text_len))
+		return false;
+
+	write_le32(c->out.p + c->out.len, (uint32_t)(1 + text_len));
+	c->out.p[c->out.len + 4] = status;
+	memcpy(c->out.p + c->out.len + 5, c->capture_buf, text_len);
+	c->out.len += 5 + text_len;
+
+	// start the next request with an empty capture and no values
+	fseeko(c->capture, 0, SEEK_SET);
+	c->capture_len = 0;
+	arena_reset(c->results);
+
+	return true;
+}
+
+static void update_events(int32_t epfd, conn *c)
+{
+	uint32_t events = 0;
+	if (!c->peer_done && !c->quit && c->out.len - c->out_off < MAX_PENDING_OUT)
+		events |= EPOLLIN | EPOLLRDHUP;
+	if (c->out_off < c->out.len)
+		events |= EPOLLOUT;
+
+	if (events == c->events)
+		return;
+
+	struct epoll_event ev = { .events = events, .data.ptr = c };
+	epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+	c->events = events;
+}
+
+// Returns false if the connection broke.
+static bool flush_out(int32_t epfd, conn *c)
+{
+	while (c->out_off < c->out.len)
+	{
+		const ssize_t n = send(c->fd, c->out.p + c->out_off,
+				c->out.len - c->out_off, MSG_NOSIGNAL);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			return false;
+		}
+		c->out_off += (size_t)n;
+	}
+
+	if (c->out_off == c->out.len)
+		c->out.len = c->out_off = 0;
+	update_events(epfd, c);
+	return true;
+}
+
+// Answers every complete request in `c->in` and keeps only the unfinished
+// one. Returns false if the connection should be closed.
+static bool handle_requests(conn *c)
+{
+	while (!c->quit && c->in.len - c->in_off >= 4)
+	{
+		// checked as soon as it arrives, so a client can't make the
+		// buffer grow past one request
+		const uint32_t req_len = read_le32(c->in.p + c->in_off);
+		if (req_len > MML_SERVE_MAX_REQUEST)
+		{
+			MML_log_warn("closing connection that sent a %" PRIu32 "-byte request\n", req_len);
+			return false;
+		}
+		if (c->in.len - c->in_off - 4 < req_len)
+			break;
+
+		if (!handle_request(c, (const char *)c->in.p + c->in_off + 4, req_len))
+			return false;
+		c->in_off += 4 + req_len;
+	}
+
+	memmove(c->in.p, c->in.p + c->in_off, c->in.len - c->in_off);
+	c->in.len -= c->in_off;
+	c->in_off = 0;
+
+	return true;
+}
+
+// Returns false if the connection should be closed.
+static bool handle_readable(conn *c)
+{
+	// a client that doesn't read its replies isn't read from either
+	while (!c->quit && c->out.len - c->out_off < MAX_PENDING_OUT)
+	{
+		if (!bytebuf_reserve(&c->in, READ_CHUNK))
+			return false;
+
+		const ssize_t n = read(c->fd, c->in.p + c->in.len, READ_CHUNK);
+		if (n == 0)
+		{
+			c->peer_done = true;
+			break;
+		}
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			return false;
+		}
+		c->in.len += (size_t)n;
+
+		if (!handle_requests(c))
+			return false;
+	}
+
+	return true;
+}
+
+static int32_t open_listener(const char *socket_path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	if (strlen(socket_path) >= sizeof(addr.sun_path))
+	{
+		MML_log_err("socket path is too long: '%s'\n", socket_path);
+		return -1;
+	}
+	strcpy(addr.sun_path, socket_path);
+
+	struct stat st;
+	if (lstat(socket_path, &st) == 0)
+	{
+		if (!S_ISSOCK(st.st_mode))
+		{
+			MML_log_err("refusing to replace '%s', which is not a socket\n", socket_path);
+			return -1;
+		}
+		unlink(socket_path);
+	}
+
+	const int32_t fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+	{
+		MML_log_err("failed to create socket: %s\n", strerror(errno));
+		return -1;
+	}
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+	 || listen(fd, SOMAXCONN) < 0)
+	{
+		MML_log_err("failed to listen on '%s': %s\n", socket_path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static void accept_all(int32_t epfd, int32_t listen_fd)
+{
+	for (;;)
+	{
+		const int32_t fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				MML_log_warn("accept failed: %s\n", strerror(errno));
+			return;
+		}
+
+		conn *c = conn_open(fd);
+		if (c == NULL)
+		{
+			close(fd);
+			continue;
+		}
+
+		c->events = EPOLLIN | EPOLLRDHUP;
+		struct epoll_event ev = { .events = c->events, .data.ptr = c };
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+			conn_close(epfd, c);
+	}
+}
+
+int32_t MML_serve(const char *socket_path)
+{
+	const int32_t listen_fd = open_listener(socket_path);
+	if (listen_fd < 0)
+		return -1;
+
+	const int32_t epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd < 0)
+	{
+		MML_log_err("epoll_create1 failed: %s\n", strerror(errno));
+		close(listen_fd);
+		unlink(socket_path);
+		return -1;
+	}
+
+	// the listening socket is the only entry without a connection
+	struct epoll_event listen_ev = { .events = EPOLLIN, .data.ptr = NULL };
+	epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &listen_ev);
+
+	// the signals are blocked except while waiting, so one that arrives
+	// between checking `serve_stop` and waiting still wakes up the wait
+	struct sigaction sa = { .sa_handler = serve_sig_handler };
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sigset_t stop_signals, old_mask, wait_mask;
+	sigemptyset(&stop_signals);
+	sigaddset(&stop_signals, SIGINT);
+	sigaddset(&stop_signals, SIGTERM);
+	sigprocmask(SIG_BLOCK, &stop_signals, &old_mask);
+	wait_mask = old_mask;
+	sigdelset(&wait_mask, SIGINT);
+	sigdelset(&wait_mask, SIGTERM);
+
+	struct epoll_event events[MAX_EVENTS];
+	while (!serve_stop)
+	{
+		const int32_t n = epoll_pwait(epfd, events, MAX_EVENTS, -1, &wait_mask);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			MML_log_err("epoll_pwait failed: %s\n", strerror(errno));
+			break;
+		}
+
+		for (int32_t i = 0; i < n; ++i)
+		{
+			conn *c = events[i].data.ptr;
+			if (c == NULL)
+			{
+				accept_all(epfd, listen_fd);
+				continue;
+			}
+
+			bool ok = (events[i].events & EPOLLERR) == 0;
+			if (ok && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)))
+				ok = handle_readable(c);
+			if (ok)
+				ok = flush_out(epfd, c);
+			// answer everything that was sent before the client hung up
+			if (!ok || ((c->peer_done || c->quit) && c->out.len == 0))
+				conn_close(epfd, c);
+		}
+	}
+
+	sigprocmask(SIG_SETMASK, &old_mask, NULL);
+
+	while (open_conns != NULL)
+		conn_close(epfd, open_conns);
+	close(epfd);
+	close(listen_fd);
+	unlink(socket_path);
+
+	return 0;
+}
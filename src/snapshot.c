@@ -0,0 +1,313 @@
+#include "mml/snapshot.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "mml/config.h"
+#include "mml/eval.h"
+#include "mml/parser.h"
+#include "cvi/dvec/dvec.h"
+#include "c-hashmap/map.h"
+
+#define BYTE_ORDER_MARK 0x01020304u
+
+struct snapshot_writer {
+	char *buf;
+	size_t len, cap;
+	dvec_t(uint64_t) relocs;
+
+	// the pointer fields of the nodes `MML_expr_walk` is still to visit,
+	// in the order it visits them (last first)
+	uint64_t *fields;
+	size_t n_fields, fields_cap;
+	// the symbol's `expr_off` the root of the tree being written goes to
+	uint64_t root_at;
+
+	bool failed;
+};
+
+// Returns the offset of SIZE zeroed bytes at the end of the file.
+static uint64_t alloc_bytes(struct snapshot_writer *w, size_t size)
+{
+	const size_t off = w->len;
+	const size_t new_len = off + ((size + 7) & ~(size_t)7);
+	if (new_len > w->cap)
+	{
+		size_t cap = (w->cap != 0) ? w->cap : 4096;
+		while (cap < new_len)
+			cap *= 2;
+		char *buf = realloc(w->buf, cap);
+		if (buf == NULL)
+		{
+			w->failed = true;
+			return 0;
+		}
+		w->buf = buf;
+		w->cap = cap;
+	}
+	memset(w->buf + off, 0, new_len - off);
+	w->len = new_len;
+	return off;
+}
+
+// Makes the pointer field at AT point to the offset TARGET.
+static void set_ptr(struct snapshot_writer *w, uint64_t at, uint64_t target)
+{
+	const uintptr_t p = (uintptr_t)MML_SNAPSHOT_BASE + target;
+	memcpy(w->buf + at, &p, sizeof(p));
+	dv_push(w->relocs, at);
+}
+
+static void push_field(struct snapshot_writer *w, uint64_t at)
+{
+	if (w->n_fields == w->fields_cap)
+	{
+		const size_t cap = (w->fields_cap != 0) ? w->fields_cap * 2 : 64;
+		uint64_t *p = realloc(w->fields, cap * sizeof(*p));
+		if (p == NULL)
+		{
+			w->failed = true;
+			return;
+		}
+		w->fields = p;
+		w->fields_cap = cap;
+	}
+	w->fields[w->n_fields++] = at;
+}
+
+// Writes EXPR to the field its parent pushed for it (or to the symbol, for
+// the root), and pushes the fields of its children in the order the walk
+// visits them.
+static bool write_node(const MML_expr *expr, const MML_expr *parent, void *usr)
+{
+	struct snapshot_writer *w = usr;
+	const uint64_t at = (parent != NULL) ? w->fields[--w->n_fields] : w->root_at;
+	if (expr == NULL)
+		return true;
+	if (expr->type == Slot_type)
+	{
+		MML_log_err("can't write a parameter of a prepared expression to a snapshot\n");
+		w->failed = true;
+		return false;
+	}
+
+	const uint64_t off = alloc_bytes(w, sizeof(MML_expr));
+	if (w->failed)
+		return false;
+	if (parent == NULL)
+		memcpy(w->buf + at, &off, sizeof(off));
+	else
+		set_ptr(w, at, off);
+	memcpy(w->buf + off, expr, sizeof(MML_expr));
+
+	// the pointer fields are zeroed, then set once their targets exist
+	MML_expr *node = (MML_expr *)(w->buf + off);
+	switch (expr->type) {
+	case Operation_type:
+		node->o.left = node->o.right = NULL;
+		push_field(w, off + offsetof(MML_expr, o.right));
+		push_field(w, off + offsetof(MML_expr, o.left));
+		break;
+	case Identifier_type:
+		node->s.s = NULL;
+		const uint64_t s_off = alloc_bytes(w, expr->s.len + 1);
+		if (w->failed)
+			return false;
+		memcpy(w->buf + s_off, expr->s.s, expr->s.len);
+		set_ptr(w, off + offsetof(MML_expr, s.s), s_off);
+		break;
+	case Vector_type:
+		node->v.ptr = NULL;
+		node->v.packed = NULL;
+		const uint64_t arr_off = alloc_bytes(w, expr->v.n * sizeof(double));
+		if (w->failed)
+			return false;
+		if (expr->v.packed != NULL)
+		{
+			memcpy(w->buf + arr_off, expr->v.packed, expr->v.n * sizeof(double));
+			set_ptr(w, off + offsetof(MML_expr, v.packed), arr_off);
+			break;
+		}
+		set_ptr(w, off + offsetof(MML_expr, v.ptr), arr_off);
+		for (size_t i = expr->v.n; i-- != 0; )
+			push_field(w, arr_off + i*sizeof(MML_expr *));
+		break;
+	default:
+		break;
+	}
+	return !w->failed;
+}
+
+struct symbol_list {
+	strbuf *names;
+	const MML_expr **exprs;
+	size_t n;
+};
+
+static int32_t collect_symbol(const void *name, size_t name_len, uintptr_t value, void *usr)
+{
+	struct symbol_list *syms = usr;
+	syms->names[syms->n] = (strbuf) { (char *)name, name_len };
+	syms->exprs[syms->n++] = (const MML_expr *)value;
+	return 0;
+}
+
+int32_t MML_save_snapshot(MML_state *restrict state, const char *path)
+{
+	const size_t n_vars = (state->variables != nullptr) ? hashmap_size(state->variables) : 0;
+	strbuf *names __attribute__((cleanup(MML_free_pp))) = malloc(n_vars * sizeof(strbuf));
+	const MML_expr **exprs __attribute__((cleanup(MML_free_pp)))
+		= malloc(n_vars * sizeof(MML_expr *));
+	if ((names == NULL || exprs == NULL) && n_vars != 0)
+		return -1;
+	struct symbol_list syms = { names, exprs, 0 };
+	if (n_vars != 0)
+		hashmap_iterate(state->variables, collect_symbol, &syms);
+
+	struct snapshot_writer w = { 0 };
+	alloc_bytes(&w, sizeof(struct MML_snapshot_header));
+	const uint64_t symbols_off = alloc_bytes(&w, syms.n * sizeof(struct MML_snapshot_symbol));
+	for (size_t i = 0; i < syms.n && !w.failed; ++i)
+	{
+		const uint64_t name_off = alloc_bytes(&w, names[i].len + 1);
+		if (w.failed)
+			break;
+		memcpy(w.buf + name_off, names[i].s, names[i].len);
+
+		const uint64_t sym_off = symbols_off + i*sizeof(struct MML_snapshot_symbol);
+		struct MML_snapshot_symbol *sym = (struct MML_snapshot_symbol *)(w.buf + sym_off);
+		sym->name_off = name_off;
+		sym->name_len = names[i].len;
+		w.root_at = sym_off + offsetof(struct MML_snapshot_symbol, expr_off);
+		w.n_fields = 0;
+		w.failed |= !MML_expr_walk(exprs[i], write_node, &w);
+	}
+
+	int32_t ret = -1;
+	if (w.failed)
+	{
+		MML_log_err("failed to build snapshot for '%s'\n", path);
+		goto out;
+	}
+
+	*(struct MML_snapshot_header *)w.buf = (struct MML_snapshot_header) {
+		.magic = MML_SNAPSHOT_MAGIC,
+		.version = MML_SNAPSHOT_VERSION,
+		.byte_order = BYTE_ORDER_MARK,
+		.expr_size = sizeof(MML_expr),
+		.base = (uintptr_t)MML_SNAPSHOT_BASE,
+		.symbols_off = symbols_off,
+		.n_symbols = syms.n,
+		.relocs_off = w.len,
+		.n_relocs = dv_n(w.relocs),
+	};
+
+	// written next to PATH and renamed over it, so readers never see half
+	char tmp_path[4096];
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+	FILE *f = fopen(tmp_path, "wb");
+	if (f == NULL)
+	{
+		MML_log_err("failed to open '%s' for writing\n", tmp_path);
+		goto out;
+	}
+	const bool written = fwrite(w.buf, 1, w.len, f) == w.len
+		&& fwrite(_dv_ptr(w.relocs), sizeof(uint64_t), dv_n(w.relocs), f) == dv_n(w.relocs);
+	if (fclose(f) != 0 || !written || rename(tmp_path, path) != 0)
+	{
+		MML_log_err("failed to write snapshot '%s'\n", path);
+		remove(tmp_path);
+		goto out;
+	}
+	ret = 0;
+
+out:
+	free(w.buf);
+	free(w.fields);
+	dv_destroy(w.relocs);
+	return ret;
+}
+
+static bool in_file(strbuf file, uint64_t off, uint64_t size)
+{
+	return off <= file.len && size <= file.len - off;
+}
+
+int32_t MML_load_snapshot(MML_state *restrict state, const char *path)
+{
+	strbuf file = MML_map_file_at(path, (void *)(uintptr_t)MML_SNAPSHOT_BASE);
+	if (file.s == NULL)
+		return -1;
+
+	const struct MML_snapshot_header *header = (const struct MML_snapshot_header *)file.s;
+	if (!in_file(file, 0, sizeof(*header))
+	 || memcmp(header->magic, MML_SNAPSHOT_MAGIC, sizeof(header->magic)) != 0)
+	{
+		MML_log_err("'%s' isn't a snapshot\n", path);
+		goto fail;
+	}
+	if (header->version != MML_SNAPSHOT_VERSION
+	 || header->byte_order != BYTE_ORDER_MARK
+	 || header->expr_size != sizeof(MML_expr))
+	{
+		MML_log_err("snapshot '%s' was written by an incompatible build\n", path);
+		goto fail;
+	}
+	if (header->n_symbols > file.len / sizeof(struct MML_snapshot_symbol)
+	 || header->n_relocs > file.len / sizeof(uint64_t)
+	 || !in_file(file, header->symbols_off, header->n_symbols * sizeof(struct MML_snapshot_symbol))
+	 || !in_file(file, header->relocs_off, header->n_relocs * sizeof(uint64_t)))
+		goto corrupt;
+
+	// mapped where the pointers expect, they are only checked; elsewhere
+	// they are moved in place, and the mapping is private, so only the
+	// pages holding them are copied
+	const bool relocate = (uintptr_t)file.s != header->base;
+	if (relocate && mprotect(file.s, file.len, PROT_READ | PROT_WRITE) != 0)
+	{
+		MML_log_err("failed to relocate snapshot '%s'\n", path);
+		goto fail;
+	}
+	const uint64_t *relocs = (const uint64_t *)(file.s + header->relocs_off);
+	for (uint64_t i = 0; i < header->n_relocs; ++i)
+	{
+		uintptr_t target;
+		if (relocs[i] % sizeof(uintptr_t) != 0 || !in_file(file, relocs[i], sizeof(target)))
+			goto corrupt;
+		memcpy(&target, file.s + relocs[i], sizeof(target));
+		target -= header->base;
+		if (target == 0 || target >= file.len)
+			goto corrupt;
+		if (!relocate)
+			continue;
+		target += (uintptr_t)file.s;
+		memcpy(file.s + relocs[i], &target, sizeof(target));
+	}
+	if (relocate)
+		mprotect(file.s, file.len, PROT_READ);
+
+	const struct MML_snapshot_symbol *syms
+		= (const struct MML_snapshot_symbol *)(file.s + header->symbols_off);
+	for (uint64_t i = 0; i < header->n_symbols; ++i)
+		if (!in_file(file, syms[i].name_off, syms[i].name_len)
+		 || syms[i].expr_off % sizeof(uintptr_t) != 0
+		 || !in_file(file, syms[i].expr_off, sizeof(MML_expr)))
+			goto corrupt;
+
+	dv_push(state->mapped_files, file);
+	for (uint64_t i = 0; i < header->n_symbols; ++i)
+		MML_eval_set_variable(state,
+				(strbuf) { file.s + syms[i].name_off, syms[i].name_len },
+				(MML_expr *)(file.s + syms[i].expr_off));
+
+	return 0;
+
+corrupt:
+	MML_log_err("snapshot '%s' is corrupt\n", path);
+fail:
+	MML_unmap_file(file);
+	return -1;
+}
@@ -0,0 +1,147 @@
+#include "mml/stream.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mml/config.h"
+#include "mml/parser.h"
+
+#define READ_CHUNK 65536
+
+struct MML_stmt_reader {
+	FILE *stream;
+
+	char *buf;
+	size_t cap;
+	size_t start;	// where the next statement begins
+	size_t scanned;	// no `;` before this ends the next statement
+	size_t len;
+
+	bool eof;
+	bool done;
+};
+
+MML_stmt_reader *MML_stmt_reader_open(FILE *stream)
+{
+	MML_stmt_reader *r = calloc(1, sizeof(MML_stmt_reader));
+	if (r == NULL)
+		return NULL;
+
+	r->stream = stream;
+	r->cap = READ_CHUNK + 1;
+	r->buf = malloc(r->cap);
+	if (r->buf == NULL)
+	{
+		free(r);
+		return NULL;
+	}
+
+	return r;
+}
+
+// Reads another chunk behind the unfinished statement, moving it to the
+// front of the buffer first. Returns false if nothing more could be read.
+static bool fill(MML_stmt_reader *r)
+{
+	if (r->start != 0)
+	{
+		memmove(r->buf, r->buf + r->start, r->len - r->start);
+		r->len -= r->start;
+		r->scanned -= r->start;
+		r->start = 0;
+	}
+
+	// a statement longer than the buffer makes it grow; one byte is always
+	// left over for the terminator
+	if (r->cap - r->len < READ_CHUNK + 1)
+	{
+		size_t cap = r->cap * 2;
+		while (cap - r->len < READ_CHUNK + 1)
+			cap *= 2;
+		char *buf = realloc(r->buf, cap);
+		if (buf == NULL)
+		{
+			MML_log_err("failed to grow statement buffer to %zu bytes\n", cap);
+			return false;
+		}
+		r->buf = buf;
+		r->cap = cap;
+	}
+
+	const size_t n = fread(r->buf + r->len, 1, READ_CHUNK, r->stream);
+	r->len += n;
+	if (n == 0)
+	{
+		if (ferror(r->stream))
+			MML_log_err("failed to read statements from stream\n");
+		r->eof = true;
+		return false;
+	}
+
+	return true;
+}
+
+// Parses the statement at the start of the unread input, with the input
+// cut off at END. Returns whether the statement is the one the parser would
+// read from the whole input.
+static bool parse_until(MML_stmt_reader *r, const char *end, MML_expr **out)
+{
+	struct parser_state state = { .lex_end = end, .quiet = true };
+	const char *s = r->buf + r->start;
+	bool has_more;
+	*out = MML_parse_next_stmt(&s, &state, &has_more);
+
+	// a statement that ended at a `;` never looked past it; otherwise the
+	// parser ran into END, which is only where the input ends at EOF
+	const bool complete = has_more || (r->eof && end == r->buf + r->len);
+	if (!complete)
+		return false;
+	if (state.had_problem)
+	{
+		// parsed again so that the problem is logged
+		s = r->buf + r->start;
+		state = (struct parser_state) { .lex_end = end };
+		*out = MML_parse_next_stmt(&s, &state, &has_more);
+	}
+
+	r->start = r->scanned = s - r->buf;
+	r->done = !has_more;
+	return true;
+}
+
+bool MML_stmt_reader_next(MML_stmt_reader *r, MML_expr **out)
+{
+	if (r->done)
+		return false;
+
+	// the statement is parsed up to each `;` in turn, since one inside
+	// brackets may not end it; the parser decides, as it does for
+	// `MML_parse_stmts`
+	for (;;)
+	{
+		const char *semi = memchr(r->buf + r->scanned, ';', r->len - r->scanned);
+		if (semi != NULL)
+		{
+			if (parse_until(r, semi + 1, out))
+				return true;
+			r->scanned = semi + 1 - r->buf;
+		} else if (r->eof || !fill(r))
+		{
+			// whatever is left is the last statement
+			r->eof = true;
+			r->buf[r->len] = '\0';
+			parse_until(r, r->buf + r->len, out);
+			r->done = true;
+			return true;
+		}
+	}
+}
+
+void MML_stmt_reader_close(MML_stmt_reader *r)
+{
+	if (r == NULL)
+		return;
+
+	free(r->buf);
+	free(r);
+}
@@ -0,0 +1,232 @@
+// SA_RESTART
+#define _DEFAULT_SOURCE
+#include "mml/trace.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct trace_event {
+	uint64_t nsecs;
+	const MML_trace_site *site;
+	uint64_t args[2];
+} trace_event;
+
+// Written only by the thread that holds it; `head` is published after the
+// event it counts, so a reader knows which slots may be mid-write.
+struct ring {
+	trace_event events[MML_TRACE_RING_SIZE];
+	_Atomic(uint64_t) head;	// events recorded
+	_Atomic(bool) in_use;
+	struct ring *next;	// every ring made, newest first
+	uint32_t id;
+};
+
+static _Atomic(struct ring *) all_rings = NULL;
+static _Atomic(uint32_t) n_rings = 0;
+static thread_local struct ring *own_ring = NULL;
+
+// hands the ring of an exiting thread on to the next thread that traces
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+static void release_ring(void *ring)
+{
+	atomic_store_explicit(&((struct ring *)ring)->in_use, false, memory_order_release);
+}
+
+static void make_ring_key(void)
+{
+	pthread_key_create(&ring_key, release_ring);
+}
+
+static struct ring *acquire_ring(void)
+{
+	pthread_once(&ring_key_once, make_ring_key);
+
+	struct ring *r = atomic_load_explicit(&all_rings, memory_order_acquire);
+	for (; r != NULL; r = r->next)
+	{
+		bool expected = false;
+		if (atomic_compare_exchange_strong(&r->in_use, &expected, true))
+			break;
+	}
+	if (r == NULL)
+	{
+		r = calloc(1, sizeof(*r));
+		if (r == NULL)
+			return NULL;
+		atomic_init(&r->in_use, true);
+		r->id = atomic_fetch_add(&n_rings, 1);
+		r->next = atomic_load_explicit(&all_rings, memory_order_relaxed);
+		while (!atomic_compare_exchange_weak_explicit(&all_rings, &r->next, r,
+					memory_order_release, memory_order_relaxed))
+			;
+	}
+	pthread_setspecific(ring_key, r);
+	return own_ring = r;
+}
+
+void MML_trace_emit(const MML_trace_site *site, uint64_t a, uint64_t b)
+{
+	struct ring *r = own_ring;
+	if (r == NULL && (r = acquire_ring()) == NULL)
+		return;
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	const uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+	trace_event *e = &r->events[head % MML_TRACE_RING_SIZE];
+	e->nsecs = (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+	e->site = site;
+	e->args[0] = a;
+	e->args[1] = b;
+	atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
+
+/* A line being made without stdio, which isn't async-signal-safe. */
+struct line {
+	char buf[256];
+	size_t n;
+};
+
+static void put_str(struct line *l, const char *s)
+{
+	while (*s != '\0' && l->n < sizeof(l->buf))
+		l->buf[l->n++] = *s++;
+}
+
+static void put_u64(struct line *l, uint64_t x, uint32_t min_digits)
+{
+	char digits[20];
+	uint32_t n = 0;
+	do {
+		digits[n++] = '0' + x % 10;
+		x /= 10;
+	} while (x != 0);
+	while (n < min_digits && n < sizeof(digits))
+		digits[n++] = '0';
+	while (n != 0 && l->n < sizeof(l->buf))
+		l->buf[l->n++] = digits[--n];
+}
+
+// like `%.6f`, or `%.6e` for magnitudes it would print badly
+static void put_f64(struct line *l, uint64_t bits)
+{
+	double x;
+	memcpy(&x, &bits, sizeof(x));
+	if (x != x)
+	{
+		put_str(l, "nan");
+		return;
+	}
+	if (x < 0)
+	{
+		put_str(l, "-");
+		x = -x;
+	}
+	if (x > 1.7976931348623157e308)
+	{
+		put_str(l, "inf");
+		return;
+	}
+
+	int32_t exp = 0;
+	const bool sci = x >= 1e15 || (x != 0 && x < 1e-4);
+	if (sci)
+	{
+		for (; x >= 10; x /= 10)
+			++exp;
+		for (; x < 1; x *= 10)
+			--exp;
+	}
+	uint64_t whole = (uint64_t)x;
+	uint64_t frac = (uint64_t)((x - (double)whole) * 1e6 + 0.5);
+	if (frac >= 1000000)
+	{
+		++whole;
+		frac -= 1000000;
+	}
+	put_u64(l, whole, 1);
+	put_str(l, ".");
+	put_u64(l, frac, 6);
+	if (sci)
+	{
+		put_str(l, (exp < 0) ? "e-" : "e+");
+		put_u64(l, (uint64_t)((exp < 0) ? -exp : exp), 2);
+	}
+}
+
+static const char *const LEVEL_STRINGS[] = {
+	"DEBUG", "INFO", "WARN", "ERROR",
+};
+
+void MML_trace_dump(int32_t fd)
+{
+	for (struct ring *r = atomic_load_explicit(&all_rings, memory_order_acquire);
+			r != NULL; r = r->next)
+	{
+		const uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+		const uint64_t first = (head > MML_TRACE_RING_SIZE) ? head - MML_TRACE_RING_SIZE : 0;
+		for (uint64_t i = first; i < head; ++i)
+		{
+			const trace_event e = r->events[i % MML_TRACE_RING_SIZE];
+			// the slot of event I is reused by event I + MML_TRACE_RING_SIZE,
+			// which may have been written while it was copied
+			atomic_thread_fence(memory_order_acquire);
+			if (i + MML_TRACE_RING_SIZE <= atomic_load_explicit(&r->head, memory_order_relaxed))
+				continue;
+
+			const MML_trace_site *site = e.site;
+			struct line l = { .n = 0 };
+			put_str(&l, "[trace ");
+			put_u64(&l, r->id, 1);
+			put_str(&l, "] ");
+			put_u64(&l, e.nsecs / 1000000000, 1);
+			put_str(&l, ".");
+			put_u64(&l, e.nsecs % 1000000000, 9);
+			put_str(&l, " ");
+			put_str(&l, (site->level < MML_TRACE_OFF) ? LEVEL_STRINGS[site->level] : "?");
+			put_str(&l, " ");
+			put_str(&l, site->file);
+			put_str(&l, ":");
+			put_u64(&l, site->line, 1);
+			put_str(&l, " ");
+			put_str(&l, site->name);
+			for (uint8_t arg = 0; arg < site->n_args && arg < 2; ++arg)
+			{
+				put_str(&l, " ");
+				if (site->float_args & (1 << arg))
+					put_f64(&l, e.args[arg]);
+				else
+					put_u64(&l, e.args[arg], 1);
+			}
+			if (l.n == sizeof(l.buf))
+				--l.n;
+			l.buf[l.n++] = '\n';
+			for (size_t off = 0; off < l.n; )
+			{
+				const ssize_t written = write(fd, l.buf + off, l.n - off);
+				if (written <= 0)
+					return;
+				off += (size_t)written;
+			}
+		}
+	}
+}
+
+static void dump_handler(int)
+{
+	MML_trace_dump(STDERR_FILENO);
+}
+
+int32_t MML_trace_dump_on_signal(int32_t signum)
+{
+	struct sigaction sa = { .sa_handler = dump_handler, .sa_flags = SA_RESTART };
+	sigemptyset(&sa.sa_mask);
+	return (sigaction(signum, &sa, NULL) == 0) ? 0 : -1;
+}
@@ -0,0 +1,439 @@
+// M_E, mkdtemp, usleep
+#define _GNU_SOURCE
+#include <math.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "mml/cache.h"
+#include "mml/config.h"
+#include "mml/dtoa.h"
+#include "mml/eval.h"
+#include "mml/expr.h"
+#include "mml/parser.h"
+#include "mml/reduce.h"
+#include "mml/server.h"
+#include "mml/snapshot.h"
+#include "arena/arena.h"
+#include "cvi/dvec/dvec.h"
+
+static uint32_t n_failed = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) \
+	{ \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		++n_failed; \
+	} \
+} while (0)
+
+static char tmp_dir[] = "/tmp/mml_tests_XXXXXX";
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+
+// xorshift64*
+static uint64_t rng_next(void)
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545f4914f6cdd1dull;
+}
+
+static bool same_bits(double a, double b)
+{
+	return memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+static MML_value eval_src(MML_state *state, const char *src)
+{
+	MML_value out;
+	MML_eval_parse_many(state, &src, 1, &out);
+	return out;
+}
+
+// reductions give the same bits however many threads they use (user-026)
+static void test_reduce_threads(MML_state *state)
+{
+	const size_t n = 3*MML_REDUCE_PARALLEL_MIN + 17;
+	double *xs = malloc(n * sizeof(double));
+	for (size_t i = 0; i < n; ++i)
+		xs[i] = (double)(int64_t)rng_next() / (double)(1ull << (rng_next() % 60));
+
+	for (uint32_t compensated = 0; compensated < 2; ++compensated)
+	{
+		const MML_reduce_opts serial = { 1, compensated };
+		const double want = MML_reduce_sum(xs, n, &serial);
+		const uint32_t threads[] = { 2, 3, 8, MML_REDUCE_MAX_THREADS };
+		for (size_t i = 0; i < sizeof(threads)/sizeof(threads[0]); ++i)
+		{
+			const MML_reduce_opts opts = { threads[i], compensated };
+			CHECK(same_bits(MML_reduce_sum(xs, n, &opts), want));
+		}
+	}
+
+	// and so does `sum` on a vector variable
+	char path[sizeof(tmp_dir) + 16];
+	snprintf(path, sizeof(path), "%s/xs.f64", tmp_dir);
+	FILE *f = fopen(path, "wb");
+	CHECK(f != NULL && fwrite(xs, sizeof(double), n, f) == n);
+	fclose(f);
+	CHECK(MML_bind_vector_mmap(state, (strbuf) { "xs", 2 }, path) == 0);
+
+	const MML_reduce_opts saved = state->config->reduce;
+	state->config->reduce.threads = 1;
+	const MML_value want = eval_src(state, "sum{xs}");
+	CHECK(want.type == RealNumber_type);
+	state->config->reduce.threads = 8;
+	const MML_value got = eval_src(state, "sum{xs}");
+	CHECK(got.type == RealNumber_type && same_bits(got.n, want.n));
+	state->config->reduce = saved;
+	free(xs);
+}
+
+// budgets and cancellation stop an evaluation with their own codes (user-027)
+static void test_budget_cancel(void)
+{
+	MML_state *state = MML_init_state();
+	char src[4096] = "1";
+	for (size_t len = 1; len + 2 < sizeof(src); len += 2)
+		memcpy(src + len, "+1", 3);
+
+	MML_eval_set_budget(state, &(MML_eval_budget) { .max_nodes = 100 });
+	MML_value val = eval_src(state, src);
+	CHECK(val.type == Invalid_type && val.i == MML_NODE_LIMIT_INVAL);
+
+	MML_eval_set_budget(state, &(MML_eval_budget) { .max_depth = 16 });
+	val = eval_src(state, "1+(1+(1+(1+(1+(1+(1+(1+(1+(1+(1+(1+(1+(1+(1+(1+(1+(1+(1+1))))))))))))))))))");
+	CHECK(val.type == Invalid_type && val.i == MML_DEPTH_LIMIT_INVAL);
+
+	// a budget applies to each evaluation on its own
+	MML_eval_set_budget(state, &(MML_eval_budget) { .max_nodes = 100 });
+	val = eval_src(state, "1 + 2");
+	CHECK(val.type == RealNumber_type && val.n == 3);
+
+	MML_eval_cancel(state);
+	const char *srcs[] = { "1", "2", "3" };
+	MML_value out[3];
+	CHECK(MML_eval_parse_many(state, srcs, 3, out) == 1);
+	for (size_t i = 0; i < 3; ++i)
+		CHECK(out[i].type == Invalid_type && out[i].i == MML_CANCELLED_INVAL);
+	val = eval_src(state, "1 + 2");
+	CHECK(val.type == RealNumber_type && val.n == 3);
+	MML_cleanup_state(state);
+}
+
+static bool write_all(int fd, const void *buf, size_t len)
+{
+	for (const char *p = buf; len != 0; )
+	{
+		const ssize_t n = write(fd, p, len);
+		if (n <= 0)
+			return false;
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+static bool read_all(int fd, void *buf, size_t len)
+{
+	for (char *p = buf; len != 0; )
+	{
+		const ssize_t n = read(fd, p, len);
+		if (n <= 0)
+			return false;
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+// Sends SRC as one request and reads the reply's status and text into TEXT.
+// Returns -1 if the connection was closed instead.
+static int32_t request(int fd, const char *src, char *text, size_t text_size)
+{
+	const uint32_t len = strlen(src);
+	if (!write_all(fd, &len, sizeof(len)) || !write_all(fd, src, len))
+		return -1;
+
+	uint32_t reply_len;
+	uint8_t status;
+	if (!read_all(fd, &reply_len, sizeof(reply_len)) || reply_len == 0
+	 || reply_len > text_size || !read_all(fd, &status, 1)
+	 || !read_all(fd, text, reply_len - 1))
+		return -1;
+	text[reply_len - 1] = '\0';
+	return status;
+}
+
+static int connect_to(const char *path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+	// the server may not be listening yet
+	for (uint32_t tries = 0; tries < 200; ++tries)
+	{
+		const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+			return fd;
+		close(fd);
+		usleep(10000);
+	}
+	return -1;
+}
+
+// the framed protocol of `MML_serve` (user-028)
+static void test_server(void)
+{
+	char path[sizeof(tmp_dir) + 16];
+	snprintf(path, sizeof(path), "%s/serve.sock", tmp_dir);
+	fflush(NULL);
+	const pid_t pid = fork();
+	if (pid == 0)
+		_exit(MML_serve(path) == 0 ? 0 : 1);
+
+	const int a = connect_to(path);
+	const int b = connect_to(path);
+	CHECK(a >= 0 && b >= 0);
+	char text[256];
+	CHECK(request(a, "x = 2; x * 21", text, sizeof(text)) == MML_SERVE_OK);
+	CHECK(strcmp(text, "42\n") == 0);
+	CHECK(request(a, "print{x}; x + 1", text, sizeof(text)) == MML_SERVE_OK);
+	CHECK(strcmp(text, "23\n") == 0);
+	// variables are kept per connection
+	CHECK(request(b, "x", text, sizeof(text)) == MML_SERVE_INVALID);
+	CHECK(request(b, "x = 5", text, sizeof(text)) == MML_SERVE_OK);
+	CHECK(request(a, "x", text, sizeof(text)) == MML_SERVE_OK);
+	CHECK(strcmp(text, "2\n") == 0);
+
+	// a request over the limit closes the connection
+	const uint32_t too_long = MML_SERVE_MAX_REQUEST + 1;
+	CHECK(write_all(b, &too_long, sizeof(too_long)));
+	CHECK(read(b, text, 1) == 0);
+	CHECK(request(a, "x", text, sizeof(text)) == MML_SERVE_OK);
+	close(a);
+	close(b);
+
+	int status;
+	kill(pid, SIGTERM);
+	CHECK(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+// scientific notation and packed vector literals (user-042, user-045)
+static void test_number_literals(MML_state *state)
+{
+	MML_value val = eval_src(state, "1.5e-9");
+	CHECK(val.type == RealNumber_type && same_bits(val.n, strtod("1.5e-9", NULL)));
+	// an `e` with no exponent after it is Euler's number
+	val = eval_src(state, "2e");
+	CHECK(val.type == RealNumber_type && same_bits(val.n, 2*M_E));
+	val = eval_src(state, "2E+3");
+	CHECK(val.type == RealNumber_type && val.n == 2000);
+
+	const MML_expr *packed = MML_parse("[1, 2.5e3, -3, 0.1]");
+	const MML_expr *unpacked = MML_parse("[1, 2.5e3, -3, 0.1 + 0]");
+	CHECK(packed != NULL && packed->type == Vector_type && packed->v.packed != NULL);
+	CHECK(unpacked != NULL && unpacked->type == Vector_type && unpacked->v.packed == NULL);
+	if (packed == NULL || unpacked == NULL || packed->v.n != unpacked->v.n)
+	{
+		++n_failed;
+		return;
+	}
+	for (size_t i = 0; i < packed->v.n; ++i)
+	{
+		const MML_value a = MML_vec_elem(state, &packed->v, i);
+		const MML_value b = MML_vec_elem(state, &unpacked->v, i);
+		CHECK(a.type == RealNumber_type && b.type == RealNumber_type && same_bits(a.n, b.n));
+	}
+	val = eval_src(state, "sum{[1, 2.5e3, -3, 0.1]} == sum{[1, 2.5e3, -3, 0.1 + 0]}");
+	CHECK(val.type == Boolean_type && val.b);
+}
+
+static bool same_stmt(MML_state *state, const MML_expr *a, const MML_expr *b)
+{
+	MML_cache_key ka, kb;
+	return MML_cache_key_make(state, &a, 1, &ka) && MML_cache_key_make(state, &b, 1, &kb)
+		&& ka.lo == kb.lo && ka.hi == kb.hi;
+}
+
+// parsing a script in parallel gives the statements a serial parse does (user-043)
+static void test_parallel_parse(void)
+{
+	// with no variables to hash, the keys only cover the trees
+	MML_state *state = MML_init_state();
+	const size_t n_stmts = 60000;
+	char *src = malloc(n_stmts * 64);
+	size_t len = 0;
+	for (size_t i = 0; i < n_stmts; ++i)
+		len += sprintf(src + len, "x%zu = [%zu, 1.5e-3] * (%zu - y) ^ 2;\n", i, i, i % 7);
+
+	Arena *serial_arena = arena_make(1 << 16);
+	Arena *parallel_arena = arena_make(1 << 16);
+	MML_expr_dvec serial = MML_parse_stmts_in(serial_arena, src, false);
+	MML_expr_dvec parallel = MML_parse_stmts_parallel(parallel_arena, src, false, 8);
+	CHECK(dv_n(serial) == dv_n(parallel));
+	bool same = dv_n(serial) == dv_n(parallel);
+	for (size_t i = 0; same && i < dv_n(serial); ++i)
+		same = same_stmt(state, _dv_ptr(serial)[i], _dv_ptr(parallel)[i]);
+	CHECK(same);
+
+	dv_destroy(serial);
+	dv_destroy(parallel);
+	arena_destroy(serial_arena);
+	arena_destroy(parallel_arena);
+	free(src);
+	MML_cleanup_state(state);
+}
+
+// MML_dtoa reads back as the same double, and matches snprintf (user-033)
+static void test_dtoa(void)
+{
+	char buf[MML_DTOA_BUF_SIZE], want[64];
+	uint32_t n_mismatched = 0;
+	for (uint32_t i = 0; i < 200000; ++i)
+	{
+		double x;
+		const uint64_t bits = rng_next();
+		memcpy(&x, &bits, sizeof(x));
+		if (!isfinite(x))
+			continue;
+
+		CHECK(MML_dtoa_shortest(buf, sizeof(buf), x) < sizeof(buf));
+		n_mismatched += !same_bits(strtod(buf, NULL), x);
+
+		const uint32_t prec = 1 + i % 17;
+		MML_dtoa_g(buf, sizeof(buf), x, prec);
+		snprintf(want, sizeof(want), "%.*g", (int)prec, x);
+		n_mismatched += strcmp(buf, want) != 0;
+	}
+	CHECK(n_mismatched == 0);
+
+	const double edges[] = { 0.0, -0.0, 5e-324, 2.2250738585072014e-308, 1.7976931348623157e308, 0.1, 1e23 };
+	for (size_t i = 0; i < sizeof(edges)/sizeof(edges[0]); ++i)
+	{
+		MML_dtoa_shortest(buf, sizeof(buf), edges[i]);
+		CHECK(same_bits(strtod(buf, NULL), edges[i]));
+	}
+}
+
+// variables survive a snapshot being saved and loaded (user-039)
+static void test_snapshot(void)
+{
+	char path[sizeof(tmp_dir) + 16];
+	snprintf(path, sizeof(path), "%s/vars.snap", tmp_dir);
+
+	MML_state *saver = MML_init_state();
+	MML_value val = eval_src(saver, "v = [1, 2, 3]; f = sum{v} * k; g = [1, [2, k + 3]]; name = k");
+	CHECK(MML_save_snapshot(saver, path) == 0);
+	MML_cleanup_state(saver);
+
+	MML_state *loader = MML_init_state();
+	CHECK(MML_load_snapshot(loader, path) == 0);
+	val = eval_src(loader, "k = 2; f");
+	CHECK(val.type == RealNumber_type && val.n == 12);
+	val = eval_src(loader, "sum{v} + name");
+	CHECK(val.type == RealNumber_type && val.n == 8);
+	val = eval_src(loader, "g");
+	CHECK(val.type == Vector_type && val.v.n == 2);
+	MML_cleanup_state(loader);
+
+	// a file that isn't a snapshot is refused
+	FILE *f = fopen(path, "wb");
+	fputs("not a snapshot", f);
+	fclose(f);
+	loader = MML_init_state();
+	CHECK(MML_load_snapshot(loader, path) == -1);
+	MML_cleanup_state(loader);
+}
+
+// Evaluates SRC on STATE through the cache in DIR, as `mml --cache-dir` does,
+// writing what it printed (or replayed) to OUT. Returns whether it was a hit.
+static bool cached_eval(MML_state *state, const char *dir, const char *src, char *out, size_t size)
+{
+	MML_cache *cache = MML_cache_open(dir);
+	CHECK(cache != NULL);
+	MML_expr_dvec stmts = MML_parse_stmts(src);
+	MML_cache_key key;
+	CHECK(MML_cache_key_make(state, (const MML_expr *const *)_dv_ptr(stmts), dv_n(stmts), &key));
+
+	FILE *sink = fmemopen(out, size, "w");
+	const bool hit = MML_cache_replay(cache, key, sink);
+	if (!hit)
+	{
+		MML_outbuf_set_sink(&state->out, sink);
+		MML_cache_capture(cache, state);
+		MML_expr **cur;
+		dv_foreach(stmts, cur)
+			MML_eval_expr(state, *cur);
+		MML_outbuf_flush(&state->out);
+		MML_cache_commit(cache, state, key, true);
+		MML_outbuf_set_sink(&state->out, stdout);
+	}
+	fclose(sink);
+	dv_destroy(stmts);
+	MML_cache_close(cache);
+	return hit;
+}
+
+// a result is stored on the first run and replayed after (user-038)
+static void test_cache(MML_state *state)
+{
+	char dir[sizeof(tmp_dir) + 16];
+	snprintf(dir, sizeof(dir), "%s/cache", tmp_dir);
+	char first[64] = { 0 }, again[64] = { 0 }, other[64] = { 0 };
+
+	CHECK(!cached_eval(state, dir, "println{6 * 7}", first, sizeof(first)));
+	CHECK(strcmp(first, "42\n") == 0);
+	CHECK(cached_eval(state, dir, "println{6 * 7}", again, sizeof(again)));
+	CHECK(strcmp(again, first) == 0);
+	CHECK(!cached_eval(state, dir, "println{6 * 8}", other, sizeof(other)));
+	CHECK(strcmp(other, "48\n") == 0);
+
+	// the key covers the variables that are set
+	eval_src(state, "c = 1");
+	CHECK(!cached_eval(state, dir, "println{c}", first, sizeof(first)));
+	eval_src(state, "c = 2");
+	CHECK(!cached_eval(state, dir, "println{c}", other, sizeof(other)));
+	CHECK(strcmp(other, "2\n") == 0);
+}
+
+int main(void)
+{
+	if (mkdtemp(tmp_dir) == NULL)
+	{
+		perror("mkdtemp");
+		return 1;
+	}
+	MML_global_config.eval_state = MML_init_state();
+	MML_state *state = MML_global_config.eval_state;
+
+	test_reduce_threads(state);
+	test_budget_cancel();
+	test_server();
+	test_number_literals(state);
+	test_parallel_parse();
+	test_dtoa();
+	test_snapshot();
+	test_cache(state);
+
+	MML_cleanup_state(state);
+	char cmd[sizeof(tmp_dir) + 16];
+	snprintf(cmd, sizeof(cmd), "rm -rf %s", tmp_dir);
+	if (system(cmd) != 0)
+		fprintf(stderr, "failed to remove %s\n", tmp_dir);
+
+	if (n_failed != 0)
+	{
+		fprintf(stderr, "%u checks failed\n", n_failed);
+		return 1;
+	}
+	puts("all tests passed");
+	return 0;
+}
@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+# Makes the builtin table `src/builtins_incl.c` from `src/builtins.def`:
+# a dense array of the builtins, and a table of slots that every name hashes
+# to a different one of, so `MML_builtin_get` finds a name with one probe.
+#
+#   usage: tools/gen_builtins.py src/builtins.def src/builtins_incl.c
+
+import re
+import sys
+
+KINDS = {
+    'VEC': 'vec',
+    'D_DD': 'd_dd',
+    'CD_CDCD': 'cd_cdcd',
+    'D_V': 'd_v',
+    'CD_D': 'cd_d',
+    'D_D': 'd_d',
+    'D_CD': 'd_cd',
+    'CD_CD': 'cd_cd',
+}
+LINE = re.compile(r'^MML_(FUNC|CONSTANT)\((\w+),\s*(.*)\)$')
+MASK32 = 0xffffffff
+
+
+# must stay the same as `builtin_hash` in src/builtins.c
+def builtin_hash(name, seed):
+    h = (seed ^ len(name)) & MASK32
+    for c in name.encode():
+        h = ((h ^ c) * 0x01000193) & MASK32
+    return h ^ (h >> 15)
+
+
+def read_def(path):
+    builtins = {}  # name -> {field: initializer}, in the order of PATH
+    with open(path) as f:
+        for n, line in enumerate(f, 1):
+            line = line.strip()
+            if not line or line.startswith('//'):
+                continue
+            m = LINE.match(line)
+            if m is None:
+                sys.exit(f'{path}:{n}: not a builtin: {line}')
+            what, name, rest = m.groups()
+            fields = builtins.setdefault(name, {})
+            if what == 'FUNC':
+                kind, func, *flags = (s.strip() for s in rest.split(','))
+                if kind not in KINDS:
+                    sys.exit(f'{path}:{n}: unknown kind {kind}')
+                if flags not in ([], ['IMPURE']):
+                    sys.exit(f'{path}:{n}: unknown flags {flags}')
+                if flags:
+                    fields['impure'] = 'true'
+                field = KINDS[kind]
+                value = func
+            else:
+                field = 'constant'
+                value = rest.strip()
+            if field in fields:
+                sys.exit(f'{path}:{n}: `{name}` already has a {field}')
+            fields[field] = value
+    return builtins
+
+
+def find_seed(names, n_slots):
+    for seed in range(1, 1 << 24):
+        slots = {builtin_hash(name, seed) & (n_slots - 1) for name in names}
+        if len(slots) == len(names):
+            return seed
+    sys.exit('no seed hashes every name to a different slot')
+
+
+def main():
+    def_path, out_path = sys.argv[1:3]
+    builtins = read_def(def_path)
+    names = list(builtins)
+    if len(names) > 255:
+        sys.exit('too many builtins for a uint8_t slot table')
+
+    # 4 slots a name keeps the search for a seed short
+    n_slots = 1
+    while n_slots < 4 * len(names):
+        n_slots *= 2
+    seed = find_seed(names, n_slots)
+
+    out = [
+        '// Table for `src/builtins.c`, included from there. Generated from',
+        '// `src/builtins.def` by `tools/gen_builtins.py`; edit those instead.',
+        '',
+        f'#define BUILTIN_HASH_SEED {seed:#x}u',
+        f'#define BUILTIN_N_SLOTS {n_slots}',
+        f'#define BUILTIN_MAX_LEN {max(len(name) for name in names)}',
+        '',
+        f'static const MML_builtin BUILTINS[{len(names)}] = {{',
+    ]
+    for name in names:
+        fields = builtins[name]
+        inits = [f'"{name}"', str(len(name))]
+        if 'constant' in fields:
+            inits += ['.is_constant = true', f'.constant = {fields["constant"]}']
+        inits += [f'.fn.{field} = {fields[field]}'
+                  for field in [*KINDS.values(), 'impure'] if field in fields]
+        out.append(f'\t{{ {", ".join(inits)} }},')
+    out += [
+        '};',
+        '',
+        '// 1 + the index into BUILTINS of the name hashing to each slot, or 0',
+        'static const uint8_t BUILTIN_SLOTS[BUILTIN_N_SLOTS] = {',
+    ]
+    slots = sorted((builtin_hash(name, seed) & (n_slots - 1), i + 1) for i, name in enumerate(names))
+    out += [f'\t[{slot}] = {i},' for slot, i in slots]
+    out += ['};', '']
+
+    with open(out_path, 'w') as f:
+        f.write('\n'.join(out))
+
+
+if __name__ == '__main__':
+    main()